@@ -21,13 +21,18 @@
 
 #include <memory/heap.h>
 #include <memory/paging.h>
+#include <memory/buddy.h>
 
 #include <init/inits.h>
+#include <utils/timing.h>
+#include <utils/memory.h>
+#include <utils/fpu.h>
 
 // New includes for network manager
 #include <drivers/pci.h>
 #include <drivers/e1000.h>
 #include <net/net.h>
+#include <net/checksum.h>
 #include <net/socket.h>
 #include <exec/process.h>
 #include <exec/syscall.h>
@@ -36,9 +41,15 @@
 void kernel_main(void)
 {
     init_interrupts_safe();
+    memory_init();
+    fpu_init();
+    timing_init();
 
     // Detect physical memory and allocate page tables
     paging_init();
+    buddy_init();
+    heap_benchmark_boot();
+    checksum_init();
 
     // Initialize input devices
     keyboard_init();
@@ -51,6 +62,7 @@ void kernel_main(void)
 
     // Initialize PCI and network
     pci_init();
+    netbuf_init();
     int net_status = e1000_init();
     if (net_status == 0) {
         net_init();
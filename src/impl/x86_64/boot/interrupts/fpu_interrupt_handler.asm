@@ -0,0 +1,32 @@
+[BITS 64]
+[GLOBAL fpu_interrupt_handler]
+[EXTERN fpu_handle_device_not_available]
+
+; #NM (vector 7): first SIMD/FPU instruction while CR0.TS is set
+fpu_interrupt_handler:
+    ; Save caller-saved registers (callee-saved ones are preserved by C)
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+
+    ; Load or save the FPU state, then clear TS
+    call fpu_handle_device_not_available
+
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+
+    ; Restart the faulting instruction
+    iretq
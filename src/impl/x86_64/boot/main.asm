@@ -9,6 +9,10 @@ global screen_height
 global bits_per_pixel
 global pitch
 global total_physical_memory
+global mmap_regions
+global mmap_region_count
+
+MMAP_MAX_REGIONS equ 32
 
 framebuffer_address: dq 0
 screen_width: dd 0
@@ -16,6 +20,10 @@ screen_height: dd 0
 bits_per_pixel: dd 0
 pitch: dd 0
 total_physical_memory: dq 0
+; Available RAM regions from the memory map: (u64 base, u64 length) pairs
+mmap_region_count: dd 0
+align 8
+mmap_regions: times MMAP_MAX_REGIONS * 16 db 0
 
 section .text
 bits 32
@@ -132,6 +140,7 @@ parse_multiboot2_info:
     xor eax, eax
     mov [total_physical_memory], eax
     mov [total_physical_memory + 4], eax
+    mov [mmap_region_count], eax
 
 .mmap_loop:
     cmp edi, ecx
@@ -148,6 +157,21 @@ parse_multiboot2_info:
     mov eax, [edi + 12]     ; length high 32 bits
     adc [total_physical_memory + 4], eax
 
+    ; Record the region for the physical page allocator (16 bytes each)
+    mov edx, [mmap_region_count]
+    cmp edx, MMAP_MAX_REGIONS
+    jge .mmap_next
+    shl edx, 4
+    mov eax, [edi]          ; base low
+    mov [mmap_regions + edx], eax
+    mov eax, [edi + 4]      ; base high
+    mov [mmap_regions + edx + 4], eax
+    mov eax, [edi + 8]      ; length low
+    mov [mmap_regions + edx + 8], eax
+    mov eax, [edi + 12]     ; length high
+    mov [mmap_regions + edx + 12], eax
+    inc dword [mmap_region_count]
+
 .mmap_next:
     add edi, ebx            ; advance by entry_size
     jmp .mmap_loop
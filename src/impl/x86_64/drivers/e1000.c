@@ -2,8 +2,12 @@
 #include "drivers/pci.h"
 #include "interrupts/port_io.h"
 #include "interrupts/idt.h"
+#include "interrupts/irq_flags.h"
 #include "memory/heap.h"
+#include "memory/buddy.h"
+#include "memory/paging.h"
 #include "utils/memory.h"
+#include "net/net.h"
 
 // Global e1000 device
 static e1000_device_t e1000_dev;
@@ -72,26 +76,28 @@ static void e1000_read_mac_address(void) {
 
 // Initialize RX descriptors
 static int e1000_init_rx(void) {
-    // Allocate descriptor ring (128-byte aligned for best compatibility)
-    e1000_dev.rx_descs = (e1000_rx_desc_t *)kmalloc_aligned(
-        sizeof(e1000_rx_desc_t) * E1000_NUM_RX_DESC, 128);
+    // Allocate descriptor ring from whole pages (page aligned, off the heap)
+    e1000_dev.rx_descs = (e1000_rx_desc_t *)kmalloc_pages(
+        sizeof(e1000_rx_desc_t) * E1000_NUM_RX_DESC);
 
     if (!e1000_dev.rx_descs) return -1;
 
     memset(e1000_dev.rx_descs, 0, sizeof(e1000_rx_desc_t) * E1000_NUM_RX_DESC);
 
-    // Allocate buffers for each descriptor
+    // Every descriptor DMAs straight into a netbuf from the pool
     for (int i = 0; i < E1000_NUM_RX_DESC; i++) {
-        e1000_dev.rx_buffers[i] = (uint8_t *)kmalloc_aligned(E1000_RX_BUFFER_SIZE, 16);
-        if (!e1000_dev.rx_buffers[i]) return -1;
+        netbuf_t *nb = netbuf_alloc();
+        if (!nb) return -1;
 
-        e1000_dev.rx_descs[i].addr = (uint64_t)e1000_dev.rx_buffers[i];
+        e1000_dev.rx_netbufs[i] = nb;
+        e1000_dev.rx_descs[i].addr = nb->phys;
         e1000_dev.rx_descs[i].status = 0;
     }
 
     // Set up descriptor ring
-    e1000_write(E1000_RDBAL, (uint32_t)((uint64_t)e1000_dev.rx_descs & 0xFFFFFFFF));
-    e1000_write(E1000_RDBAH, (uint32_t)((uint64_t)e1000_dev.rx_descs >> 32));
+    uint64_t rx_ring = paging_virt_to_phys(e1000_dev.rx_descs);
+    e1000_write(E1000_RDBAL, (uint32_t)(rx_ring & 0xFFFFFFFF));
+    e1000_write(E1000_RDBAH, (uint32_t)(rx_ring >> 32));
     e1000_write(E1000_RDLEN, E1000_NUM_RX_DESC * sizeof(e1000_rx_desc_t));
     e1000_write(E1000_RDH, 0);
     e1000_write(E1000_RDT, E1000_NUM_RX_DESC - 1);
@@ -111,32 +117,35 @@ static int e1000_init_rx(void) {
 
 // Initialize TX descriptors
 static int e1000_init_tx(void) {
-    // Allocate descriptor ring (128-byte aligned for best compatibility)
-    e1000_dev.tx_descs = (e1000_tx_desc_t *)kmalloc_aligned(
-        sizeof(e1000_tx_desc_t) * E1000_NUM_TX_DESC, 128);
+    // Allocate descriptor ring from whole pages (page aligned, off the heap)
+    e1000_dev.tx_descs = (e1000_tx_desc_t *)kmalloc_pages(
+        sizeof(e1000_tx_desc_t) * E1000_NUM_TX_DESC);
 
     if (!e1000_dev.tx_descs) return -1;
 
     memset(e1000_dev.tx_descs, 0, sizeof(e1000_tx_desc_t) * E1000_NUM_TX_DESC);
 
-    // Allocate buffers for each descriptor
+    // Buffers are attached per packet by e1000_send_netbuf()
     for (int i = 0; i < E1000_NUM_TX_DESC; i++) {
-        e1000_dev.tx_buffers[i] = (uint8_t *)kmalloc_aligned(E1000_TX_BUFFER_SIZE, 16);
-        if (!e1000_dev.tx_buffers[i]) return -1;
-
-        e1000_dev.tx_descs[i].addr = (uint64_t)e1000_dev.tx_buffers[i];
+        e1000_dev.tx_netbufs[i] = NULL;
         e1000_dev.tx_descs[i].status = E1000_TXD_STAT_DD;  // Mark as done initially
         e1000_dev.tx_descs[i].cmd = 0;
     }
 
     // Set up descriptor ring
-    e1000_write(E1000_TDBAL, (uint32_t)((uint64_t)e1000_dev.tx_descs & 0xFFFFFFFF));
-    e1000_write(E1000_TDBAH, (uint32_t)((uint64_t)e1000_dev.tx_descs >> 32));
+    uint64_t tx_ring = paging_virt_to_phys(e1000_dev.tx_descs);
+    e1000_write(E1000_TDBAL, (uint32_t)(tx_ring & 0xFFFFFFFF));
+    e1000_write(E1000_TDBAH, (uint32_t)(tx_ring >> 32));
     e1000_write(E1000_TDLEN, E1000_NUM_TX_DESC * sizeof(e1000_tx_desc_t));
     e1000_write(E1000_TDH, 0);
     e1000_write(E1000_TDT, 0);
 
     e1000_dev.tx_cur = 0;
+    e1000_dev.tx_clean = 0;
+    e1000_dev.tx_used = 0;
+    e1000_dev.tx_tail = 0;
+    e1000_dev.tx_batch = 0;
+    e1000_dev.tx_context = 0;
 
     // Set Transmit Inter-Packet Gap (required for TX to work)
     // IPGT=10, IPGR1=10, IPGR2=10 for IEEE 802.3 standard
@@ -224,105 +233,316 @@ int e1000_init(void) {
         return -4;
     }
 
-    // Set up interrupt handler
+    // Set up interrupt handler and unmask the line
     uint8_t irq = pci->interrupt_line;
     if (irq > 0 && irq < 16) {
         idt_set_gate(0x20 + irq, (uint64_t)e1000_interrupt_handler);
+
+        if (irq < 8) {
+            outb(0x21, inb(0x21) & ~(1 << irq));
+        } else {
+            outb(0xA1, inb(0xA1) & ~(1 << (irq - 8)));
+            outb(0x21, inb(0x21) & ~(1 << 2));  // Cascade
+        }
+        e1000_dev.irq_enabled = 1;
+    } else {
+        // No interrupt to wait for: receive is polled
+        e1000_dev.rx_scheduled = 1;
     }
 
+    // Throttle interrupts so a busy link hands over batches
+    e1000_write(E1000_ITR, E1000_ITR_INTERVAL);
+
+    // Checksum and segmentation offload on by default
+    e1000_set_offload(E1000_OFFLOAD_CSUM | E1000_OFFLOAD_TSO);
+
     // Enable interrupts
-    e1000_write(E1000_IMS, E1000_ICR_RXT0 | E1000_ICR_LSC);
+    e1000_write(E1000_IMS, E1000_RX_INTERRUPTS | E1000_ICR_TXDW | E1000_ICR_LSC);
 
     e1000_dev.initialized = 1;
 
     return 0;
 }
 
-// Send a packet
-int e1000_send_packet(const void *data, size_t length) {
-    if (!e1000_dev.initialized || !data || length == 0) {
-        return -1;
+// Release packets the hardware has finished with (interrupts off). Only
+// a packet's EOP descriptor reports status.
+static void e1000_tx_reclaim(void) {
+    volatile e1000_tx_desc_t *descs = e1000_dev.tx_descs;
+
+    while (e1000_dev.tx_used > 0) {
+        uint16_t eop = e1000_dev.tx_eop[e1000_dev.tx_clean];
+        if (!(descs[eop].status & E1000_TXD_STAT_DD)) break;
+
+        uint16_t i;
+        do {
+            i = e1000_dev.tx_clean;
+            netbuf_put(e1000_dev.tx_netbufs[i]);
+            e1000_dev.tx_netbufs[i] = NULL;
+            e1000_dev.tx_clean = (i + 1) % E1000_NUM_TX_DESC;
+            e1000_dev.tx_used--;
+        } while (i != eop);
     }
+}
 
-    if (length > E1000_TX_BUFFER_SIZE) {
-        return -2;  // Packet too large
+// Hand everything queued so far to the hardware
+static void e1000_tx_kick(void) {
+    if (e1000_dev.tx_tail != e1000_dev.tx_cur) {
+        // Descriptors must be in memory before the NIC is told about them
+        __asm__ volatile("" ::: "memory");
+        e1000_dev.tx_tail = e1000_dev.tx_cur;
+        e1000_write(E1000_TDT, e1000_dev.tx_tail);
+    }
+}
+
+// Make room for `needed` descriptors (interrupts off). TDT == TDH means
+// empty, so one slot always stays unused.
+static int e1000_tx_reserve(int needed) {
+    e1000_tx_reclaim();
+    if (E1000_NUM_TX_DESC - 1 - e1000_dev.tx_used >= needed) return 0;
+
+    // Ring full: push out the open batch and wait for completions
+    e1000_tx_kick();
+
+    for (int timeout = 1000000; timeout > 0; timeout--) {
+        e1000_tx_reclaim();
+        if (E1000_NUM_TX_DESC - 1 - e1000_dev.tx_used >= needed) return 0;
+    }
+    return -1;
+}
+
+// Fill a context descriptor from the packet's Ethernet/IPv4/TCP|UDP
+// headers. `key` identifies the checksum layout so consecutive packets
+// of the same shape can share one context.
+static int e1000_tx_build_context(const netbuf_t *nb, size_t total,
+                                  e1000_tx_context_desc_t *ctx,
+                                  uint8_t *popts, uint32_t *key) {
+    const uint8_t *frame = nb->data;
+    if (nb->len < ETH_HEADER_SIZE + IP_HEADER_SIZE) return -1;
+
+    const ipv4_header_t *ip = (const ipv4_header_t *)(frame + ETH_HEADER_SIZE);
+    uint32_t l4 = ETH_HEADER_SIZE + (ip->version_ihl & 0x0F) * 4;
+    int tcp = ip->protocol == IP_PROTO_TCP;
+    int tso = (nb->offload & NETBUF_TX_TSO) != 0;
+
+    uint8_t tucmd = E1000_TXD_TUCMD_IP | E1000_TXD_CMD_DEXT;
+    if (tcp) tucmd |= E1000_TXD_TUCMD_TCP;
+
+    ctx->ipcss = ETH_HEADER_SIZE;
+    ctx->ipcso = ETH_HEADER_SIZE + 10;
+    ctx->ipcse = l4 - 1;
+    ctx->tucss = l4;
+    ctx->tucso = l4 + (tcp ? 16 : 6);
+    ctx->tucse = 0;
+    ctx->status = 0;
+    ctx->hdr_len = 0;
+    ctx->mss = 0;
+    ctx->cmd_len = E1000_TXD_DTYP_CTX | ((uint32_t)tucmd << 24);
+
+    if (tso) {
+        if (!tcp || nb->len < l4 + sizeof(tcp_header_t) || nb->mss == 0) return -1;
+
+        const tcp_header_t *th = (const tcp_header_t *)(frame + l4);
+        uint32_t hdr_len = l4 + ((th->data_offset >> 4) & 0x0F) * 4;
+        if (hdr_len > nb->len) return -1;
+
+        ctx->hdr_len = hdr_len;
+        ctx->mss = nb->mss;
+        ctx->cmd_len = (total - hdr_len) | E1000_TXD_DTYP_CTX |
+                       ((uint32_t)(tucmd | E1000_TXD_CMD_TSE) << 24);
+    }
+
+    *popts = 0;
+    if (nb->offload & (NETBUF_TX_IP_CSUM | NETBUF_TX_TSO)) *popts |= E1000_TXD_POPTS_IXSM;
+    if (nb->offload & (NETBUF_TX_L4_CSUM | NETBUF_TX_TSO)) *popts |= E1000_TXD_POPTS_TXSM;
+
+    *key = 0x80000000 | ((uint32_t)ctx->ipcse << 16) | ((uint32_t)ctx->tucso << 8) | tucmd;
+    return 0;
+}
+
+// Queue a netbuf (and its fragments) for transmission; returns once the
+// packet is on the ring
+int e1000_send_netbuf(netbuf_t *nb) {
+    if (!nb) return -1;
+
+    size_t total = netbuf_total_len(nb);
+    if (!e1000_dev.initialized || total == 0) {
+        netbuf_put(nb);
+        return -1;
     }
 
-    uint16_t cur = e1000_dev.tx_cur;
-    e1000_tx_desc_t *desc = &e1000_dev.tx_descs[cur];
+    int offload = (nb->offload & (NETBUF_TX_IP_CSUM | NETBUF_TX_L4_CSUM | NETBUF_TX_TSO)) != 0;
+    e1000_tx_context_desc_t ctx;
+    uint8_t popts = 0;
+    uint32_t key = 0;
+    if (offload && e1000_tx_build_context(nb, total, &ctx, &popts, &key) != 0) {
+        netbuf_put(nb);
+        return -1;
+    }
 
-    // Wait for descriptor to be available (with timeout)
-    int timeout = 100000;
-    while (!(desc->status & E1000_TXD_STAT_DD) && timeout > 0) {
-        timeout--;
+    int needed = 0;
+    for (netbuf_t *f = nb; f; f = f->frag) {
+        if (f->len) needed++;
     }
-    if (timeout == 0) {
-        return -3;  // Timeout waiting for descriptor
+
+    uint64_t flags = irq_save();
+
+    // TSO contexts carry the payload length, so they are never reused
+    int tso = (nb->offload & NETBUF_TX_TSO) != 0;
+    int need_ctx = offload && (tso || key != e1000_dev.tx_context);
+    needed += need_ctx;
+
+    if (needed > E1000_NUM_TX_DESC - 1 || e1000_tx_reserve(needed) != 0) {
+        irq_restore(flags);
+        netbuf_put(nb);
+        return -3;  // Timeout waiting for descriptors
     }
 
-    // Copy data to buffer
-    memcpy(e1000_dev.tx_buffers[cur], data, length);
+    uint16_t first = e1000_dev.tx_cur;
+    uint16_t cur = first;
+    uint16_t eop = first;
 
-    // Set up descriptor - use the buffer's address
-    desc->addr = (uint64_t)(uintptr_t)e1000_dev.tx_buffers[cur];
-    desc->length = length;
-    desc->cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
-    desc->status = 0;
-    desc->cso = 0;
-    desc->css = 0;
-    desc->special = 0;
+    if (need_ctx) {
+        *(e1000_tx_context_desc_t *)&e1000_dev.tx_descs[cur] = ctx;
+        e1000_dev.tx_netbufs[cur] = NULL;
+        e1000_dev.tx_context = tso ? 0 : key;
+        cur = (cur + 1) % E1000_NUM_TX_DESC;
+    }
 
-    // Advance tail
-    e1000_dev.tx_cur = (cur + 1) % E1000_NUM_TX_DESC;
-    e1000_write(E1000_TDT, e1000_dev.tx_cur);
+    // One descriptor per buffer, pointing straight at the packet data.
+    // The EOP slot holds the reference that frees the whole chain.
+    for (netbuf_t *f = nb; f; f = f->frag) {
+        if (!f->len) continue;
+
+        netbuf_t *rest = f->frag;
+        while (rest && !rest->len) rest = rest->frag;
+        int last = rest == NULL;
+
+        if (offload) {
+            e1000_tx_data_desc_t *desc = (e1000_tx_data_desc_t *)&e1000_dev.tx_descs[cur];
+            uint8_t dcmd = E1000_TXD_CMD_DEXT | E1000_TXD_CMD_IFCS;
+            if (tso) dcmd |= E1000_TXD_CMD_TSE;
+            if (last) dcmd |= E1000_TXD_CMD_EOP | E1000_TXD_CMD_RS;
+
+            desc->addr = netbuf_dma_addr(f);
+            desc->cmd_len = f->len | E1000_TXD_DTYP_DATA | ((uint32_t)dcmd << 24);
+            desc->status = 0;
+            desc->popts = popts;
+            desc->special = 0;
+        } else {
+            e1000_tx_desc_t *desc = &e1000_dev.tx_descs[cur];
+            desc->addr = netbuf_dma_addr(f);
+            desc->length = f->len;
+            desc->cmd = E1000_TXD_CMD_IFCS;
+            if (last) desc->cmd |= E1000_TXD_CMD_EOP | E1000_TXD_CMD_RS;
+            desc->status = 0;
+            desc->cso = 0;
+            desc->css = 0;
+            desc->special = 0;
+        }
 
-    // Wait for transmission to complete
-    timeout = 100000;
-    while (!(desc->status & E1000_TXD_STAT_DD) && timeout > 0) {
-        timeout--;
+        e1000_dev.tx_netbufs[cur] = last ? nb : NULL;
+        eop = cur;
+        cur = (cur + 1) % E1000_NUM_TX_DESC;
     }
 
-    if (!(desc->status & E1000_TXD_STAT_DD)) {
-        return -4;  // TX didn't complete
+    e1000_dev.tx_eop[first] = eop;
+    e1000_dev.tx_cur = cur;
+    e1000_dev.tx_used += needed;
+
+    // Outside a batch every packet goes out at once
+    if (e1000_dev.tx_batch == 0) {
+        e1000_tx_kick();
     }
 
-    return length;
+    irq_restore(flags);
+    return total;
 }
 
-// Receive a packet
-int e1000_receive_packet(void *buffer, size_t max_length) {
-    if (!e1000_dev.initialized || !buffer) {
+// Send a packet from a plain buffer (copied into a netbuf)
+int e1000_send_packet(const void *data, size_t length) {
+    if (!e1000_dev.initialized || !data || length == 0) {
         return -1;
     }
 
-    uint16_t cur = e1000_dev.rx_cur;
-    e1000_rx_desc_t *desc = &e1000_dev.rx_descs[cur];
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb) return -3;
 
-    // Check if packet available
-    if (!(desc->status & E1000_RXD_STAT_DD)) {
-        return 0;  // No packet
+    uint8_t *p = netbuf_append(nb, length);
+    if (!p) {
+        netbuf_put(nb);
+        return -2;  // Packet too large
     }
+    memcpy(p, data, length);
+
+    return e1000_send_netbuf(nb);
+}
 
-    // Get packet length
-    uint16_t length = desc->length;
-    if (length > max_length) {
-        length = max_length;
+void e1000_tx_batch_begin(void) {
+    uint64_t flags = irq_save();
+    e1000_dev.tx_batch++;
+    irq_restore(flags);
+}
+
+void e1000_tx_batch_end(void) {
+    uint64_t flags = irq_save();
+    if (e1000_dev.tx_batch > 0 && --e1000_dev.tx_batch == 0) {
+        e1000_tx_kick();
     }
+    irq_restore(flags);
+}
+
+// Take the next received frame off the ring, replacing its buffer
+netbuf_t *e1000_receive_netbuf(void) {
+    if (!e1000_dev.initialized) return NULL;
 
-    // Copy data
-    memcpy(buffer, e1000_dev.rx_buffers[cur], length);
+    while (1) {
+        uint16_t cur = e1000_dev.rx_cur;
+        e1000_rx_desc_t *desc = &e1000_dev.rx_descs[cur];
 
-    // Reset descriptor
-    desc->status = 0;
+        // Check if packet available
+        if (!(desc->status & E1000_RXD_STAT_DD)) {
+            return NULL;
+        }
+
+        // Checksums the NIC verified spare the stack; frames it found
+        // corrupt are dropped here
+        uint8_t csum_ok = 0;
+        int corrupt = 0;
+        if ((e1000_dev.offload & E1000_OFFLOAD_CSUM) && !(desc->status & E1000_RXD_STAT_IXSM)) {
+            corrupt = (desc->errors & (E1000_RXD_ERR_IPE | E1000_RXD_ERR_TCPE)) != 0;
+            if (desc->status & E1000_RXD_STAT_IPCS) csum_ok |= NETBUF_RX_IP_CSUM_OK;
+            if (desc->status & E1000_RXD_STAT_TCPCS) csum_ok |= NETBUF_RX_L4_CSUM_OK;
+        }
+
+        netbuf_t *nb = e1000_dev.rx_netbufs[cur];
+        netbuf_t *fresh = corrupt ? NULL : netbuf_alloc();
+
+        if (fresh) {
+            // Hand the filled buffer up and refill the slot
+            nb->data = nb->head;
+            nb->len = desc->length;
+            nb->offload = csum_ok;
+            e1000_dev.rx_netbufs[cur] = fresh;
+            desc->addr = fresh->phys;
+        } else {
+            // Bad checksum or pool exhausted: keep the buffer, drop the frame
+            if (corrupt) {
+                e1000_dev.rx_csum_errors++;
+            } else {
+                e1000_dev.rx_dropped++;
+            }
+            nb = NULL;
+        }
 
-    // Advance head
-    uint16_t old_cur = cur;
-    e1000_dev.rx_cur = (cur + 1) % E1000_NUM_RX_DESC;
+        // Reset descriptor
+        desc->status = 0;
 
-    // Update tail
-    e1000_write(E1000_RDT, old_cur);
+        // Advance head and return the slot to the hardware
+        e1000_dev.rx_cur = (cur + 1) % E1000_NUM_RX_DESC;
+        e1000_write(E1000_RDT, cur);
 
-    return length;
+        if (nb) return nb;
+    }
 }
 
 // Get MAC address
@@ -332,18 +552,73 @@ void e1000_get_mac_address(uint8_t *mac) {
     }
 }
 
-// Handle interrupt
+// Top half: acknowledge the causes. Receive work is left to the bottom
+// half (net_rx_action), with RX interrupts masked until it completes.
 void e1000_handle_interrupt(void) {
     uint32_t icr = e1000_read(E1000_ICR);
 
     if (icr & E1000_ICR_LSC) {
-        // Link status change
-        // Re-read link status if needed
+        // Link status change; e1000_link_up() reads it on demand
+    }
+
+    if (icr & E1000_RX_INTERRUPTS) {
+        e1000_write(E1000_IMC, E1000_RX_INTERRUPTS);
+        e1000_dev.rx_scheduled = 1;
+    }
+
+    if (icr & E1000_ICR_TXDW) {
+        e1000_tx_reclaim();
+    }
+}
+
+int e1000_rx_scheduled(void) {
+    return e1000_dev.rx_scheduled;
+}
+
+// Causes latched while masked raise a fresh interrupt on unmask, so a
+// frame that lands between the last ring check and here is not lost
+void e1000_rx_complete(void) {
+    if (!e1000_dev.irq_enabled) return;
+
+    e1000_dev.rx_scheduled = 0;
+    e1000_write(E1000_IMS, E1000_RX_INTERRUPTS);
+}
+
+// Frames that were already in the ring when ICR was read raise no new
+// cause, so a poll that stops on its budget sets one itself. The
+// interrupt still goes through ITR throttling.
+void e1000_rx_reschedule(void) {
+    if (!e1000_dev.irq_enabled) return;
+
+    e1000_dev.rx_scheduled = 0;
+    e1000_write(E1000_IMS, E1000_RX_INTERRUPTS);
+    e1000_write(E1000_ICS, E1000_ICR_RXT0);
+}
+
+int e1000_rx_interrupts(void) {
+    return e1000_dev.irq_enabled;
+}
+
+uint32_t e1000_set_offload(uint32_t offload) {
+    if (!e1000_dev.mmio_base) return 0;
+
+    // Segmentation relies on the NIC inserting checksums per segment
+    if (!(offload & E1000_OFFLOAD_CSUM)) {
+        offload &= ~E1000_OFFLOAD_TSO;
     }
+    e1000_dev.offload = offload;
 
-    if (icr & E1000_ICR_RXT0) {
-        // Packet received - handled in polling for now
+    uint32_t rxcsum = e1000_read(E1000_RXCSUM) & ~(E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL);
+    if (offload & E1000_OFFLOAD_CSUM) {
+        rxcsum |= E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL;
     }
+    e1000_write(E1000_RXCSUM, rxcsum);
+
+    return offload;
+}
+
+uint32_t e1000_get_offload(void) {
+    return e1000_dev.offload;
 }
 
 // Check if link is up
@@ -381,9 +656,15 @@ void e1000_debug_tx(void) {
     print_int(e1000_read(E1000_TDBAL));
     print_str("\n  tx_descs addr: ");
     print_int((uint32_t)(uintptr_t)e1000_dev.tx_descs);
-    print_str("\n  tx_buf[0] addr: ");
-    print_int((uint32_t)(uintptr_t)e1000_dev.tx_buffers[0]);
+    print_str("\n  free netbufs: ");
+    print_int(netbuf_available());
+    print_str(" rx dropped: ");
+    print_int(e1000_dev.rx_dropped);
+    print_str(" rx bad csum: ");
+    print_int(e1000_dev.rx_csum_errors);
     print_str("\n  desc[0].status: ");
     print_int(e1000_dev.tx_descs[0].status);
+    print_str("\n  queued: ");
+    print_int(e1000_dev.tx_used);
     print_str("\n");
 }
@@ -4,6 +4,7 @@
 section .text
 global e1000_interrupt_handler
 extern e1000_handle_interrupt
+extern net_rx_action
 
 e1000_interrupt_handler:
     ; Save all registers
@@ -26,18 +27,23 @@ e1000_interrupt_handler:
     ; Align stack
     sub rsp, 8
 
-    ; Call C handler
+    ; Call C handler (top half)
     call e1000_handle_interrupt
 
-    ; Restore stack
-    add rsp, 8
-
     ; Send EOI to PIC
     ; e1000 is usually on IRQ 11 (slave PIC)
     mov al, 0x20
     out 0xA0, al    ; EOI to slave PIC
     out 0x20, al    ; EOI to master PIC
 
+    ; Bottom half, with interrupts enabled again
+    sti
+    call net_rx_action
+    cli
+
+    ; Restore stack
+    add rsp, 8
+
     ; Restore registers
     pop r15
     pop r14
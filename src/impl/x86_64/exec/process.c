@@ -1,6 +1,7 @@
 #include "exec/process.h"
 #include "exec/elf.h"
 #include "memory/heap.h"
+#include "memory/buddy.h"
 #include "utils/memory.h"
 #include "utils/string.h"
 #include "fs/vfs.h"
@@ -50,7 +51,7 @@ process_t *process_create(const char *name) {
     proc->name[name_len] = 0;
 
     // Allocate stack
-    proc->stack_base = kmalloc_aligned(PROCESS_STACK_SIZE, 16);
+    proc->stack_base = kmalloc_pages(PROCESS_STACK_SIZE);
     if (!proc->stack_base) {
         kfree(proc);
         return 0;
@@ -152,7 +153,7 @@ void process_terminate(process_t *proc) {
 
     // Free resources
     if (proc->stack_base) {
-        kfree(proc->stack_base);
+        kfree_pages(proc->stack_base);
     }
 
     elf_unload(&proc->elf_info);
@@ -59,6 +59,11 @@ void simplefs_init(block_device_t *block_device)
     simplefs_fs->device = block_device;
     simplefs_fs->root = simplefs_root;
 
+    for (int i = 0; i < SIMPLEFS_INODE_CACHE_SIZE; i++)
+        simplefs_fs->inode_cache[i].valid = 0;
+    for (int i = 0; i < SIMPLEFS_IO_BUFFERS; i++)
+        simplefs_fs->io_buffer_used[i] = 0;
+
     // Attach filesystem to root VFS node
     simplefs_root->filesystem = simplefs_fs;
 
@@ -221,6 +226,10 @@ int simplefs_mount(block_device_t *block_device)
     simplefs_fs->superblock = sb;
     simplefs_fs->device = block_device;
 
+    // Drop anything cached from a previous mount
+    for (int i = 0; i < SIMPLEFS_INODE_CACHE_SIZE; i++)
+        simplefs_fs->inode_cache[i].valid = 0;
+
     serial_print("Mounted SimpleFS v");
     serial_print_hex(sb.header.version);
     serial_print("\n");
@@ -236,70 +245,187 @@ int simplefs_read_block(uint32_t block_number, void *buffer)
     return simplefs_fs->device->read_block(simplefs_block_device, block_number, (uint8_t *)buffer);
 }
 
-int simplefs_read_file(uint32_t inode_number, uint8_t *buffer, uint32_t size, uint32_t offset)
+// Borrow a scratch block buffer from the filesystem's pool.
+// Only falls back to the heap if every pool buffer is in use.
+static uint8_t *simplefs_io_buffer_get(void)
 {
-    (void)offset;
+    uint32_t block_size = simplefs_fs->device->block_size;
 
-    if (!simplefs_fs || !simplefs_fs->device || !buffer)
-        return -1;
+    if (block_size <= SIMPLEFS_IO_BUFFER_SIZE)
+    {
+        for (int i = 0; i < SIMPLEFS_IO_BUFFERS; i++)
+        {
+            if (!simplefs_fs->io_buffer_used[i])
+            {
+                simplefs_fs->io_buffer_used[i] = 1;
+                return simplefs_fs->io_buffers[i];
+            }
+        }
+    }
+
+    return (uint8_t *)kmalloc(block_size);
+}
+
+static void simplefs_io_buffer_put(uint8_t *buffer)
+{
+    for (int i = 0; i < SIMPLEFS_IO_BUFFERS; i++)
+    {
+        if (buffer == simplefs_fs->io_buffers[i])
+        {
+            simplefs_fs->io_buffer_used[i] = 0;
+            return;
+        }
+    }
+
+    kfree(buffer);
+}
+
+// Look up an inode, reading it from disk only on a cache miss
+static simplefs_inode_t *simplefs_inode_get(uint32_t inode_number)
+{
+    simplefs_inode_cache_entry_t *entry =
+        &simplefs_fs->inode_cache[inode_number % SIMPLEFS_INODE_CACHE_SIZE];
 
-    // Use a proper 512-byte buffer for block I/O
-    uint8_t *inode_buf = (uint8_t *)kmalloc(512);
+    if (entry->valid && entry->inode_number == inode_number)
+        return &entry->inode;
+
+    uint8_t *inode_buf = simplefs_io_buffer_get();
     if (!inode_buf)
-        return -1;
+        return NULL;
 
-    simplefs_fs->device->read_block(simplefs_fs->device,
-                                    simplefs_fs->superblock.inodetable_start + inode_number,
-                                    inode_buf);
+    int result = simplefs_fs->device->read_block(simplefs_fs->device,
+                                                 simplefs_fs->superblock.inodetable_start + inode_number,
+                                                 inode_buf);
+    if (result != 0)
+    {
+        simplefs_io_buffer_put(inode_buf);
+        return NULL;
+    }
 
-    simplefs_inode_t *inode = (simplefs_inode_t *)inode_buf;
+    uint8_t *dst = (uint8_t *)&entry->inode;
+    for (uint32_t i = 0; i < sizeof(simplefs_inode_t); i++)
+        dst[i] = inode_buf[i];
+    simplefs_io_buffer_put(inode_buf);
 
-    if (inode->file_size == 0 || size == 0)
+    entry->inode_number = inode_number;
+    entry->valid = 1;
+    return &entry->inode;
+}
+
+// Write an inode to disk and keep the cache in sync (write-through)
+static int simplefs_inode_put(uint32_t inode_number, const simplefs_inode_t *inode)
+{
+    simplefs_inode_cache_entry_t *entry =
+        &simplefs_fs->inode_cache[inode_number % SIMPLEFS_INODE_CACHE_SIZE];
+
+    if (&entry->inode != inode)
     {
-        kfree(inode_buf);
-        return 0;
+        uint8_t *dst = (uint8_t *)&entry->inode;
+        const uint8_t *src = (const uint8_t *)inode;
+        for (uint32_t i = 0; i < sizeof(simplefs_inode_t); i++)
+            dst[i] = src[i];
     }
+    entry->inode_number = inode_number;
+    entry->valid = 1;
 
-    uint32_t block_num = inode->direct_blocks[0];
-    uint32_t file_size = inode->file_size;
-    kfree(inode_buf);
+    uint8_t *inode_buf = simplefs_io_buffer_get();
+    if (!inode_buf)
+    {
+        entry->valid = 0;
+        return -1;
+    }
+
+    uint32_t block_size = simplefs_fs->device->block_size;
+    for (uint32_t i = 0; i < block_size; i++)
+        inode_buf[i] = 0;
+    const uint8_t *src = (const uint8_t *)&entry->inode;
+    for (uint32_t i = 0; i < sizeof(simplefs_inode_t); i++)
+        inode_buf[i] = src[i];
 
-    // Use a 512-byte buffer for block read, then copy to user buffer
-    uint8_t *data_buf = (uint8_t *)kmalloc(512);
-    if (!data_buf)
+    int result = simplefs_fs->device->write_block(simplefs_fs->device,
+                                                  simplefs_fs->superblock.inodetable_start + inode_number,
+                                                  inode_buf);
+    simplefs_io_buffer_put(inode_buf);
+
+    if (result != 0)
+        entry->valid = 0;
+    return result;
+}
+
+int simplefs_read_file(uint32_t inode_number, uint8_t *buffer, uint32_t size, uint32_t offset)
+{
+    if (!simplefs_fs || !simplefs_fs->device || !buffer)
+        return -1;
+
+    simplefs_inode_t *inode = simplefs_inode_get(inode_number);
+    if (!inode)
         return -1;
 
-    simplefs_fs->device->read_block(simplefs_fs->device, block_num, data_buf);
+    // Files live in their direct blocks; never read past what they can hold
+    uint32_t block_size = simplefs_fs->device->block_size;
+    uint32_t file_size = inode->file_size;
+    if (file_size > SIMPLEFS_DIRECT_BLOCKS * block_size)
+        file_size = SIMPLEFS_DIRECT_BLOCKS * block_size;
+
+    if (offset >= file_size || size == 0)
+        return 0;
+    if (size > file_size - offset)
+        size = file_size - offset;
+
+    uint32_t done = 0;
+    uint8_t *scratch = NULL;
+
+    while (done < size)
+    {
+        uint32_t pos = offset + done;
+        uint32_t block_index = pos / block_size;
+        uint32_t block_offset = pos % block_size;
+        uint32_t chunk = block_size - block_offset;
+        if (chunk > size - done)
+            chunk = size - done;
+
+        uint32_t block_num = inode->direct_blocks[block_index];
+        if (block_num == 0)
+            break;
+
+        if (block_offset == 0 && chunk == block_size)
+        {
+            // Whole block: read straight into the caller's buffer
+            if (simplefs_fs->device->read_block(simplefs_fs->device, block_num, buffer + done) != 0)
+                break;
+        }
+        else
+        {
+            if (!scratch)
+            {
+                scratch = simplefs_io_buffer_get();
+                if (!scratch)
+                    break;
+            }
+            if (simplefs_fs->device->read_block(simplefs_fs->device, block_num, scratch) != 0)
+                break;
+            for (uint32_t i = 0; i < chunk; i++)
+                buffer[done + i] = scratch[block_offset + i];
+        }
 
-    // Copy only the requested amount to user buffer
-    uint32_t bytes_to_copy = (file_size < size) ? file_size : size;
-    for (uint32_t i = 0; i < bytes_to_copy; i++)
-        buffer[i] = data_buf[i];
+        done += chunk;
+    }
 
-    kfree(data_buf);
+    if (scratch)
+        simplefs_io_buffer_put(scratch);
 
-    return bytes_to_copy;
+    return done;
 }
 
 int simplefs_write_file(uint32_t inode_number, const uint8_t *buffer, uint32_t size, uint32_t offset)
 {
-    (void)offset;
-
     if (!simplefs_fs || !simplefs_fs->device || !buffer)
         return -1;
 
-    // Use a proper 512-byte buffer for block I/O
-    uint8_t *inode_buf = (uint8_t *)kmalloc(512);
-    if (!inode_buf)
+    simplefs_inode_t *inode = simplefs_inode_get(inode_number);
+    if (!inode)
         return -1;
 
-    // Read inode block
-    simplefs_fs->device->read_block(simplefs_fs->device,
-                                    simplefs_fs->superblock.inodetable_start + inode_number,
-                                    inode_buf);
-
-    simplefs_inode_t *inode = (simplefs_inode_t *)inode_buf;
-
     if (inode->direct_blocks[0] == 0)
     {
         // Allocate first data block for this file
@@ -309,31 +435,53 @@ int simplefs_write_file(uint32_t inode_number, const uint8_t *buffer, uint32_t s
         inode->direct_blocks[0] = simplefs_fs->superblock.first_data_block + 64 + inode_number;
     }
 
-    // Write data (need a 512-byte buffer)
-    uint8_t *data_buf = (uint8_t *)kmalloc(512);
-    if (!data_buf)
+    // Each file owns exactly one data block; store what fits in it and
+    // report that, so callers can tell a short write from a full one
+    uint32_t block_size = simplefs_fs->device->block_size;
+    if (offset >= block_size)
+        return 0;
+    uint32_t stored = size;
+    if (stored > block_size - offset)
+        stored = block_size - offset;
+
+    if (offset == 0 && stored == block_size)
     {
-        kfree(inode_buf);
-        return -1;
+        // Full block available in the caller's buffer: write it directly
+        if (simplefs_fs->device->write_block(simplefs_fs->device, inode->direct_blocks[0],
+                                             (uint8_t *)buffer) != 0)
+            return -1;
     }
+    else
+    {
+        uint8_t *data_buf = simplefs_io_buffer_get();
+        if (!data_buf)
+            return -1;
 
-    // Zero and copy data
-    for (int i = 0; i < 512; i++)
-        data_buf[i] = 0;
-    for (uint32_t i = 0; i < size && i < 512; i++)
-        data_buf[i] = buffer[i];
+        // Keep the bytes before `offset` that the file already has; the
+        // rest of the block is zeroed (the write truncates)
+        uint32_t keep = inode->file_size < offset ? inode->file_size : offset;
+        if (keep > 0 &&
+            simplefs_fs->device->read_block(simplefs_fs->device, inode->direct_blocks[0], data_buf) != 0)
+        {
+            simplefs_io_buffer_put(data_buf);
+            return -1;
+        }
+        for (uint32_t i = keep; i < block_size; i++)
+            data_buf[i] = 0;
+        for (uint32_t i = 0; i < stored; i++)
+            data_buf[offset + i] = buffer[i];
 
-    simplefs_fs->device->write_block(simplefs_fs->device, inode->direct_blocks[0], data_buf);
-    kfree(data_buf);
+        int result = simplefs_fs->device->write_block(simplefs_fs->device, inode->direct_blocks[0], data_buf);
+        simplefs_io_buffer_put(data_buf);
+        if (result != 0)
+            return -1;
+    }
 
     // Update inode size and write back
-    inode->file_size = size;
-    simplefs_fs->device->write_block(simplefs_fs->device,
-                                     simplefs_fs->superblock.inodetable_start + inode_number,
-                                     inode_buf);
-    kfree(inode_buf);
+    inode->file_size = offset + stored;
+    simplefs_inode_put(inode_number, inode);
 
-    return size;
+    return stored;
 }
 
 int simplefs_list_dir(uint32_t dir_inode_number)
@@ -401,19 +549,11 @@ int simplefs_create_file(uint32_t dir_inode_number, const char *filename, uint32
     uint32_t inode_number = simplefs_fs->superblock.max_inode_count - simplefs_fs->superblock.free_inode_count;
     simplefs_fs->superblock.free_inode_count--;
 
-    // Write empty inode (need full 512-byte buffer for block write)
-    uint8_t *inode_buffer = (uint8_t *)kmalloc(512);
-    if (!inode_buffer)
+    // Write empty inode (through the inode cache)
+    simplefs_inode_t empty_inode = {0};
+    if (simplefs_inode_put(inode_number, &empty_inode) != 0)
         return -1;
 
-    for (int i = 0; i < 512; i++)
-        inode_buffer[i] = 0;
-
-    simplefs_fs->device->write_block(simplefs_fs->device,
-                                     simplefs_fs->superblock.inodetable_start + inode_number,
-                                     inode_buffer);
-    kfree(inode_buffer);
-
     // Find empty slot in directory blocks
     uint8_t *block_buffer = (uint8_t *)kmalloc(512);
     if (!block_buffer)
@@ -484,14 +624,9 @@ int simplefs_delete_file(uint32_t dir_inode_number, const char *filename)
     if (simplefs_find_file(dir_inode_number, filename, &inode_number) != 0)
         return -1;
 
-    // Clear inode (need full 512-byte buffer)
-    uint8_t *inode_buffer = (uint8_t *)kmalloc(512);
-    if (!inode_buffer)
-        return -1;
-    for (int i = 0; i < 512; i++)
-        inode_buffer[i] = 0;
-    simplefs_fs->device->write_block(simplefs_fs->device, simplefs_fs->superblock.inodetable_start + inode_number, inode_buffer);
-    kfree(inode_buffer);
+    // Clear inode (through the inode cache)
+    simplefs_inode_t empty_inode = {0};
+    simplefs_inode_put(inode_number, &empty_inode);
 
     // Find and clear directory entry
     uint8_t *block_buffer = (uint8_t *)kmalloc(512);
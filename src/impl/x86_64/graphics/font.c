@@ -1,5 +1,23 @@
 #include <graphics/font.h>
 #include <graphics/graphics.h>
+#include <utils/timing.h>
+
+// Glyph atlas: each (fg, bg) pair gets the whole font pre-expanded into
+// 32-bit pixels, built lazily one glyph at a time. A small LRU of pairs
+// covers the handful of color combinations the UI actually uses.
+typedef struct
+{
+    uint32_t fg;
+    uint32_t bg;
+    uint32_t last_used;
+    uint8_t valid;
+    uint8_t ready[FONT_GLYPHS / 8]; // Bit per expanded glyph
+    uint32_t pixels[FONT_GLYPHS][8 * 8];
+} glyph_pair_t;
+
+static glyph_pair_t glyph_pairs[FONT_CACHE_PAIRS];
+static glyph_pair_t *glyph_mru = 0;
+static uint32_t glyph_clock = 0;
 
 // Simple 8x8 bitmap font (subset - add more as needed)
 const uint8_t font_8x8[128][8] = {
@@ -82,9 +100,69 @@ const uint8_t font_8x8[128][8] = {
     ['\n'] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
 };
 
+static glyph_pair_t *glyph_pair_get(uint32_t fg_color, uint32_t bg_color)
+{
+    if (glyph_mru && glyph_mru->fg == fg_color && glyph_mru->bg == bg_color)
+        return glyph_mru;
+
+    glyph_pair_t *victim = &glyph_pairs[0];
+    for (int i = 0; i < FONT_CACHE_PAIRS; i++)
+    {
+        glyph_pair_t *p = &glyph_pairs[i];
+        if (p->valid && p->fg == fg_color && p->bg == bg_color)
+        {
+            p->last_used = ++glyph_clock;
+            glyph_mru = p;
+            return p;
+        }
+        if (!p->valid || (victim->valid && p->last_used < victim->last_used))
+            victim = p;
+    }
+
+    // Evict the least recently used pair
+    victim->fg = fg_color;
+    victim->bg = bg_color;
+    victim->valid = 1;
+    victim->last_used = ++glyph_clock;
+    for (int i = 0; i < FONT_GLYPHS / 8; i++)
+        victim->ready[i] = 0;
+
+    glyph_mru = victim;
+    return victim;
+}
+
+static const uint32_t *glyph_pixels(glyph_pair_t *pair, uint8_t c)
+{
+    uint32_t *out = pair->pixels[c];
+    if (pair->ready[c >> 3] & (1 << (c & 7)))
+        return out;
+
+    const uint8_t *glyph = font_8x8[c];
+    for (int dy = 0; dy < 8; dy++)
+    {
+        for (int dx = 0; dx < 8; dx++)
+        {
+            out[dy * 8 + dx] = (glyph[dy] & (1 << (7 - dx))) ? pair->fg : pair->bg;
+        }
+    }
+    pair->ready[c >> 3] |= 1 << (c & 7);
+    return out;
+}
+
 void draw_char(char c, uint32_t x, uint32_t y, uint32_t fg_color, uint32_t bg_color)
 {
-    const uint8_t *glyph = font_8x8[(uint8_t)c];
+    uint8_t index = (uint8_t)c < FONT_GLYPHS ? (uint8_t)c : 0;
+    const uint32_t *pixels = glyph_pixels(glyph_pair_get(fg_color, bg_color), index);
+
+    // Eight 32-byte row copies
+    blit_rect(x, y, pixels, 8, 8, 8, 0);
+}
+
+// Original bit-by-bit renderer, kept as the benchmark baseline
+static void draw_char_bitwise(char c, uint32_t x, uint32_t y, uint32_t fg_color, uint32_t bg_color)
+{
+    const uint8_t *glyph = font_8x8[(uint8_t)c & (FONT_GLYPHS - 1)];
+    graphics_mark_dirty(x, y, 8, 8);
 
     for (int dy = 0; dy < 8; dy++)
     {
@@ -117,4 +195,38 @@ void draw_string(const char *str, uint32_t x, uint32_t y, uint32_t fg_color, uin
         offset += 8;
         str++;
     }
-}
\ No newline at end of file
+}
+
+void font_benchmark(uint32_t *bitwise_cps, uint32_t *cached_cps)
+{
+    uint32_t cols = get_screen_width() / 8;
+    uint32_t rows = get_screen_height() / 8;
+    if (cols > 80)
+        cols = 80;
+    if (rows > 25)
+        rows = 25;
+
+    uint32_t total = cols * rows * FONT_BENCH_SCREENS;
+    uint64_t elapsed[2];
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        uint64_t start = timing_rdtsc();
+        for (uint32_t n = 0; n < total; n++)
+        {
+            uint32_t cell = n % (cols * rows);
+            char c = (char)(' ' + (n % 95));
+            uint32_t fg = (n & 1) ? COLOR_WHITE : COLOR_YELLOW;
+            if (pass == 0)
+                draw_char_bitwise(c, (cell % cols) * 8, (cell / cols) * 8, fg, COLOR_BLACK);
+            else
+                draw_char(c, (cell % cols) * 8, (cell / cols) * 8, fg, COLOR_BLACK);
+        }
+        elapsed[pass] = timing_cycles_to_us(timing_rdtsc() - start);
+        if (elapsed[pass] == 0)
+            elapsed[pass] = 1;
+    }
+
+    *bitwise_cps = (uint32_t)((uint64_t)total * 1000000 / elapsed[0]);
+    *cached_cps = (uint32_t)((uint64_t)total * 1000000 / elapsed[1]);
+}
@@ -9,14 +9,17 @@
 #include "graphics/graphics.h"
 #include "graphics/font.h"
 #include "memory/heap.h"
+#include "memory/buddy.h"
 #include "utils/string.h"
+#include "utils/memory.h"
 #include "fs/vfs.h"
 
 // Global desktop instance
 static desktop_t g_desktop = {0};
 
-// Forward declaration
+// Forward declarations
 static void render_taskbar(void);
+static void invalidate_taskbar(void);
 
 // Screen dimensions (from graphics)
 extern uint32_t get_screen_width(void);
@@ -167,7 +170,7 @@ int desktop_handle_mouse(int32_t x, int32_t y, uint8_t buttons) {
 
         if (new_hover != g_desktop.hover_button) {
             g_desktop.hover_button = new_hover;
-            render_taskbar();  // Only redraw taskbar, not whole desktop
+            invalidate_taskbar();  // Only redraw taskbar, not whole desktop
         }
 
         // Handle click
@@ -186,7 +189,7 @@ int desktop_handle_mouse(int32_t x, int32_t y, uint8_t buttons) {
     // Clear hover when not in taskbar
     if (g_desktop.hover_button != -1) {
         g_desktop.hover_button = -1;
-        render_taskbar();  // Only redraw taskbar
+        invalidate_taskbar();  // Only redraw taskbar
     }
 
     // Route mouse to draw app if mouse is within its content area
@@ -262,33 +265,53 @@ static void render_taskbar(void) {
     }
 }
 
-// Render full desktop (background + taskbar)
-void desktop_render(void) {
+// Render the desktop layer (background + taskbar) inside one rectangle.
+// The window manager calls this for areas no window covers.
+void desktop_render_rect(int32_t x, int32_t y, uint32_t w, uint32_t h) {
     if (!g_desktop.active) return;
 
     uint32_t screen_w = get_screen_width();
     uint32_t screen_h = get_screen_height();
+    uint32_t desktop_h = screen_h - TASKBAR_HEIGHT;
+
+    graphics_rect_t clip = {x, y, w, h};
+    graphics_set_clip(&clip);
+
+    // Clamp the rectangle to the desktop area above the taskbar
+    int32_t x0 = x < 0 ? 0 : x;
+    int32_t y0 = y < 0 ? 0 : y;
+    int32_t x1 = x + (int32_t)w > (int32_t)screen_w ? (int32_t)screen_w : x + (int32_t)w;
+    int32_t y1 = y + (int32_t)h > (int32_t)desktop_h ? (int32_t)desktop_h : y + (int32_t)h;
 
     // Draw desktop background
-    if (g_desktop.bg_pixels && g_desktop.bg_width > 0 && g_desktop.bg_height > 0) {
-        // Draw background image (scaled/tiled to fit)
-        uint32_t desktop_h = screen_h - TASKBAR_HEIGHT;
-        for (uint32_t y = 0; y < desktop_h; y++) {
-            uint32_t src_y = (y * g_desktop.bg_height) / desktop_h;
-            if (src_y >= g_desktop.bg_height) src_y = g_desktop.bg_height - 1;
-            for (uint32_t x = 0; x < screen_w; x++) {
-                uint32_t src_x = (x * g_desktop.bg_width) / screen_w;
-                if (src_x >= g_desktop.bg_width) src_x = g_desktop.bg_width - 1;
-                put_pixel(x, y, g_desktop.bg_pixels[src_y * g_desktop.bg_width + src_x]);
-            }
+    if (x0 < x1 && y0 < y1) {
+        if (g_desktop.bg_pixels && g_desktop.bg_width == screen_w && g_desktop.bg_height == desktop_h) {
+            // Copy straight from the pre-scaled backing store
+            blit_rect(x0, y0, g_desktop.bg_pixels + (uint32_t)y0 * screen_w + x0, screen_w,
+                      x1 - x0, y1 - y0, 0);
+        } else {
+            // Draw solid teal color background
+            fill_rect(x0, y0, x1 - x0, y1 - y0, DESKTOP_BG_COLOR);
         }
-    } else {
-        // Draw solid teal color background
-        fill_rect(0, 0, screen_w, screen_h - TASKBAR_HEIGHT, DESKTOP_BG_COLOR);
     }
 
-    // Draw taskbar
-    render_taskbar();
+    // Draw taskbar (clipped to the rectangle)
+    if (y + (int32_t)h > (int32_t)desktop_h) {
+        render_taskbar();
+    }
+
+    graphics_set_clip(0);
+}
+
+// Render full desktop (background + taskbar)
+void desktop_render(void) {
+    desktop_render_rect(0, 0, get_screen_width(), get_screen_height());
+}
+
+// Queue a taskbar repaint through the compositor so windows stay on top
+static void invalidate_taskbar(void) {
+    uint32_t screen_h = get_screen_height();
+    wm_damage_rect(0, screen_h - TASKBAR_HEIGHT, get_screen_width(), TASKBAR_HEIGHT);
 }
 
 // Open an application
@@ -324,8 +347,7 @@ void desktop_open_app(app_type_t app) {
     }
 
     // Redraw taskbar to show open indicator
-    desktop_render();
-    wm_force_render();
+    invalidate_taskbar();
 }
 
 // Called when a window is destroyed - clear our reference
@@ -341,7 +363,7 @@ void desktop_notify_window_closed(window_t *win) {
     if (g_desktop.terminal && g_desktop.terminal->window == win) {
         g_desktop.terminal = 0;
     }
-    render_taskbar();  // Update indicator dots
+    invalidate_taskbar();  // Update indicator dots
 }
 
 // Detect image format from data
@@ -360,78 +382,168 @@ static int detect_image_format(const uint8_t *data, size_t size) {
     return 0;  // Unknown
 }
 
-// Set desktop background image from file
-int desktop_set_background(const char *path) {
-    if (!path) return -1;
-
-    // Read file
-    vfs_node_t *file = vfs_open(path, VFS_READ);
-    if (!file) return -1;
+// Box filter for shrinking: each output pixel averages its source footprint
+static void scale_box(const uint32_t *src, uint32_t sw, uint32_t sh,
+                      uint32_t *dst, uint32_t dw, uint32_t dh) {
+    for (uint32_t y = 0; y < dh; y++) {
+        uint32_t sy0 = (uint32_t)(((uint64_t)y * sh) / dh);
+        uint32_t sy1 = (uint32_t)(((uint64_t)(y + 1) * sh) / dh);
+        if (sy1 <= sy0) sy1 = sy0 + 1;
+
+        for (uint32_t x = 0; x < dw; x++) {
+            uint32_t sx0 = (uint32_t)(((uint64_t)x * sw) / dw);
+            uint32_t sx1 = (uint32_t)(((uint64_t)(x + 1) * sw) / dw);
+            if (sx1 <= sx0) sx1 = sx0 + 1;
+
+            uint32_t r = 0, g = 0, b = 0;
+            for (uint32_t sy = sy0; sy < sy1; sy++) {
+                const uint32_t *row = src + sy * sw;
+                for (uint32_t sx = sx0; sx < sx1; sx++) {
+                    uint32_t c = row[sx];
+                    r += (c >> 16) & 0xFF;
+                    g += (c >> 8) & 0xFF;
+                    b += c & 0xFF;
+                }
+            }
 
-    uint8_t *buffer = (uint8_t *)kmalloc(file->length);
-    if (!buffer) {
-        vfs_close(file);
-        return -1;
+            uint32_t n = (sy1 - sy0) * (sx1 - sx0);
+            dst[y * dw + x] = ((r / n) << 16) | ((g / n) << 8) | (b / n);
+        }
     }
+}
 
-    int bytes_read = vfs_read(file, 0, file->length, buffer);
-    vfs_close(file);
-
-    if (bytes_read <= 0) {
-        kfree(buffer);
-        return -1;
+// Bilinear filter for enlarging, 8-bit fixed-point weights
+static void scale_bilinear(const uint32_t *src, uint32_t sw, uint32_t sh,
+                           uint32_t *dst, uint32_t dw, uint32_t dh) {
+    // Sample at pixel centers: s = (d + 0.5) * sw / dw - 0.5, in 16.16
+    int64_t step_x = ((int64_t)sw << 16) / dw;
+    int64_t step_y = ((int64_t)sh << 16) / dh;
+
+    for (uint32_t y = 0; y < dh; y++) {
+        int64_t fy = step_y / 2 + (int64_t)y * step_y - 0x8000;
+        if (fy < 0) fy = 0;
+        uint32_t y0 = (uint32_t)(fy >> 16);
+        uint32_t y1 = y0 + 1 < sh ? y0 + 1 : sh - 1;
+        uint32_t wy = (uint32_t)(fy >> 8) & 0xFF;
+        const uint32_t *row0 = src + y0 * sw;
+        const uint32_t *row1 = src + y1 * sw;
+
+        for (uint32_t x = 0; x < dw; x++) {
+            int64_t fx = step_x / 2 + (int64_t)x * step_x - 0x8000;
+            if (fx < 0) fx = 0;
+            uint32_t x0 = (uint32_t)(fx >> 16);
+            uint32_t x1 = x0 + 1 < sw ? x0 + 1 : sw - 1;
+            uint32_t wx = (uint32_t)(fx >> 8) & 0xFF;
+
+            uint32_t c00 = row0[x0], c01 = row0[x1];
+            uint32_t c10 = row1[x0], c11 = row1[x1];
+            uint32_t out = 0;
+            for (int shift = 0; shift <= 16; shift += 8) {
+                uint32_t top = ((c00 >> shift) & 0xFF) * (256 - wx) + ((c01 >> shift) & 0xFF) * wx;
+                uint32_t bot = ((c10 >> shift) & 0xFF) * (256 - wx) + ((c11 >> shift) & 0xFF) * wx;
+                uint32_t v = (top * (256 - wy) + bot * wy) >> 16;
+                out |= v << shift;
+            }
+            dst[y * dw + x] = out;
+        }
     }
+}
 
-    // Detect format and load
-    int format = detect_image_format(buffer, bytes_read);
+// Decode an image file into a freshly kmalloc'd pixel array
+static uint32_t *decode_image(const uint8_t *data, size_t size, uint32_t *width, uint32_t *height) {
+    int format = detect_image_format(data, size);
     uint32_t *pixels = 0;
-    uint32_t width = 0, height = 0;
 
     if (format == 1) {
         // BMP
-        bmp_image_t *img = bmp_load(buffer, bytes_read);
+        bmp_image_t *img = bmp_load(data, size);
         if (img) {
             pixels = img->pixels;
-            width = img->width;
-            height = img->height;
+            *width = img->width;
+            *height = img->height;
             kfree(img);  // Free struct but keep pixels
         }
     } else if (format == 2) {
         // PNG
-        png_image_t *img = png_load(buffer, bytes_read);
+        png_image_t *img = png_load(data, size);
         if (img) {
             pixels = img->pixels;
-            width = img->width;
-            height = img->height;
+            *width = img->width;
+            *height = img->height;
             kfree(img);  // Free struct but keep pixels
         }
     } else if (format == 3) {
         // JPG
-        jpg_image_t *img = jpg_load(buffer, bytes_read);
+        jpg_image_t *img = jpg_load(data, size);
         if (img) {
             pixels = img->pixels;
-            width = img->width;
-            height = img->height;
+            *width = img->width;
+            *height = img->height;
             kfree(img);  // Free struct but keep pixels
         }
     }
 
+    return pixels;
+}
+
+// Set desktop background image from file
+int desktop_set_background(const char *path) {
+    if (!path) return -1;
+
+    uint32_t screen_w = get_screen_width();
+    uint32_t desktop_h = get_screen_height() - TASKBAR_HEIGHT;
+
+    // Read file
+    vfs_node_t *file = vfs_open(path, VFS_READ);
+    if (!file) return -1;
+
+    uint8_t *buffer = (uint8_t *)kmalloc(file->length);
+    if (!buffer) {
+        vfs_close(file);
+        return -1;
+    }
+    int bytes_read = vfs_read(file, 0, file->length, buffer);
+    vfs_close(file);
+    if (bytes_read <= 0) {
+        kfree(buffer);
+        return -1;
+    }
+
+    // Detect format and load
+    uint32_t width = 0, height = 0;
+    uint32_t *pixels = decode_image(buffer, bytes_read, &width, &height);
     kfree(buffer);
 
-    if (!pixels) return -1;
+    if (!pixels || width == 0 || height == 0) {
+        if (pixels) kfree(pixels);
+        return -1;
+    }
+
+    uint32_t *scaled = (uint32_t *)kmalloc_pages((size_t)screen_w * desktop_h * sizeof(uint32_t));
+    if (!scaled) {
+        kfree(pixels);
+        return -1;
+    }
+
+    // Scale once to the desktop area
+    if (width >= screen_w && height >= desktop_h) {
+        scale_box(pixels, width, height, scaled, screen_w, desktop_h);
+    } else {
+        scale_bilinear(pixels, width, height, scaled, screen_w, desktop_h);
+    }
+    kfree(pixels);
 
     // Free old background if any
     if (g_desktop.bg_pixels) {
-        kfree(g_desktop.bg_pixels);
+        kfree_pages(g_desktop.bg_pixels);
     }
 
     // Set new background
-    g_desktop.bg_pixels = pixels;
-    g_desktop.bg_width = width;
-    g_desktop.bg_height = height;
+    g_desktop.bg_pixels = scaled;
+    g_desktop.bg_width = screen_w;
+    g_desktop.bg_height = desktop_h;
 
-    // Redraw desktop
-    desktop_render();
+    // Redraw desktop and everything on it
     wm_force_render();
 
     return 0;
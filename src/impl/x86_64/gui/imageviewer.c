@@ -7,11 +7,19 @@
 #include "utils/memory.h"
 #include "utils/string.h"
 #include "fs/vfs.h"
+#include "graphics/graphics.h"
+#include "utils/timing.h"
 
 // Default viewer size
 #define VIEWER_DEFAULT_WIDTH  400
 #define VIEWER_DEFAULT_HEIGHT 300
 
+// Minimum time between screen updates while an image is still decoding
+#define VIEWER_PROGRESS_MS 16
+
+// TSC of the last progressive update
+static uint64_t progress_last = 0;
+
 // Paint callback
 static void imageviewer_paint(window_t *win) {
     image_viewer_t *viewer = (image_viewer_t *)win->user_data;
@@ -39,14 +47,7 @@ static void imageviewer_paint(window_t *win) {
     }
 
     // Draw image pixels
-    for (uint32_t y = 0; y < img->height && y + offset_y < win->content_height; y++) {
-        for (uint32_t x = 0; x < img->width && x + offset_x < win->content_width; x++) {
-            if (x + offset_x >= 0 && y + offset_y >= 0) {
-                window_put_pixel(win, offset_x + x, offset_y + y,
-                                img->pixels[y * img->width + x]);
-            }
-        }
-    }
+    window_draw_image(win, img->pixels, offset_x, offset_y, img->width, img->height);
 }
 
 // Free image based on format
@@ -131,6 +132,51 @@ static generic_image_t *load_image_data(const uint8_t *data, size_t size, image_
     }
 }
 
+// Resize window to fit image (with limits)
+static void fit_window(image_viewer_t *viewer) {
+    uint32_t new_width = viewer->image->width;
+    uint32_t new_height = viewer->image->height;
+
+    if (new_width > 800) new_width = 800;
+    if (new_height > 600) new_height = 600;
+    if (new_width < 100) new_width = 100;
+    if (new_height < 100) new_height = 100;
+
+    window_resize(viewer->window, new_width, new_height);
+}
+
+// PNG header decoded: show the (still blank) image at its final size
+static void progressive_header(void *ctx, png_image_t *img) {
+    image_viewer_t *viewer = (image_viewer_t *)ctx;
+    viewer->image = (generic_image_t *)img;
+    fit_window(viewer);
+    progress_last = 0;
+}
+
+// PNG row decoded: put what we have on screen, at most once a frame
+static void progressive_row(void *ctx, png_image_t *img, uint32_t y) {
+    image_viewer_t *viewer = (image_viewer_t *)ctx;
+    uint64_t now = timing_rdtsc();
+    if (y + 1 < img->height && now - progress_last < timing_tsc_khz() * VIEWER_PROGRESS_MS) {
+        return;
+    }
+    progress_last = now;
+
+    window_invalidate(viewer->window);
+    wm_render();
+    graphics_flush();
+}
+
+// Set the title to the file name
+static void set_title_from_path(image_viewer_t *viewer, const char *path) {
+    const char *filename = path;
+    // Find last / or start
+    for (const char *p = path; *p; p++) {
+        if (*p == '/') filename = p + 1;
+    }
+    window_set_title(viewer->window, filename);
+}
+
 // Load from file
 int imageviewer_load_file(image_viewer_t *viewer, const char *path) {
     if (!viewer) return -1;
@@ -142,6 +188,27 @@ int imageviewer_load_file(image_viewer_t *viewer, const char *path) {
     vfs_node_t *node = vfs_open(path, VFS_READ);
     if (!node) return -1;
 
+    // PNGs decode while the file is read, drawing rows as they arrive
+    uint8_t signature[8];
+    if (vfs_read(node, 0, sizeof(signature), signature) == (int)sizeof(signature) &&
+        detect_format(signature, sizeof(signature)) == IMG_FORMAT_PNG) {
+        vfs_close(node);
+
+        viewer->format = IMG_FORMAT_PNG;
+        set_title_from_path(viewer, path);
+
+        png_callbacks_t cb = {progressive_header, progressive_row, viewer};
+        png_image_t *img = png_load_file_progressive(path, &cb);
+        if (!img) {
+            viewer->image = 0;  // Freed by the decoder
+            return -1;
+        }
+
+        viewer->image = (generic_image_t *)img;
+        window_invalidate(viewer->window);
+        return 0;
+    }
+
     uint8_t *buffer = (uint8_t *)kmalloc(node->length);
     if (!buffer) {
         vfs_close(node);
@@ -171,23 +238,9 @@ int imageviewer_load_file(image_viewer_t *viewer, const char *path) {
     }
 
     // Update window title
-    const char *filename = path;
-    // Find last / or start
-    for (const char *p = path; *p; p++) {
-        if (*p == '/') filename = p + 1;
-    }
-    window_set_title(viewer->window, filename);
-
-    // Resize window to fit image (with limits)
-    uint32_t new_width = viewer->image->width;
-    uint32_t new_height = viewer->image->height;
-
-    if (new_width > 800) new_width = 800;
-    if (new_height > 600) new_height = 600;
-    if (new_width < 100) new_width = 100;
-    if (new_height < 100) new_height = 100;
+    set_title_from_path(viewer, path);
 
-    window_resize(viewer->window, new_width, new_height);
+    fit_window(viewer);
 
     // Trigger repaint
     window_invalidate(viewer->window);
@@ -213,16 +266,7 @@ int imageviewer_load_data(image_viewer_t *viewer, const uint8_t *data, size_t si
         return -1;
     }
 
-    // Resize window to fit image (with limits)
-    uint32_t new_width = viewer->image->width;
-    uint32_t new_height = viewer->image->height;
-
-    if (new_width > 800) new_width = 800;
-    if (new_height > 600) new_height = 600;
-    if (new_width < 100) new_width = 100;
-    if (new_height < 100) new_height = 100;
-
-    window_resize(viewer->window, new_width, new_height);
+    fit_window(viewer);
 
     // Trigger repaint
     window_invalidate(viewer->window);
@@ -2,22 +2,44 @@
 #include "memory/heap.h"
 #include "utils/memory.h"
 #include "fs/vfs.h"
+#include "utils/timing.h"
 
 // JPEG markers
 #define MARKER_SOI  0xD8  // Start of Image
 #define MARKER_EOI  0xD9  // End of Image
 #define MARKER_SOF0 0xC0  // Baseline DCT
-#define MARKER_SOF2 0xC2  // Progressive DCT (not supported)
+#define MARKER_SOF1 0xC1  // Extended sequential DCT (Huffman)
+#define MARKER_SOF2 0xC2  // Progressive DCT (Huffman)
 #define MARKER_DHT  0xC4  // Define Huffman Table
+#define MARKER_JPG  0xC8  // Reserved
+#define MARKER_DAC  0xCC  // Define Arithmetic Coding conditioning
 #define MARKER_DQT  0xDB  // Define Quantization Table
 #define MARKER_DRI  0xDD  // Define Restart Interval
 #define MARKER_SOS  0xDA  // Start of Scan
+#define MARKER_RST0 0xD0  // Restart markers RST0..RST7
+#define MARKER_RST7 0xD7
 #define MARKER_APP0 0xE0  // JFIF
 #define MARKER_COM  0xFE  // Comment
 
 // Maximum values
 #define MAX_COMPONENTS 3
 #define MAX_HUFFMAN_TABLES 4
+#define MAX_SAMPLING 2  // Largest supported h/v sampling factor
+
+// Huffman codes up to this many bits decode with a single table lookup
+#define HUFF_LOOKAHEAD 9
+
+// AAN IDCT fixed point (as in the IJG "ifast" IDCT): products carry
+// IDCT_CONST_BITS fraction bits, the first pass keeps IDCT_PASS1_BITS extra
+#define IDCT_CONST_BITS 8
+#define IDCT_PASS1_BITS 2
+#define IDCT_QUANT_BITS 8  // Fraction bits kept in the scaled quant tables
+#define FIX_1_082392200 277
+#define FIX_1_414213562 362
+#define FIX_1_847759065 473
+#define FIX_2_613125930 669
+#define IDCT_MUL(v, c) (((v) * (c)) >> IDCT_CONST_BITS)
+#define DEQUANT(v, q) (((v) * (q) + (1 << (IDCT_QUANT_BITS - 1))) >> IDCT_QUANT_BITS)
 
 // Zigzag order
 static const uint8_t zigzag[64] = {
@@ -31,13 +53,15 @@ static const uint8_t zigzag[64] = {
     53, 60, 61, 54, 47, 55, 62, 63
 };
 
-// Huffman table
+// Huffman table in canonical form (JPEG Annex C). Codes of up to
+// HUFF_LOOKAHEAD bits resolve through lookup; longer ones through maxcode.
 typedef struct {
     uint8_t bits[16];      // Number of codes of each length
     uint8_t values[256];   // Symbol values
-    uint16_t codes[256];   // Huffman codes
-    int sizes[256];        // Code lengths
-    int num_codes;
+    uint16_t lookup[1 << HUFF_LOOKAHEAD];  // (length << 8) | symbol, 0 = longer code
+    int32_t maxcode[17];   // Largest code of each length, -1 if none
+    int32_t valptr[17];    // values[] index of a code of each length, minus the code
+    uint8_t present;
 } huffman_table_t;
 
 // JPEG decoder state
@@ -49,6 +73,13 @@ typedef struct {
     uint32_t width;
     uint32_t height;
     uint8_t num_components;
+    uint8_t progressive;
+    uint8_t buffered;      // Scans accumulate into coefficient buffers
+    uint8_t hmax;          // Largest sampling factors: the MCU is
+    uint8_t vmax;          // 8*hmax x 8*vmax pixels
+    uint32_t mcus_x;
+    uint32_t mcus_y;
+    uint32_t scan_count;
 
     // Component info
     struct {
@@ -58,76 +89,103 @@ typedef struct {
         uint8_t qt_id;     // Quantization table ID
         uint8_t dc_table;  // DC Huffman table
         uint8_t ac_table;  // AC Huffman table
+        uint32_t blocks_w; // Blocks per row/column in a non-interleaved scan
+        uint32_t blocks_h;
+        uint32_t stride;   // Blocks per row of coefs (padded to whole MCUs)
+        int16_t *coefs;    // Quantized coefficients, natural order (buffered only)
     } components[MAX_COMPONENTS];
 
-    // Quantization tables (up to 4)
+    // Quantization tables (up to 4), zigzag order as stored in DQT
     int16_t quant[4][64];
+    // Same tables in natural order, premultiplied by the AAN scale factors
+    int32_t quant_scaled[4][64];
 
-    // Huffman tables (DC and AC, up to 2 each)
-    huffman_table_t huff_dc[2];
-    huffman_table_t huff_ac[2];
+    huffman_table_t huff_dc[MAX_HUFFMAN_TABLES];
+    huffman_table_t huff_ac[MAX_HUFFMAN_TABLES];
 
-    // Bit reading state
-    uint32_t bit_buffer;
-    int bits_left;
-
-    // DC prediction values
-    int16_t dc_pred[MAX_COMPONENTS];
-
-    // Restart interval
+    // Restart interval in MCUs, 0 if none
     uint16_t restart_interval;
-    uint16_t restart_count;
+
+    jpg_image_t *img;
 } jpeg_decoder_t;
 
+// One scan's parameters
+typedef struct {
+    uint8_t num_components;
+    uint8_t comp[MAX_COMPONENTS];  // Indices into components[], in scan order
+    uint8_t ss;            // Spectral selection start/end (zigzag index)
+    uint8_t se;
+    uint8_t ah;            // Successive approximation: previous/current bit
+    uint8_t al;
+    uint32_t mcus_x;       // MCU grid; a non-interleaved scan's MCU is one block
+    uint32_t mcu_count;
+} jpeg_scan_t;
+
+// A run of MCUs between restart markers. Segments share no entropy
+// decoder state, so each can be decoded on its own.
+typedef struct {
+    size_t start;          // Entropy-coded bytes, markers excluded
+    size_t end;
+    uint32_t first_mcu;
+    uint32_t mcu_count;
+} jpeg_segment_t;
+
+// Bit reader and prediction state for one segment
+typedef struct {
+    const uint8_t *data;
+    size_t pos;
+    size_t end;
+    uint32_t bit_buffer;
+    int bits_left;
+    int dc_pred[MAX_COMPONENTS];
+    uint32_t eobrun;       // Progressive AC: blocks left in the current end-of-band run
+} jpeg_stream_t;
+
 // Read 16-bit big-endian
 static uint16_t read_be16(const uint8_t *p) {
     return ((uint16_t)p[0] << 8) | p[1];
 }
 
-// Get next byte (handles FF00 stuffing)
-static int get_byte(jpeg_decoder_t *d) {
-    if (d->pos >= d->size) return -1;
-    uint8_t b = d->data[d->pos++];
-
-    // Handle byte stuffing (FF00 -> FF)
-    if (b == 0xFF && d->pos < d->size && d->data[d->pos] == 0x00) {
-        d->pos++;
+// Top up the bit buffer to at least 25 bits. FF00 stuffing is undone;
+// past the end of the segment, zero bits are supplied.
+static void fill_bits(jpeg_stream_t *s) {
+    while (s->bits_left <= 24) {
+        uint32_t b = 0;
+        if (s->pos < s->end) {
+            b = s->data[s->pos++];
+            if (b == 0xFF && s->pos < s->end && s->data[s->pos] == 0x00) {
+                s->pos++;
+            }
+        }
+        s->bit_buffer = (s->bit_buffer << 8) | b;
+        s->bits_left += 8;
     }
-
-    return b;
 }
 
-// Get n bits from bitstream
-static int get_bits(jpeg_decoder_t *d, int n) {
-    while (d->bits_left < n) {
-        int b = get_byte(d);
-        if (b < 0) return -1;
-        d->bit_buffer = (d->bit_buffer << 8) | b;
-        d->bits_left += 8;
-    }
-
-    d->bits_left -= n;
-    return (d->bit_buffer >> d->bits_left) & ((1 << n) - 1);
+// Get n (0..16) bits from the stream
+static inline int get_bits(jpeg_stream_t *s, int n) {
+    if (n == 0) return 0;
+    if (s->bits_left < n) fill_bits(s);
+    s->bits_left -= n;
+    return (s->bit_buffer >> s->bits_left) & ((1 << n) - 1);
 }
 
-// Decode Huffman symbol
-static int decode_huffman(jpeg_decoder_t *d, huffman_table_t *table) {
-    int code = 0;
+// Decode Huffman symbol, -1 on an invalid code
+static int decode_huffman(jpeg_stream_t *s, const huffman_table_t *table) {
+    if (s->bits_left < 16) fill_bits(s);
 
-    for (int len = 1; len <= 16; len++) {
-        int bit = get_bits(d, 1);
-        if (bit < 0) return -1;
-        code = (code << 1) | bit;
-
-        // Search for matching code
-        int idx = 0;
-        for (int i = 0; i < len - 1; i++) {
-            idx += table->bits[i];
-        }
-        for (int i = 0; i < table->bits[len - 1]; i++) {
-            if (table->sizes[idx + i] == len && table->codes[idx + i] == code) {
-                return table->values[idx + i];
-            }
+    int look = (s->bit_buffer >> (s->bits_left - HUFF_LOOKAHEAD)) & ((1 << HUFF_LOOKAHEAD) - 1);
+    uint16_t entry = table->lookup[look];
+    if (entry) {
+        s->bits_left -= entry >> 8;
+        return entry & 0xFF;
+    }
+
+    for (int len = HUFF_LOOKAHEAD + 1; len <= 16; len++) {
+        int32_t code = (s->bit_buffer >> (s->bits_left - len)) & ((1 << len) - 1);
+        if (code <= table->maxcode[len]) {
+            s->bits_left -= len;
+            return table->values[code + table->valptr[len]];
         }
     }
 
@@ -144,399 +202,844 @@ static int extend(int value, int bits) {
     return value;
 }
 
-// Build Huffman table codes
-static void build_huffman_codes(huffman_table_t *table) {
-    int code = 0;
-    int idx = 0;
+// Build the lookup and maxcode tables; -1 if the code lengths overflow
+static int build_huffman_table(huffman_table_t *table) {
+    int32_t code = 0;
+    int k = 0;
 
+    memset(table->lookup, 0, sizeof(table->lookup));
     for (int len = 1; len <= 16; len++) {
-        for (int i = 0; i < table->bits[len - 1]; i++) {
-            table->codes[idx] = code;
-            table->sizes[idx] = len;
-            idx++;
-            code++;
+        int n = table->bits[len - 1];
+        if (code + n > (1 << len)) return -1;
+
+        table->valptr[len] = k - code;
+        for (int i = 0; i < n; i++, k++, code++) {
+            if (len <= HUFF_LOOKAHEAD) {
+                int shift = HUFF_LOOKAHEAD - len;
+                uint16_t entry = (uint16_t)((len << 8) | table->values[k]);
+                for (int j = 0; j < (1 << shift); j++) {
+                    table->lookup[(code << shift) | j] = entry;
+                }
+            }
         }
+        table->maxcode[len] = n ? code - 1 : -1;
         code <<= 1;
     }
-    table->num_codes = idx;
+
+    table->present = 1;
+    return 0;
 }
 
-// Simple integer IDCT (scaled, approximate)
-static void idct_block(int16_t *block) {
-    // Very simplified IDCT using integer math
-    // This is a scaled approximation, not exact
-    int tmp[64];
-
-    // Row IDCT
-    for (int i = 0; i < 8; i++) {
-        int *row = &tmp[i * 8];
-        int16_t *src = &block[i * 8];
-
-        // DC term (scaled by 8)
-        int dc = src[0] * 8;
-
-        // Simplified: just use DC for now (very basic approximation)
-        // A proper IDCT would compute all 64 terms
-        int s1 = src[1] * 7;
-        int s2 = src[2] * 6;
-        int s3 = src[3] * 4;
-        int s4 = src[4] * 3;
-
-        row[0] = dc + s1 + s2 + s3 + s4;
-        row[1] = dc + s1 + s2 + s3 - s4;
-        row[2] = dc + s1 + s2 - s3;
-        row[3] = dc + s1 - s2;
-        row[4] = dc - s1;
-        row[5] = dc - s1 - s2;
-        row[6] = dc - s1 - s2 - s3;
-        row[7] = dc - s1 - s2 - s3 - s4;
-    }
-
-    // Column IDCT + final scaling
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            int val = tmp[j * 8 + i];
-            // Scale down and add 128 (level shift)
-            val = (val / 64) + 128;
-            // Clamp
-            if (val < 0) val = 0;
-            if (val > 255) val = 255;
-            block[j * 8 + i] = val;
+// AAN row/column scale factors, 14-bit fixed point:
+// aan[i][j] = 16384 * s(i) * s(j), s(0) = 1, s(k) = cos(k*pi/16) * sqrt(2)
+static const uint16_t aan_scales[64] = {
+    16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+    22725, 31521, 29692, 26722, 22725, 17855, 12299,  6270,
+    21407, 29692, 27969, 25172, 21407, 16819, 11585,  5906,
+    19266, 26722, 25172, 22654, 19266, 15137, 10426,  5315,
+    16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+    12873, 17855, 16819, 15137, 12873, 10114,  6967,  3552,
+     8867, 12299, 11585, 10426,  8867,  6967,  4799,  2446,
+     4520,  6270,  5906,  5315,  4520,  3552,  2446,  1247
+};
+
+// Fold the AAN output scaling into the quantization tables, so that
+// dequantization is the only multiply per coefficient. The extra fraction
+// bits keep fine quantizers (quality 95+) from being rounded coarsely.
+static void scale_quant_tables(jpeg_decoder_t *d) {
+    for (int t = 0; t < 4; t++) {
+        for (int i = 0; i < 64; i++) {
+            int n = zigzag[i];
+            d->quant_scaled[t][n] = ((int32_t)d->quant[t][i] * aan_scales[n] +
+                                     (1 << (13 - IDCT_PASS1_BITS - IDCT_QUANT_BITS))) >>
+                                    (14 - IDCT_PASS1_BITS - IDCT_QUANT_BITS);
         }
     }
 }
 
-// Decode one 8x8 block
-static int decode_block(jpeg_decoder_t *d, int16_t *block, int comp) {
-    memset(block, 0, 64 * sizeof(int16_t));
+static inline uint8_t clamp_sample(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
 
-    // DC coefficient
-    int dc_table = d->components[comp].dc_table;
-    int symbol = decode_huffman(d, &d->huff_dc[dc_table]);
-    if (symbol < 0) return -1;
+// Separable AAN IDCT on dequantized coefficients (natural order), writing
+// level-shifted 8-bit samples. 5 multiplies per 1-D pass.
+static void idct_block(int32_t *block, uint8_t *out, int stride) {
+    int32_t ws[64];
+
+    // Pass 1: columns
+    for (int c = 0; c < 8; c++) {
+        int32_t *in = block + c;
+        int32_t *w = ws + c;
+
+        if ((in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56]) == 0) {
+            // AC terms all zero: the column is flat
+            int32_t dc = in[0];
+            w[0] = w[8] = w[16] = w[24] = w[32] = w[40] = w[48] = w[56] = dc;
+            continue;
+        }
 
-    if (symbol > 0) {
-        int value = get_bits(d, symbol);
-        if (value < 0) return -1;
-        value = extend(value, symbol);
-        d->dc_pred[comp] += value;
+        // Even part
+        int32_t tmp10 = in[0] + in[32];
+        int32_t tmp11 = in[0] - in[32];
+        int32_t tmp13 = in[16] + in[48];
+        int32_t tmp12 = IDCT_MUL(in[16] - in[48], FIX_1_414213562) - tmp13;
+
+        int32_t tmp0 = tmp10 + tmp13;
+        int32_t tmp3 = tmp10 - tmp13;
+        int32_t tmp1 = tmp11 + tmp12;
+        int32_t tmp2 = tmp11 - tmp12;
+
+        // Odd part
+        int32_t z13 = in[40] + in[24];
+        int32_t z10 = in[40] - in[24];
+        int32_t z11 = in[8] + in[56];
+        int32_t z12 = in[8] - in[56];
+
+        int32_t tmp7 = z11 + z13;
+        tmp11 = IDCT_MUL(z11 - z13, FIX_1_414213562);
+        int32_t z5 = IDCT_MUL(z10 + z12, FIX_1_847759065);
+        tmp10 = IDCT_MUL(z12, FIX_1_082392200) - z5;
+        tmp12 = IDCT_MUL(z10, -FIX_2_613125930) + z5;
+
+        int32_t tmp6 = tmp12 - tmp7;
+        int32_t tmp5 = tmp11 - tmp6;
+        int32_t tmp4 = tmp10 + tmp5;
+
+        w[0] = tmp0 + tmp7;
+        w[56] = tmp0 - tmp7;
+        w[8] = tmp1 + tmp6;
+        w[48] = tmp1 - tmp6;
+        w[16] = tmp2 + tmp5;
+        w[40] = tmp2 - tmp5;
+        w[32] = tmp3 + tmp4;
+        w[24] = tmp3 - tmp4;
     }
-    block[0] = d->dc_pred[comp] * d->quant[d->components[comp].qt_id][0];
+
+    // Pass 2: rows, then descale, round and level shift
+    const int shift = IDCT_PASS1_BITS + 3;
+    const int32_t bias = (128 << shift) + (1 << (shift - 1));
+
+    for (int r = 0; r < 8; r++) {
+        int32_t *w = ws + r * 8;
+        uint8_t *o = out + r * stride;
+
+        int32_t tmp10 = w[0] + w[4] + bias;
+        int32_t tmp11 = w[0] - w[4] + bias;
+        int32_t tmp13 = w[2] + w[6];
+        int32_t tmp12 = IDCT_MUL(w[2] - w[6], FIX_1_414213562) - tmp13;
+
+        int32_t tmp0 = tmp10 + tmp13;
+        int32_t tmp3 = tmp10 - tmp13;
+        int32_t tmp1 = tmp11 + tmp12;
+        int32_t tmp2 = tmp11 - tmp12;
+
+        int32_t z13 = w[5] + w[3];
+        int32_t z10 = w[5] - w[3];
+        int32_t z11 = w[1] + w[7];
+        int32_t z12 = w[1] - w[7];
+
+        int32_t tmp7 = z11 + z13;
+        tmp11 = IDCT_MUL(z11 - z13, FIX_1_414213562);
+        int32_t z5 = IDCT_MUL(z10 + z12, FIX_1_847759065);
+        tmp10 = IDCT_MUL(z12, FIX_1_082392200) - z5;
+        tmp12 = IDCT_MUL(z10, -FIX_2_613125930) + z5;
+
+        int32_t tmp6 = tmp12 - tmp7;
+        int32_t tmp5 = tmp11 - tmp6;
+        int32_t tmp4 = tmp10 + tmp5;
+
+        o[0] = clamp_sample((tmp0 + tmp7) >> shift);
+        o[7] = clamp_sample((tmp0 - tmp7) >> shift);
+        o[1] = clamp_sample((tmp1 + tmp6) >> shift);
+        o[6] = clamp_sample((tmp1 - tmp6) >> shift);
+        o[2] = clamp_sample((tmp2 + tmp5) >> shift);
+        o[5] = clamp_sample((tmp2 - tmp5) >> shift);
+        o[4] = clamp_sample((tmp3 + tmp4) >> shift);
+        o[3] = clamp_sample((tmp3 - tmp4) >> shift);
+    }
+}
+
+// Sequential block (direct path): coefficients dequantized, natural order
+static int decode_block(const jpeg_decoder_t *d, jpeg_stream_t *s, int comp, int32_t *block) {
+    memset(block, 0, 64 * sizeof(int32_t));
+    const int32_t *q = d->quant_scaled[d->components[comp].qt_id];
+
+    // DC coefficient
+    int symbol = decode_huffman(s, &d->huff_dc[d->components[comp].dc_table]);
+    if (symbol < 0 || symbol > 11) return -1;
+    s->dc_pred[comp] += extend(get_bits(s, symbol), symbol);
+    block[0] = DEQUANT(s->dc_pred[comp], q[0]);
 
     // AC coefficients
-    int ac_table = d->components[comp].ac_table;
+    const huffman_table_t *ac = &d->huff_ac[d->components[comp].ac_table];
     int idx = 1;
 
     while (idx < 64) {
-        symbol = decode_huffman(d, &d->huff_ac[ac_table]);
+        symbol = decode_huffman(s, ac);
         if (symbol < 0) return -1;
 
-        if (symbol == 0) {
-            // End of block
-            break;
-        }
-
         int zeros = (symbol >> 4) & 0x0F;
         int bits = symbol & 0x0F;
 
         if (bits == 0) {
-            if (zeros == 15) {
-                // 16 zeros
-                idx += 16;
-            } else {
-                break;
-            }
-        } else {
-            idx += zeros;
-            if (idx >= 64) break;
+            if (zeros != 15) break;  // End of block
+            idx += 16;               // 16 zeros
+            continue;
+        }
 
-            int value = get_bits(d, bits);
-            if (value < 0) return -1;
-            value = extend(value, bits);
+        idx += zeros;
+        if (idx >= 64) return -1;
 
-            int zig_idx = zigzag[idx];
-            block[zig_idx] = value * d->quant[d->components[comp].qt_id][zig_idx];
-            idx++;
-        }
+        int zig_idx = zigzag[idx];
+        block[zig_idx] = DEQUANT(extend(get_bits(s, bits), bits), q[zig_idx]);
+        idx++;
     }
 
-    // Apply IDCT
-    idct_block(block);
+    return 0;
+}
 
+// DC first pass (also the DC half of a buffered sequential block)
+static int decode_dc_first(const jpeg_decoder_t *d, jpeg_stream_t *s, int comp,
+                           int16_t *coef, int al) {
+    int symbol = decode_huffman(s, &d->huff_dc[d->components[comp].dc_table]);
+    if (symbol < 0 || symbol > 11) return -1;
+    s->dc_pred[comp] += extend(get_bits(s, symbol), symbol);
+    coef[0] = (int16_t)(s->dc_pred[comp] * (1 << al));
     return 0;
 }
 
-// Parse JPEG headers
-static int parse_headers(jpeg_decoder_t *d) {
-    // Check SOI marker
-    if (d->pos + 2 > d->size) return -1;
-    if (d->data[0] != 0xFF || d->data[1] != MARKER_SOI) return -1;
-    d->pos = 2;
+// DC refinement: one more bit of every DC coefficient
+static void decode_dc_refine(jpeg_stream_t *s, int16_t *coef, int al) {
+    if (get_bits(s, 1)) coef[0] |= (int16_t)(1 << al);
+}
 
-    while (d->pos + 2 <= d->size) {
-        if (d->data[d->pos] != 0xFF) {
-            d->pos++;
-            continue;
-        }
+// AC first pass over the band ss..se, with end-of-band runs
+static int decode_ac_first(const jpeg_decoder_t *d, jpeg_stream_t *s, int comp,
+                           int16_t *coef, int ss, int se, int al) {
+    if (s->eobrun > 0) {
+        s->eobrun--;
+        return 0;
+    }
 
-        uint8_t marker = d->data[d->pos + 1];
-        d->pos += 2;
+    const huffman_table_t *ac = &d->huff_ac[d->components[comp].ac_table];
+    for (int k = ss; k <= se; k++) {
+        int symbol = decode_huffman(s, ac);
+        if (symbol < 0) return -1;
+
+        int run = symbol >> 4;
+        int bits = symbol & 0x0F;
 
-        // Skip padding FF bytes
-        while (marker == 0xFF && d->pos < d->size) {
-            marker = d->data[d->pos++];
+        if (bits == 0) {
+            if (run < 15) {
+                // EOBn: this block and (1 << run) - 1 + extra more end here
+                s->eobrun = (1u << run) - 1;
+                if (run) s->eobrun += get_bits(s, run);
+                break;
+            }
+            k += 15;  // ZRL
+            continue;
         }
 
-        if (marker == MARKER_EOI) break;
-        if (marker == MARKER_SOS) break;  // Start of scan - stop parsing headers
+        k += run;
+        if (k > se) return -1;
+        coef[zigzag[k]] = (int16_t)(extend(get_bits(s, bits), bits) * (1 << al));
+    }
 
-        // Get segment length
-        if (d->pos + 2 > d->size) return -1;
-        uint16_t length = read_be16(d->data + d->pos);
-        d->pos += 2;
+    return 0;
+}
 
-        if (d->pos + length - 2 > d->size) return -1;
-        const uint8_t *segment = d->data + d->pos;
+// AC refinement (G.1.2.3): one more bit of the coefficients already
+// nonzero, and newly nonzero coefficients of magnitude 1 << al
+static int decode_ac_refine(const jpeg_decoder_t *d, jpeg_stream_t *s, int comp,
+                            int16_t *coef, int ss, int se, int al) {
+    int p1 = 1 << al;
+    int m1 = -p1;
+    int k = ss;
+
+    if (s->eobrun == 0) {
+        const huffman_table_t *ac = &d->huff_ac[d->components[comp].ac_table];
+        for (; k <= se; k++) {
+            int symbol = decode_huffman(s, ac);
+            if (symbol < 0) return -1;
+
+            int run = symbol >> 4;
+            int value = 0;
+
+            if (symbol & 0x0F) {
+                value = get_bits(s, 1) ? p1 : m1;
+            } else if (run != 15) {
+                // EOBn, counting this block; its remaining bits follow below
+                s->eobrun = 1u << run;
+                if (run) s->eobrun += get_bits(s, run);
+                break;
+            }
 
-        switch (marker) {
-            case MARKER_SOF0: {
-                // Baseline DCT
-                if (length < 11) return -1;
-                d->height = read_be16(segment + 1);
-                d->width = read_be16(segment + 3);
-                d->num_components = segment[5];
-
-                if (d->num_components > MAX_COMPONENTS) return -1;
-
-                for (int i = 0; i < d->num_components; i++) {
-                    d->components[i].id = segment[6 + i * 3];
-                    uint8_t sampling = segment[7 + i * 3];
-                    d->components[i].h_sample = (sampling >> 4) & 0x0F;
-                    d->components[i].v_sample = sampling & 0x0F;
-                    d->components[i].qt_id = segment[8 + i * 3];
+            // Skip `run` zero coefficients, refining nonzero ones on the way
+            for (; k <= se; k++) {
+                int16_t *c = &coef[zigzag[k]];
+                if (*c != 0) {
+                    if (get_bits(s, 1) && (*c & p1) == 0) {
+                        *c += (int16_t)(*c >= 0 ? p1 : m1);
+                    }
+                } else {
+                    if (run-- == 0) break;
                 }
-                break;
             }
 
-            case MARKER_DHT: {
-                // Define Huffman Table
-                size_t offset = 0;
-                while (offset + 17 <= length - 2) {
-                    uint8_t info = segment[offset++];
-                    int table_class = (info >> 4) & 1;  // 0 = DC, 1 = AC
-                    int table_id = info & 0x0F;
+            if (value && k <= se) coef[zigzag[k]] = (int16_t)value;
+        }
+    }
+
+    if (s->eobrun > 0) {
+        // Inside an end-of-band run only the correction bits remain
+        for (; k <= se; k++) {
+            int16_t *c = &coef[zigzag[k]];
+            if (*c != 0 && get_bits(s, 1) && (*c & p1) == 0) {
+                *c += (int16_t)(*c >= 0 ? p1 : m1);
+            }
+        }
+        s->eobrun--;
+    }
+
+    return 0;
+}
 
-                    if (table_id > 1) return -1;
+// Decode one block of a buffered scan into its coefficient slot
+static int decode_coef_block(const jpeg_decoder_t *d, const jpeg_scan_t *scan,
+                             jpeg_stream_t *s, int comp, int16_t *coef) {
+    if (!d->progressive) {
+        if (decode_dc_first(d, s, comp, coef, 0) != 0) return -1;
+        return decode_ac_first(d, s, comp, coef, 1, 63, 0);
+    }
 
-                    huffman_table_t *table = table_class ?
-                                             &d->huff_ac[table_id] : &d->huff_dc[table_id];
+    if (scan->ss == 0) {
+        if (scan->ah == 0) return decode_dc_first(d, s, comp, coef, scan->al);
+        decode_dc_refine(s, coef, scan->al);
+        return 0;
+    }
 
-                    int num_codes = 0;
-                    for (int i = 0; i < 16; i++) {
-                        table->bits[i] = segment[offset++];
-                        num_codes += table->bits[i];
-                    }
+    if (scan->ah == 0) return decode_ac_first(d, s, comp, coef, scan->ss, scan->se, scan->al);
+    return decode_ac_refine(d, s, comp, coef, scan->ss, scan->se, scan->al);
+}
 
-                    if (offset + num_codes > length - 2) return -1;
-                    for (int i = 0; i < num_codes; i++) {
-                        table->values[i] = segment[offset++];
-                    }
+// YCbCr -> RGB contributions, 16.16 fixed point (JFIF coefficients)
+static int32_t cr_to_r[256];
+static int32_t cb_to_b[256];
+static int32_t cr_to_g[256];
+static int32_t cb_to_g[256];
+static int color_tables_built = 0;
+
+static void build_color_tables(void) {
+    for (int i = 0; i < 256; i++) {
+        int32_t c = i - 128;
+        cr_to_r[i] = (91881 * c + 32768) >> 16;     // 1.402
+        cb_to_b[i] = (116130 * c + 32768) >> 16;    // 1.772
+        cr_to_g[i] = -46802 * c;                    // -0.714136
+        cb_to_g[i] = -22554 * c + 32768;            // -0.344136, carries rounding
+    }
+    color_tables_built = 1;
+}
 
-                    build_huffman_codes(table);
-                }
-                break;
+// Convert one MCU's sample planes to ARGB. Chroma is upsampled by
+// replication on the fly, so no full-resolution chroma planes exist.
+static void color_convert_mcu(const jpeg_decoder_t *d, uint8_t planes[][64 * MAX_SAMPLING * MAX_SAMPLING],
+                              jpg_image_t *img, uint32_t x0, uint32_t y0,
+                              uint32_t mcu_w, uint32_t mcu_h) {
+    uint32_t w = img->width - x0 < mcu_w ? img->width - x0 : mcu_w;
+    uint32_t h = img->height - y0 < mcu_h ? img->height - y0 : mcu_h;
+    uint32_t y_stride = 8 * d->components[0].h_sample;
+
+    if (d->num_components == 1) {
+        for (uint32_t y = 0; y < h; y++) {
+            const uint8_t *ys = planes[0] + y * y_stride;
+            uint32_t *dst = img->pixels + (y0 + y) * img->width + x0;
+            for (uint32_t x = 0; x < w; x++) {
+                uint32_t v = ys[x];
+                dst[x] = 0xFF000000 | (v << 16) | (v << 8) | v;
             }
+        }
+        return;
+    }
+
+    // Chroma shares one sampling factor (checked at load)
+    uint32_t c_stride = 8 * d->components[1].h_sample;
+    int sx = d->components[0].h_sample / d->components[1].h_sample - 1;  // 0 or 1
+    int sy = d->components[0].v_sample / d->components[1].v_sample - 1;
+
+    for (uint32_t y = 0; y < h; y++) {
+        const uint8_t *ys = planes[0] + y * y_stride;
+        const uint8_t *cbs = planes[1] + (y >> sy) * c_stride;
+        const uint8_t *crs = planes[2] + (y >> sy) * c_stride;
+        uint32_t *dst = img->pixels + (y0 + y) * img->width + x0;
+
+        for (uint32_t x = 0; x < w; x++) {
+            int luma = ys[x];
+            int cb = cbs[x >> sx];
+            int cr = crs[x >> sx];
 
-            case MARKER_DQT: {
-                // Define Quantization Table
-                size_t offset = 0;
-                while (offset + 65 <= length - 2) {
-                    uint8_t info = segment[offset++];
-                    int precision = (info >> 4) & 0x0F;
-                    int table_id = info & 0x0F;
+            int r = luma + cr_to_r[cr];
+            int g = luma + ((cb_to_g[cb] + cr_to_g[cr]) >> 16);
+            int b = luma + cb_to_b[cb];
+
+            dst[x] = 0xFF000000 | ((uint32_t)clamp_sample(r) << 16) |
+                     ((uint32_t)clamp_sample(g) << 8) | clamp_sample(b);
+        }
+    }
+}
 
-                    if (table_id > 3) return -1;
-                    if (precision != 0) return -1;  // Only 8-bit precision
+// Decode one restart interval. Only the shared tables are read and only
+// this segment's blocks (or pixels) are written, so segments are free to
+// run concurrently.
+static int decode_segment(const jpeg_decoder_t *d, const jpeg_scan_t *scan,
+                          const jpeg_segment_t *seg) {
+    jpeg_stream_t s;
+    memset(&s, 0, sizeof(s));
+    s.data = d->data;
+    s.pos = seg->start;
+    s.end = seg->end;
+
+    int32_t block[64];
+    uint8_t planes[MAX_COMPONENTS][64 * MAX_SAMPLING * MAX_SAMPLING];
+    uint32_t mcu_w = 8 * d->hmax;
+    uint32_t mcu_h = 8 * d->vmax;
+
+    for (uint32_t m = seg->first_mcu; m < seg->first_mcu + seg->mcu_count; m++) {
+        uint32_t mx = m % scan->mcus_x;
+        uint32_t my = m / scan->mcus_x;
+
+        if (d->buffered && scan->num_components == 1) {
+            // Non-interleaved: the MCU is a single block
+            int c = scan->comp[0];
+            int16_t *coef = d->components[c].coefs +
+                            ((size_t)my * d->components[c].stride + mx) * 64;
+            if (decode_coef_block(d, scan, &s, c, coef) != 0) return -1;
+            continue;
+        }
 
-                    for (int i = 0; i < 64; i++) {
-                        d->quant[table_id][i] = segment[offset++];
+        for (int i = 0; i < scan->num_components; i++) {
+            int c = scan->comp[i];
+            int h = d->components[c].h_sample;
+            int v = d->components[c].v_sample;
+            for (int by = 0; by < v; by++) {
+                for (int bx = 0; bx < h; bx++) {
+                    if (d->buffered) {
+                        int16_t *coef = d->components[c].coefs +
+                                        ((size_t)(my * v + by) * d->components[c].stride +
+                                         mx * h + bx) * 64;
+                        if (decode_coef_block(d, scan, &s, c, coef) != 0) return -1;
+                    } else {
+                        // Single-scan image: straight to samples
+                        if (decode_block(d, &s, c, block) != 0) return -1;
+                        idct_block(block, planes[c] + by * 8 * (8 * h) + bx * 8, 8 * h);
                     }
                 }
-                break;
-            }
-
-            case MARKER_DRI: {
-                // Define Restart Interval
-                if (length >= 4) {
-                    d->restart_interval = read_be16(segment);
-                }
-                break;
             }
         }
 
-        d->pos += length - 2;
+        if (!d->buffered) {
+            color_convert_mcu(d, planes, d->img, mx * mcu_w, my * mcu_h, mcu_w, mcu_h);
+        }
     }
 
     return 0;
 }
 
-// Parse SOS (Start of Scan) and decode
-static int decode_scan(jpeg_decoder_t *d) {
-    // Find SOS marker
-    while (d->pos + 2 <= d->size) {
-        if (d->data[d->pos] == 0xFF && d->data[d->pos + 1] == MARKER_SOS) {
-            d->pos += 2;
+// Split a scan's entropy-coded data at its restart markers, starting at
+// d->pos, into up to max_segs segments of `interval` MCUs. Returns the
+// number of segments; *end gets the offset of the marker after the scan.
+static uint32_t index_scan(const jpeg_decoder_t *d, const jpeg_scan_t *scan, uint32_t interval,
+                           jpeg_segment_t *segs, uint32_t max_segs, size_t *end) {
+    size_t pos = d->pos;
+    size_t start = pos;
+    uint32_t n = 0;
+
+    for (;;) {
+        int last = 0;
+        while (pos + 1 < d->size) {
+            if (d->data[pos] != 0xFF) {
+                pos++;
+                continue;
+            }
+            uint8_t m = d->data[pos + 1];
+            if (m == 0x00) {
+                pos += 2;  // Stuffed FF
+                continue;
+            }
+            if (m == 0xFF) {
+                pos++;     // Fill byte
+                continue;
+            }
             break;
         }
-        d->pos++;
-    }
+        if (pos + 1 >= d->size) {
+            pos = d->size;  // Truncated: the data runs to the end of the file
+            last = 1;
+        } else if (d->data[pos + 1] < MARKER_RST0 || d->data[pos + 1] > MARKER_RST7 ||
+                   d->restart_interval == 0) {
+            last = 1;
+        }
 
-    if (d->pos + 2 > d->size) return -1;
+        if (n < max_segs) {
+            segs[n].start = start;
+            segs[n].end = pos;
+            segs[n].first_mcu = n * interval;
+            segs[n].mcu_count = scan->mcu_count - n * interval < interval ?
+                                scan->mcu_count - n * interval : interval;
+            n++;
+        }
 
-    // Parse SOS header
-    d->pos += 2;  // Skip length field
+        if (last) break;
+        pos += 2;
+        start = pos;
+    }
 
-    uint8_t num_scan_comp = d->data[d->pos++];
-    if (num_scan_comp != d->num_components) return -1;
+    *end = pos;
+    return n;
+}
 
-    for (int i = 0; i < num_scan_comp; i++) {
-        uint8_t comp_id = d->data[d->pos++];
-        uint8_t table_sel = d->data[d->pos++];
+// Parse SOF0/1/2
+static int parse_frame(jpeg_decoder_t *d, const uint8_t *segment, uint16_t length,
+                       int progressive) {
+    if (d->img) return -1;  // One frame per image
+    if (length < 6 || segment[0] != 8) return -1;  // Only 8-bit precision
+
+    d->height = read_be16(segment + 1);
+    d->width = read_be16(segment + 3);
+    d->num_components = segment[5];
+    d->progressive = (uint8_t)progressive;
+
+    // Grayscale or YCbCr; height 0 (defined later by DNL) is not supported
+    if (d->width == 0 || d->height == 0) return -1;
+    if (d->num_components != 1 && d->num_components != 3) return -1;
+    if (length < 6 + 3 * d->num_components) return -1;
+
+    for (int i = 0; i < d->num_components; i++) {
+        d->components[i].id = segment[6 + i * 3];
+        uint8_t sampling = segment[7 + i * 3];
+        d->components[i].h_sample = (sampling >> 4) & 0x0F;
+        d->components[i].v_sample = sampling & 0x0F;
+        d->components[i].qt_id = segment[8 + i * 3];
+        if (d->components[i].qt_id > 3) return -1;
+    }
 
-        // Find component and set table selections
-        for (int j = 0; j < d->num_components; j++) {
-            if (d->components[j].id == comp_id) {
-                d->components[j].dc_table = (table_sel >> 4) & 0x0F;
-                d->components[j].ac_table = table_sel & 0x0F;
-                break;
-            }
+    // Luma may be subsampled 1x or 2x against chroma in each direction;
+    // both chroma components must match
+    int hmax = d->components[0].h_sample;
+    int vmax = d->components[0].v_sample;
+    if (hmax < 1 || hmax > MAX_SAMPLING || vmax < 1 || vmax > MAX_SAMPLING) return -1;
+    if (d->num_components == 1) {
+        // Non-interleaved scan: one block per MCU regardless of the factors
+        hmax = vmax = 1;
+        d->components[0].h_sample = d->components[0].v_sample = 1;
+    } else {
+        for (int c = 1; c < 3; c++) {
+            if (d->components[c].h_sample != 1 || d->components[c].v_sample != 1) return -1;
         }
     }
 
-    d->pos += 3;  // Skip Ss, Se, Ah/Al
+    d->hmax = (uint8_t)hmax;
+    d->vmax = (uint8_t)vmax;
+    d->mcus_x = (d->width + 8 * hmax - 1) / (8 * hmax);
+    d->mcus_y = (d->height + 8 * vmax - 1) / (8 * vmax);
+
+    for (int i = 0; i < d->num_components; i++) {
+        int h = d->components[i].h_sample;
+        int v = d->components[i].v_sample;
+        d->components[i].blocks_w = ((d->width * h + hmax - 1) / hmax + 7) / 8;
+        d->components[i].blocks_h = ((d->height * v + vmax - 1) / vmax + 7) / 8;
+        d->components[i].stride = d->mcus_x * h;
+    }
 
-    // Reset bit reading state
-    d->bit_buffer = 0;
-    d->bits_left = 0;
+    // Allocate output image
+    jpg_image_t *img = (jpg_image_t *)kmalloc(sizeof(jpg_image_t));
+    if (!img) return -1;
+
+    img->width = d->width;
+    img->height = d->height;
+    img->pixels = (uint32_t *)kmalloc(img->width * img->height * sizeof(uint32_t));
+    if (!img->pixels) {
+        kfree(img);
+        return -1;
+    }
+    d->img = img;
+    return 0;
+}
 
-    // Reset DC prediction
+// Coefficient buffers for images coded in more than one scan
+static int alloc_coefficients(jpeg_decoder_t *d) {
+    for (int i = 0; i < d->num_components; i++) {
+        size_t blocks = (size_t)d->components[i].stride * d->mcus_y * d->components[i].v_sample;
+        d->components[i].coefs = (int16_t *)kcalloc(blocks * 64, sizeof(int16_t));
+        if (!d->components[i].coefs) return -1;
+    }
+    d->buffered = 1;
+    return 0;
+}
+
+static void free_coefficients(jpeg_decoder_t *d) {
     for (int i = 0; i < MAX_COMPONENTS; i++) {
-        d->dc_pred[i] = 0;
+        if (d->components[i].coefs) kfree(d->components[i].coefs);
+        d->components[i].coefs = 0;
+    }
+}
+
+static int parse_huffman_tables(jpeg_decoder_t *d, const uint8_t *segment, uint16_t length) {
+    size_t offset = 0;
+    while (offset + 17 <= length) {
+        uint8_t info = segment[offset++];
+        int table_class = (info >> 4) & 1;  // 0 = DC, 1 = AC
+        int table_id = info & 0x0F;
+
+        if (table_id >= MAX_HUFFMAN_TABLES) return -1;
+
+        huffman_table_t *table = table_class ? &d->huff_ac[table_id] : &d->huff_dc[table_id];
+
+        int num_codes = 0;
+        for (int i = 0; i < 16; i++) {
+            table->bits[i] = segment[offset++];
+            num_codes += table->bits[i];
+        }
+
+        if (num_codes > 256 || offset + num_codes > length) return -1;
+        for (int i = 0; i < num_codes; i++) {
+            table->values[i] = segment[offset++];
+        }
+
+        if (build_huffman_table(table) != 0) return -1;
     }
+    return 0;
+}
+
+static int parse_quant_tables(jpeg_decoder_t *d, const uint8_t *segment, uint16_t length) {
+    size_t offset = 0;
+    while (offset + 65 <= length) {
+        uint8_t info = segment[offset++];
+        int precision = (info >> 4) & 0x0F;
+        int table_id = info & 0x0F;
+
+        if (table_id > 3) return -1;
+        if (precision != 0) return -1;  // Only 8-bit precision
 
+        for (int i = 0; i < 64; i++) {
+            d->quant[table_id][i] = segment[offset++];
+        }
+    }
     return 0;
 }
 
-// Load JPEG from memory
-jpg_image_t *jpg_load(const uint8_t *data, size_t size) {
-    if (!data || size < 4) return 0;
+// Parse an SOS header
+static int parse_scan_header(jpeg_decoder_t *d, const uint8_t *segment, uint16_t length,
+                             jpeg_scan_t *scan) {
+    if (length < 1) return -1;
+    int n = segment[0];
+    if (n < 1 || n > d->num_components || length < 4 + 2 * n) return -1;
+
+    scan->num_components = (uint8_t)n;
+    for (int i = 0; i < n; i++) {
+        uint8_t comp_id = segment[1 + i * 2];
+        uint8_t table_sel = segment[2 + i * 2];
+
+        int j = 0;
+        while (j < d->num_components && d->components[j].id != comp_id) j++;
+        if (j == d->num_components) return -1;
+
+        d->components[j].dc_table = (table_sel >> 4) & 0x0F;
+        d->components[j].ac_table = table_sel & 0x0F;
+        if (d->components[j].dc_table >= MAX_HUFFMAN_TABLES ||
+            d->components[j].ac_table >= MAX_HUFFMAN_TABLES) return -1;
+        scan->comp[i] = (uint8_t)j;
+    }
 
-    jpeg_decoder_t decoder;
-    memset(&decoder, 0, sizeof(decoder));
-    decoder.data = data;
-    decoder.size = size;
+    scan->ss = segment[1 + n * 2];
+    scan->se = segment[2 + n * 2];
+    scan->ah = segment[3 + n * 2] >> 4;
+    scan->al = segment[3 + n * 2] & 0x0F;
+
+    if (d->progressive) {
+        // DC and AC bands are never mixed, and AC scans hold one component
+        if (scan->ss == 0 ? scan->se != 0 : (scan->se < scan->ss || scan->se > 63 || n != 1))
+            return -1;
+        if (scan->al > 13) return -1;
+    } else {
+        scan->ss = 0;
+        scan->se = 63;
+        scan->ah = scan->al = 0;
+    }
 
-    // Parse headers
-    if (parse_headers(&decoder) != 0) return 0;
-    if (decoder.width == 0 || decoder.height == 0) return 0;
+    // Every table the scan decodes with must be defined
+    for (int i = 0; i < n; i++) {
+        int c = scan->comp[i];
+        if (scan->ss == 0 && scan->ah == 0 && !d->huff_dc[d->components[c].dc_table].present)
+            return -1;
+        if (scan->se > 0 && !d->huff_ac[d->components[c].ac_table].present) return -1;
+    }
 
-    // Only support YCbCr (3 components) for now
-    if (decoder.num_components != 3) return 0;
+    if (n == 1) {
+        scan->mcus_x = d->components[scan->comp[0]].blocks_w;
+        scan->mcu_count = scan->mcus_x * d->components[scan->comp[0]].blocks_h;
+    } else {
+        scan->mcus_x = d->mcus_x;
+        scan->mcu_count = d->mcus_x * d->mcus_y;
+    }
+    return 0;
+}
 
-    // Parse SOS and prepare for decoding
-    if (decode_scan(&decoder) != 0) return 0;
+// Decode the scan whose header was just read; d->pos ends at the marker
+// that follows its entropy-coded data
+static int decode_scan(jpeg_decoder_t *d, const uint8_t *header, uint16_t length) {
+    jpeg_scan_t scan;
 
-    // Allocate output image
-    jpg_image_t *img = (jpg_image_t *)kmalloc(sizeof(jpg_image_t));
-    if (!img) return 0;
+    if (!d->img) return -1;
+    if (parse_scan_header(d, header, length, &scan) != 0) return -1;
 
-    img->width = decoder.width;
-    img->height = decoder.height;
-    img->pixels = (uint32_t *)kmalloc(img->width * img->height * sizeof(uint32_t));
-    if (!img->pixels) {
-        kfree(img);
-        return 0;
+    // A sequential image whose first scan holds every component decodes
+    // straight to pixels; anything else builds up coefficients
+    if (d->scan_count == 0 && (d->progressive || scan.num_components != d->num_components)) {
+        if (alloc_coefficients(d) != 0) return -1;
     }
+    if (!d->buffered) {
+        if (d->scan_count > 0) return -1;
+        scale_quant_tables(d);
+    }
+
+    uint32_t interval = d->restart_interval ? d->restart_interval : scan.mcu_count;
+    uint32_t max_segs = (scan.mcu_count + interval - 1) / interval;
+    jpeg_segment_t *segs = (jpeg_segment_t *)kmalloc(max_segs * sizeof(jpeg_segment_t));
+    if (!segs) return -1;
+
+    size_t end;
+    uint32_t count = index_scan(d, &scan, interval, segs, max_segs, &end);
+
+    // Segments are independent; here they simply run in order
+    int result = 0;
+    for (uint32_t i = 0; i < count && result == 0; i++) {
+        result = decode_segment(d, &scan, &segs[i]);
+    }
+
+    kfree(segs);
+    d->pos = end;
+    d->scan_count++;
+    return result;
+}
 
-    // Decode MCUs (Minimum Coded Units)
-    // For simplicity, assume 1x1 sampling (no subsampling)
-    int mcu_width = 8;
-    int mcu_height = 8;
-    int mcus_x = (img->width + mcu_width - 1) / mcu_width;
-    int mcus_y = (img->height + mcu_height - 1) / mcu_height;
-
-    int16_t blocks[3][64];  // Y, Cb, Cr blocks
-
-    decoder.restart_count = decoder.restart_interval;
-
-    for (int mcu_y = 0; mcu_y < mcus_y; mcu_y++) {
-        for (int mcu_x = 0; mcu_x < mcus_x; mcu_x++) {
-            // Check for restart marker
-            if (decoder.restart_interval > 0 && decoder.restart_count == 0) {
-                // Find restart marker and reset
-                decoder.bits_left = 0;
-                while (decoder.pos + 1 < decoder.size) {
-                    if (decoder.data[decoder.pos] == 0xFF) {
-                        uint8_t m = decoder.data[decoder.pos + 1];
-                        if (m >= 0xD0 && m <= 0xD7) {
-                            decoder.pos += 2;
-                            break;
+// Dequantize, IDCT and convert the accumulated coefficients
+static void output_coefficients(jpeg_decoder_t *d) {
+    int32_t block[64];
+    uint8_t planes[MAX_COMPONENTS][64 * MAX_SAMPLING * MAX_SAMPLING];
+    uint32_t mcu_w = 8 * d->hmax;
+    uint32_t mcu_h = 8 * d->vmax;
+
+    scale_quant_tables(d);
+
+    for (uint32_t my = 0; my < d->mcus_y; my++) {
+        for (uint32_t mx = 0; mx < d->mcus_x; mx++) {
+            for (int c = 0; c < d->num_components; c++) {
+                int h = d->components[c].h_sample;
+                int v = d->components[c].v_sample;
+                const int32_t *q = d->quant_scaled[d->components[c].qt_id];
+
+                for (int by = 0; by < v; by++) {
+                    for (int bx = 0; bx < h; bx++) {
+                        const int16_t *coef = d->components[c].coefs +
+                                              ((size_t)(my * v + by) * d->components[c].stride +
+                                               mx * h + bx) * 64;
+                        for (int i = 0; i < 64; i++) {
+                            block[i] = DEQUANT((int32_t)coef[i], q[i]);
                         }
+                        idct_block(block, planes[c] + by * 8 * (8 * h) + bx * 8, 8 * h);
                     }
-                    decoder.pos++;
-                }
-                for (int i = 0; i < MAX_COMPONENTS; i++) {
-                    decoder.dc_pred[i] = 0;
                 }
-                decoder.restart_count = decoder.restart_interval;
             }
+            color_convert_mcu(d, planes, d->img, mx * mcu_w, my * mcu_h, mcu_w, mcu_h);
+        }
+    }
+}
 
-            // Decode blocks for each component
-            for (int comp = 0; comp < decoder.num_components; comp++) {
-                if (decode_block(&decoder, blocks[comp], comp) != 0) {
-                    kfree(img->pixels);
-                    kfree(img);
-                    return 0;
-                }
-            }
+// Load JPEG from memory
+jpg_image_t *jpg_load(const uint8_t *data, size_t size) {
+    if (!data || size < 4) return 0;
+    if (data[0] != 0xFF || data[1] != MARKER_SOI) return 0;
 
-            if (decoder.restart_interval > 0) {
-                decoder.restart_count--;
-            }
+    // Too large for the stack with four tables of each class
+    jpeg_decoder_t *d = (jpeg_decoder_t *)kcalloc(1, sizeof(jpeg_decoder_t));
+    if (!d) return 0;
+    d->data = data;
+    d->size = size;
+    d->pos = 2;
+
+    if (!color_tables_built) build_color_tables();
+
+    int error = 0;
+    while (!error && d->pos + 2 <= d->size) {
+        if (d->data[d->pos] != 0xFF) {
+            d->pos++;
+            continue;
+        }
+
+        uint8_t marker = d->data[d->pos + 1];
+        if (marker == 0xFF) {
+            d->pos++;  // Fill byte
+            continue;
+        }
+        d->pos += 2;
 
-            // Convert YCbCr to RGB and write to image
-            for (int by = 0; by < 8; by++) {
-                int py = mcu_y * 8 + by;
-                if (py >= (int)img->height) continue;
-
-                for (int bx = 0; bx < 8; bx++) {
-                    int px = mcu_x * 8 + bx;
-                    if (px >= (int)img->width) continue;
-
-                    int idx = by * 8 + bx;
-                    int y = blocks[0][idx];
-                    int cb = blocks[1][idx] - 128;
-                    int cr = blocks[2][idx] - 128;
-
-                    // YCbCr to RGB conversion (integer approximation)
-                    int r = y + ((cr * 359) >> 8);
-                    int g = y - ((cb * 88 + cr * 183) >> 8);
-                    int b = y + ((cb * 454) >> 8);
-
-                    // Clamp
-                    if (r < 0) r = 0;
-                    if (r > 255) r = 255;
-                    if (g < 0) g = 0;
-                    if (g > 255) g = 255;
-                    if (b < 0) b = 0;
-                    if (b > 255) b = 255;
-
-                    img->pixels[py * img->width + px] = (0xFF << 24) | (r << 16) | (g << 8) | b;
+        if (marker == MARKER_EOI) break;
+        if (marker == 0x00 || (marker >= MARKER_RST0 && marker <= MARKER_RST7)) continue;
+
+        // Get segment length
+        if (d->pos + 2 > d->size) break;
+        uint16_t length = read_be16(d->data + d->pos);
+        if (length < 2 || d->pos + length > d->size) {
+            error = 1;
+            break;
+        }
+        const uint8_t *segment = d->data + d->pos + 2;
+        d->pos += length;
+        length -= 2;
+
+        switch (marker) {
+            case MARKER_SOF0:
+            case MARKER_SOF1:
+            case MARKER_SOF2:
+                error = parse_frame(d, segment, length, marker == MARKER_SOF2) != 0;
+                break;
+
+            case MARKER_DHT:
+                error = parse_huffman_tables(d, segment, length) != 0;
+                break;
+
+            case MARKER_DQT:
+                error = parse_quant_tables(d, segment, length) != 0;
+                break;
+
+            case MARKER_DRI:
+                if (length >= 2) d->restart_interval = read_be16(segment);
+                break;
+
+            case MARKER_SOS:
+                error = decode_scan(d, segment, length) != 0;
+                break;
+
+            default:
+                // Lossless, hierarchical and arithmetic-coded frames
+                if (marker >= 0xC3 && marker <= 0xCF && marker != MARKER_JPG &&
+                    marker != MARKER_DAC) {
+                    error = 1;
                 }
-            }
+                break;
         }
     }
 
+    jpg_image_t *img = d->img;
+    if (!error && img && d->scan_count > 0) {
+        if (d->buffered) output_coefficients(d);
+    } else if (img) {
+        jpg_free(img);
+        img = 0;
+    }
+
+    free_coefficients(d);
+    kfree(d);
     return img;
 }
 
@@ -571,3 +1074,27 @@ void jpg_free(jpg_image_t *img) {
         kfree(img);
     }
 }
+
+int jpg_benchmark(const uint8_t *data, size_t size, uint32_t iterations,
+                  jpg_bench_result_t *result) {
+    if (iterations == 0) iterations = 1;
+
+    uint64_t start = timing_rdtsc();
+    jpg_image_t *img = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        img = jpg_load(data, size);
+        if (!img) return -1;
+        if (i + 1 < iterations) jpg_free(img);
+    }
+    uint64_t us = timing_cycles_to_us(timing_rdtsc() - start);
+
+    uint64_t pixels = (uint64_t)img->width * img->height;
+    result->width = img->width;
+    result->height = img->height;
+    result->iterations = iterations;
+    result->us_per_image = (uint32_t)(us / iterations);
+    result->us_per_mpixel = (uint32_t)(us * 1000000 / (pixels * iterations));
+
+    jpg_free(img);
+    return 0;
+}
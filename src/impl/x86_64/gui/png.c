@@ -3,6 +3,7 @@
 #include "memory/heap.h"
 #include "utils/memory.h"
 #include "fs/vfs.h"
+#include "utils/timing.h"
 
 // PNG file signature
 static const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
@@ -33,436 +34,825 @@ static uint32_t read_be32(const uint8_t *p) {
            ((uint32_t)p[2] << 8) | p[3];
 }
 
-// DEFLATE decompression state
+// Unaligned 8-byte access (x86 handles misaligned loads/stores in hardware)
+typedef uint64_t __attribute__((may_alias, aligned(1))) png_word_t;
+
+// File data is pulled through this many bytes at a time
+#define PNG_READ_BLOCK 4096
+
+// LZ77 history DEFLATE may refer back into
+#define INFLATE_WINDOW 32768
+
+// Longest match plus the overrun of the 8-byte match copy
+#define INFLATE_MATCH_SLACK (258 + 8)
+
+// Largest decoded ARGB image accepted; IHDR sizes are untrusted and the
+// buffer math below must not wrap
+#define PNG_MAX_PIXEL_BYTES (256u * 1024 * 1024)
+
+// Byte source: either a whole file in memory or a VFS file read in blocks
+typedef struct {
+    const uint8_t *data;    // Current run of bytes
+    size_t size;
+    size_t pos;
+    vfs_node_t *file;       // 0 for an in-memory source
+    uint32_t file_pos;
+    uint8_t *block;
+} png_source_t;
+
+// Decoder state. Decompressed bytes go to a sliding window; each complete
+// scanline is unfiltered and converted straight into the output pixels.
+typedef struct {
+    png_source_t src;
+    uint32_t idat_remaining;    // Bytes left in the current IDAT chunk
+
+    png_image_t *img;
+    const png_callbacks_t *cb;
+    int bytes_per_pixel;
+    size_t row_bytes;           // Unfiltered bytes per row
+    uint32_t y;                 // Next row to emit
+
+    uint8_t *window;
+    size_t window_size;
+    size_t window_pos;          // Bytes in the window
+    size_t row_start;           // Start of the first row not yet emitted
+    size_t slide_at;            // Window fill level that triggers a slide
+    size_t checkpoint;          // Next window_pos needing attention
+    uint8_t *prev_row;          // Previous unfiltered row (zeros for row 0)
+    uint8_t *cur_row;
+} png_decoder_t;
+
+// DEFLATE decompression state. Bits are consumed LSB first from a 64-bit
+// buffer that is refilled a whole word at a time from the current run of
+// IDAT bytes; runs are fetched from the decoder as they are used up.
 typedef struct {
     const uint8_t *data;
     size_t size;
     size_t pos;
-    uint32_t bit_buffer;
+    uint64_t bit_buffer;
     int bits_in_buffer;
+    png_decoder_t *dec;
 } inflate_state_t;
 
-// Get a single bit
-static int get_bit(inflate_state_t *s) {
-    if (s->bits_in_buffer == 0) {
-        if (s->pos >= s->size) return -1;
-        s->bit_buffer = s->data[s->pos++];
-        s->bits_in_buffer = 8;
-    }
-    int bit = s->bit_buffer & 1;
-    s->bit_buffer >>= 1;
-    s->bits_in_buffer--;
-    return bit;
+static size_t idat_next(png_decoder_t *dec, const uint8_t **data);
+
+// Top up the bit buffer to at least 56 bits (fewer only at end of input)
+static inline void refill(inflate_state_t *s) {
+    if (s->pos + 8 <= s->size) {
+        s->bit_buffer |= *(const png_word_t *)(s->data + s->pos) << s->bits_in_buffer;
+        s->pos += (63 - s->bits_in_buffer) >> 3;
+        s->bits_in_buffer |= 56;
+        return;
+    }
+
+    while (s->bits_in_buffer <= 56) {
+        if (s->pos >= s->size) {
+            s->size = idat_next(s->dec, &s->data);
+            s->pos = 0;
+            if (s->size == 0) return;
+        }
+        s->bit_buffer |= (uint64_t)s->data[s->pos++] << s->bits_in_buffer;
+        s->bits_in_buffer += 8;
+    }
 }
 
-// Get n bits (LSB first)
-static int get_bits(inflate_state_t *s, int n) {
-    int value = 0;
-    for (int i = 0; i < n; i++) {
-        int bit = get_bit(s);
-        if (bit < 0) return -1;
-        value |= (bit << i);
+// Get n bits (LSB first), n <= 32
+static inline int get_bits(inflate_state_t *s, int n) {
+    if (s->bits_in_buffer < n) {
+        refill(s);
+        if (s->bits_in_buffer < n) return -1;
     }
+    int value = (int)(s->bit_buffer & ((1ull << n) - 1));
+    s->bit_buffer >>= n;
+    s->bits_in_buffer -= n;
     return value;
 }
 
-// Align to byte boundary
+// Align to byte boundary (whole bytes stay buffered)
 static void align_byte(inflate_state_t *s) {
-    s->bits_in_buffer = 0;
-    s->bit_buffer = 0;
+    int drop = s->bits_in_buffer & 7;
+    s->bit_buffer >>= drop;
+    s->bits_in_buffer -= drop;
+}
+
+// Copy stored-block bytes: first what is buffered, then straight from input
+static int read_stored(inflate_state_t *s, uint8_t *dst, size_t len) {
+    while (len > 0 && s->bits_in_buffer >= 8) {
+        *dst++ = (uint8_t)s->bit_buffer;
+        s->bit_buffer >>= 8;
+        s->bits_in_buffer -= 8;
+        len--;
+    }
+    // A word-wide refill leaves bits of input past `pos` above the counted
+    // ones; once the copy skips ahead of them they must not reach the next
+    // refill
+    if (s->bits_in_buffer == 0) s->bit_buffer = 0;
+    while (len > 0) {
+        if (s->pos >= s->size) {
+            s->size = idat_next(s->dec, &s->data);
+            s->pos = 0;
+            if (s->size == 0) return -1;
+        }
+        size_t n = s->size - s->pos;
+        if (n > len) n = len;
+        memcpy(dst, s->data + s->pos, n);
+        s->pos += n;
+        dst += n;
+        len -= n;
+    }
+    return 0;
 }
 
+// Huffman decoding tables. Codes up to `fast_bits` long resolve with one
+// lookup of the next input bits; longer codes fall back to a canonical
+// walk using the per-length counts.
+#define HUFF_MAX_BITS 15
+#define HUFF_LIT_FAST_BITS 10
+#define HUFF_DIST_FAST_BITS 9
+#define HUFF_MAX_SYMBOLS 288
+
+typedef struct {
+    uint16_t fast[1 << HUFF_LIT_FAST_BITS]; // (symbol << 4) | length, 0 = long code
+    uint16_t count[HUFF_MAX_BITS + 1];      // Codes of each length
+    uint16_t symbol[HUFF_MAX_SYMBOLS];      // Symbols ordered by code
+    int fast_bits;
+} huffman_t;
+
+static uint32_t reverse_bits(uint32_t code, int len) {
+    uint32_t r = 0;
+    for (int i = 0; i < len; i++) {
+        r = (r << 1) | (code & 1);
+        code >>= 1;
+    }
+    return r;
+}
+
+// Build tables from code lengths; incomplete codes are allowed (RFC 1951
+// permits a lone distance code), over-subscribed ones are rejected
+static int huffman_build(huffman_t *h, const uint8_t *lengths, int n, int fast_bits) {
+    uint16_t offsets[HUFF_MAX_BITS + 2];
+    uint32_t next_code[HUFF_MAX_BITS + 1];
+
+    h->fast_bits = fast_bits;
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(uint16_t) << fast_bits);
+
+    for (int i = 0; i < n; i++) {
+        h->count[lengths[i]]++;
+    }
+    h->count[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len <= HUFF_MAX_BITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return -1;
+    }
+
+    offsets[1] = 0;
+    uint32_t code = 0;
+    for (int len = 1; len <= HUFF_MAX_BITS; len++) {
+        offsets[len + 1] = offsets[len] + h->count[len];
+        next_code[len] = code;
+        code = (code + h->count[len]) << 1;
+    }
+
+    for (int sym = 0; sym < n; sym++) {
+        int len = lengths[sym];
+        if (len == 0) continue;
+        h->symbol[offsets[len]++] = (uint16_t)sym;
+
+        uint32_t c = next_code[len]++;
+        if (len <= fast_bits) {
+            // Fill every slot whose low `len` bits are this (reversed) code
+            uint16_t entry = (uint16_t)((sym << 4) | len);
+            for (uint32_t slot = reverse_bits(c, len); slot < (1u << fast_bits); slot += 1u << len) {
+                h->fast[slot] = entry;
+            }
+        }
+    }
+    return 0;
+}
+
+// Canonical decode of a code longer than the table covers
+static int huffman_decode_slow(inflate_state_t *s, const huffman_t *h) {
+    int code = 0, first = 0, index = 0;
+    uint64_t bits = s->bit_buffer;
+    for (int len = 1; len <= HUFF_MAX_BITS && len <= s->bits_in_buffer; len++) {
+        code |= (int)(bits & 1);
+        bits >>= 1;
+        int count = h->count[len];
+        if (code - first < count) {
+            s->bit_buffer >>= len;
+            s->bits_in_buffer -= len;
+            return h->symbol[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static inline int huffman_decode(inflate_state_t *s, const huffman_t *h) {
+    if (s->bits_in_buffer < HUFF_MAX_BITS) refill(s);
+
+    uint32_t entry = h->fast[s->bit_buffer & ((1u << h->fast_bits) - 1)];
+    if (entry) {
+        int len = entry & 15;
+        if (len > s->bits_in_buffer) return -1;
+        s->bit_buffer >>= len;
+        s->bits_in_buffer -= len;
+        return entry >> 4;
+    }
+    return huffman_decode_slow(s, h);
+}
 
 // Length base values
-static const int length_base[29] = {
+static const uint16_t length_base[29] = {
     3, 4, 5, 6, 7, 8, 9, 10, 11, 13,
     15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
     67, 83, 99, 115, 131, 163, 195, 227, 258
 };
 
 // Length extra bits
-static const int length_extra[29] = {
+static const uint8_t length_extra[29] = {
     0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
     1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
     4, 4, 4, 4, 5, 5, 5, 5, 0
 };
 
 // Distance base values
-static const int dist_base[30] = {
+static const uint16_t dist_base[30] = {
     1, 2, 3, 4, 5, 7, 9, 13, 17, 25,
     33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
     1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
 };
 
 // Distance extra bits
-static const int dist_extra[30] = {
+static const uint8_t dist_extra[30] = {
     0, 0, 0, 0, 1, 1, 2, 2, 3, 3,
     4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
     9, 9, 10, 10, 11, 11, 12, 12, 13, 13
 };
 
-// Decode fixed Huffman literal/length
-static int decode_fixed_lit(inflate_state_t *s) {
-    // Read 7 bits first
-    int code = 0;
-    for (int i = 0; i < 7; i++) {
-        int bit = get_bit(s);
-        if (bit < 0) return -1;
-        code = (code << 1) | bit;
+// Order in which code length code lengths are stored (RFC 1951 3.2.7)
+static const uint8_t codelen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Fixed Huffman tables, built on first use
+static huffman_t fixed_lit;
+static huffman_t fixed_dist;
+static int fixed_built = 0;
+
+static void build_fixed_tables(void) {
+    uint8_t lengths[HUFF_MAX_SYMBOLS];
+    int i = 0;
+    for (; i < 144; i++) lengths[i] = 8;
+    for (; i < 256; i++) lengths[i] = 9;
+    for (; i < 280; i++) lengths[i] = 7;
+    for (; i < 288; i++) lengths[i] = 8;
+    huffman_build(&fixed_lit, lengths, 288, HUFF_LIT_FAST_BITS);
+
+    for (i = 0; i < 30; i++) lengths[i] = 5;
+    huffman_build(&fixed_dist, lengths, 30, HUFF_DIST_FAST_BITS);
+    fixed_built = 1;
+}
+
+// Read the code length tables of a dynamic block (RFC 1951 3.2.7)
+static int read_dynamic_tables(inflate_state_t *s, huffman_t *lit, huffman_t *dist) {
+    uint8_t lengths[HUFF_MAX_SYMBOLS + 32];
+
+    int hlit = get_bits(s, 5);
+    int hdist = get_bits(s, 5);
+    int hclen = get_bits(s, 4);
+    if (hlit < 0 || hdist < 0 || hclen < 0) return -1;
+    hlit += 257;
+    hdist += 1;
+    hclen += 4;
+    if (hlit > 286 || hdist > 30) return -1;
+
+    // Code length code, reusing the distance table as scratch
+    memset(lengths, 0, 19);
+    for (int i = 0; i < hclen; i++) {
+        int len = get_bits(s, 3);
+        if (len < 0) return -1;
+        lengths[codelen_order[i]] = (uint8_t)len;
     }
+    if (huffman_build(dist, lengths, 19, 7) != 0) return -1;
+
+    // Literal/length and distance code lengths form one sequence
+    int total = hlit + hdist;
+    int i = 0;
+    while (i < total) {
+        int sym = huffman_decode(s, dist);
+        if (sym < 0) return -1;
+
+        if (sym < 16) {
+            lengths[i++] = (uint8_t)sym;
+            continue;
+        }
 
-    // 256-279: 7-bit codes (0000000-0010111 reversed = 256-279)
-    if (code >= 0 && code <= 23) {
-        return code + 256;
+        int repeat;
+        uint8_t value = 0;
+        if (sym == 16) {
+            if (i == 0) return -1;
+            value = lengths[i - 1];
+            repeat = get_bits(s, 2) + 3;
+        } else if (sym == 17) {
+            repeat = get_bits(s, 3) + 3;
+        } else {
+            repeat = get_bits(s, 7) + 11;
+        }
+        if (repeat < 3 || i + repeat > total) return -1;
+        while (repeat--) lengths[i++] = value;
     }
 
-    // Need 8th bit
-    int bit = get_bit(s);
-    if (bit < 0) return -1;
-    code = (code << 1) | bit;
+    // End-of-block must be codable
+    if (lengths[256] == 0) return -1;
 
-    // 0-143: 8-bit codes (00110000-10111111 reversed)
-    if (code >= 48 && code <= 191) {
-        return code - 48;
+    if (huffman_build(lit, lengths, hlit, HUFF_LIT_FAST_BITS) != 0) return -1;
+    if (huffman_build(dist, lengths + hlit, hdist, HUFF_DIST_FAST_BITS) != 0) return -1;
+    return 0;
+}
+
+// Copy a match that may overlap its own output
+static inline void copy_match(uint8_t *out, size_t distance, size_t length, size_t room) {
+    const uint8_t *from = out - distance;
+
+    if (distance >= 8 && length + 8 <= room) {
+        // Each 8-byte load is complete before the store that could touch it;
+        // the last store may run up to 7 bytes past the match
+        for (size_t i = 0; i < length; i += 8) {
+            *(png_word_t *)(out + i) = *(const png_word_t *)(from + i);
+        }
+    } else if (distance == 1) {
+        memset(out, from[0], length);
+    } else {
+        for (size_t i = 0; i < length; i++) {
+            out[i] = from[i];
+        }
     }
-    // 280-287: 8-bit codes (11000000-11000111 reversed)
-    if (code >= 192 && code <= 199) {
-        return code - 192 + 280;
+}
+
+// Paeth predictor
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = a + b - c;
+    int pa = p > a ? p - a : a - p;
+    int pb = p > b ? p - b : b - p;
+    int pc = p > c ? p - c : c - p;
+
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// Undo one row's filter; `raw` starts with the filter byte and stays
+// untouched because it is still LZ77 history
+static int unfilter_row(uint8_t *out, const uint8_t *raw, const uint8_t *prev,
+                        uint32_t row_bytes, uint32_t bpp) {
+    uint8_t filter = raw[0];
+    raw++;
+
+    switch (filter) {
+        case FILTER_NONE:
+            memcpy(out, raw, row_bytes);
+            break;
+
+        case FILTER_SUB:
+            for (uint32_t x = 0; x < row_bytes; x++) {
+                out[x] = raw[x] + (x >= bpp ? out[x - bpp] : 0);
+            }
+            break;
+
+        case FILTER_UP:
+            for (uint32_t x = 0; x < row_bytes; x++) {
+                out[x] = raw[x] + prev[x];
+            }
+            break;
+
+        case FILTER_AVERAGE:
+            for (uint32_t x = 0; x < row_bytes; x++) {
+                uint8_t left = x >= bpp ? out[x - bpp] : 0;
+                out[x] = raw[x] + (uint8_t)((left + prev[x]) / 2);
+            }
+            break;
+
+        case FILTER_PAETH:
+            for (uint32_t x = 0; x < row_bytes; x++) {
+                uint8_t left = x >= bpp ? out[x - bpp] : 0;
+                uint8_t up_left = x >= bpp ? prev[x - bpp] : 0;
+                out[x] = raw[x] + paeth(left, prev[x], up_left);
+            }
+            break;
+
+        default:
+            return -1;  // Unknown filter
     }
+    return 0;
+}
+
+// Emit every complete row in the window and slide it when it fills up.
+// Returns 1 once the last row is out, -1 on a bad filter.
+static int emit_rows(png_decoder_t *dec) {
+    size_t row_len = dec->row_bytes + 1;
+    png_image_t *img = dec->img;
+
+    while (dec->window_pos - dec->row_start >= row_len) {
+        if (unfilter_row(dec->cur_row, dec->window + dec->row_start, dec->prev_row,
+                         dec->row_bytes, dec->bytes_per_pixel) != 0) {
+            return -1;
+        }
+        dec->row_start += row_len;
+
+        // Convert to ARGB
+        const uint8_t *row = dec->cur_row;
+        uint32_t *dst = img->pixels + (size_t)dec->y * img->width;
+        if (dec->bytes_per_pixel == 4) {
+            for (uint32_t x = 0; x < img->width; x++, row += 4) {
+                dst[x] = ((uint32_t)row[3] << 24) | ((uint32_t)row[0] << 16) |
+                         ((uint32_t)row[1] << 8) | row[2];
+            }
+        } else {
+            for (uint32_t x = 0; x < img->width; x++, row += 3) {
+                dst[x] = 0xFF000000 | ((uint32_t)row[0] << 16) |
+                         ((uint32_t)row[1] << 8) | row[2];
+            }
+        }
 
-    // Need 9th bit for 144-255
-    bit = get_bit(s);
-    if (bit < 0) return -1;
-    code = (code << 1) | bit;
+        uint8_t *tmp = dec->prev_row;
+        dec->prev_row = dec->cur_row;
+        dec->cur_row = tmp;
 
-    // 144-255: 9-bit codes (110010000-111111111 reversed)
-    if (code >= 400 && code <= 511) {
-        return code - 400 + 144;
+        if (dec->cb && dec->cb->on_row) {
+            dec->cb->on_row(dec->cb->ctx, img, dec->y);
+        }
+        if (++dec->y == img->height) return 1;
     }
 
-    return -1;
+    // Keep the last 32 KiB (and any partial row), drop the rest
+    if (dec->window_pos >= dec->slide_at) {
+        size_t keep_from = dec->window_pos - INFLATE_WINDOW;
+        if (keep_from > dec->row_start) keep_from = dec->row_start;
+        memmove(dec->window, dec->window + keep_from, dec->window_pos - keep_from);
+        dec->window_pos -= keep_from;
+        dec->row_start -= keep_from;
+    }
+
+    dec->checkpoint = dec->row_start + row_len;
+    if (dec->checkpoint > dec->slide_at) dec->checkpoint = dec->slide_at;
+    return 0;
 }
 
-// Decode fixed Huffman distance (5 bits, no actual huffman)
-static int decode_fixed_dist(inflate_state_t *s) {
-    int code = 0;
-    for (int i = 0; i < 5; i++) {
-        int bit = get_bit(s);
-        if (bit < 0) return -1;
-        code = (code << 1) | bit;
+// Decode one Huffman-coded block. Returns 1 once the image is complete.
+static int inflate_block(inflate_state_t *s, const huffman_t *lit, const huffman_t *dist) {
+    png_decoder_t *dec = s->dec;
+    uint8_t *window = dec->window;
+    size_t pos = dec->window_pos;
+
+    while (1) {
+        if (pos >= dec->checkpoint) {
+            dec->window_pos = pos;
+            int r = emit_rows(dec);
+            if (r != 0) return r;
+            pos = dec->window_pos;
+        }
+
+        int sym = huffman_decode(s, lit);
+        if (sym < 0) return -1;
+
+        if (sym < 256) {
+            // Literal byte
+            window[pos++] = (uint8_t)sym;
+            continue;
+        }
+        if (sym == 256) {
+            // End of block
+            break;
+        }
+
+        // Length/distance pair
+        int len_idx = sym - 257;
+        if (len_idx >= 29) return -1;
+
+        int length = length_base[len_idx];
+        if (length_extra[len_idx] > 0) {
+            int extra = get_bits(s, length_extra[len_idx]);
+            if (extra < 0) return -1;
+            length += extra;
+        }
+
+        int dist_code = huffman_decode(s, dist);
+        if (dist_code < 0 || dist_code >= 30) return -1;
+
+        size_t distance = dist_base[dist_code];
+        if (dist_extra[dist_code] > 0) {
+            int extra = get_bits(s, dist_extra[dist_code]);
+            if (extra < 0) return -1;
+            distance += extra;
+        }
+
+        // Copy from back buffer; the slide keeps room for a whole match
+        if (distance > pos) return -1;
+        copy_match(window + pos, distance, length, dec->window_size - pos);
+        pos += length;
     }
-    return code;
+
+    dec->window_pos = pos;
+    return 0;
 }
 
-// Simple DEFLATE inflate for fixed and uncompressed blocks
-static int inflate_data(const uint8_t *src, size_t src_size,
-                        uint8_t *dst, size_t dst_size, size_t *out_size) {
+// Inflate the zlib stream spread over the IDAT chunks, emitting rows as
+// they complete. Returns 0 when all rows are out or the stream ends.
+static int inflate_stream(png_decoder_t *dec) {
     inflate_state_t state = {
-        .data = src,
-        .size = src_size,
+        .data = 0,
+        .size = 0,
         .pos = 0,
         .bit_buffer = 0,
-        .bits_in_buffer = 0
+        .bits_in_buffer = 0,
+        .dec = dec
     };
 
     // Skip zlib header (2 bytes)
-    if (src_size < 2) return -1;
-    state.pos = 2;
+    if (get_bits(&state, 16) < 0) return -1;
+
+    if (!fixed_built) build_fixed_tables();
+
+    // Dynamic tables are too big for the kernel stack
+    huffman_t *dyn = 0;
 
-    size_t out_pos = 0;
     int bfinal = 0;
+    int result = 0;
 
-    while (!bfinal && out_pos < dst_size) {
-        bfinal = get_bit(&state);
+    while (!bfinal && result == 0) {
+        bfinal = get_bits(&state, 1);
         int btype = get_bits(&state, 2);
+        if (bfinal < 0 || btype < 0) {
+            result = -1;
+            break;
+        }
 
         if (btype == 0) {
-            // Uncompressed block
+            // Uncompressed block, copied through the window in pieces
             align_byte(&state);
-            if (state.pos + 4 > src_size) return -1;
-
-            uint16_t len = state.data[state.pos] | (state.data[state.pos + 1] << 8);
-            state.pos += 4;  // Skip len and nlen
-
-            if (state.pos + len > src_size) return -1;
-            if (out_pos + len > dst_size) return -1;
+            int len = get_bits(&state, 16);
+            if (len < 0 || get_bits(&state, 16) < 0) {
+                result = -1;
+                break;
+            }
 
-            memcpy(dst + out_pos, state.data + state.pos, len);
-            out_pos += len;
-            state.pos += len;
+            while (len > 0 && result == 0) {
+                if (dec->window_pos >= dec->checkpoint) {
+                    result = emit_rows(dec);
+                    if (result != 0) break;
+                }
+                size_t n = dec->checkpoint - dec->window_pos;
+                if (n > (size_t)len) n = len;
+                if (read_stored(&state, dec->window + dec->window_pos, n) != 0) {
+                    result = -1;
+                    break;
+                }
+                dec->window_pos += n;
+                len -= (int)n;
+            }
 
         } else if (btype == 1) {
             // Fixed Huffman codes
-            while (out_pos < dst_size) {
-                int sym = decode_fixed_lit(&state);
-                if (sym < 0) return -1;
-
-                if (sym < 256) {
-                    // Literal byte
-                    dst[out_pos++] = (uint8_t)sym;
-                } else if (sym == 256) {
-                    // End of block
+            result = inflate_block(&state, &fixed_lit, &fixed_dist);
+
+        } else if (btype == 2) {
+            // Dynamic Huffman codes
+            if (!dyn) {
+                dyn = (huffman_t *)kmalloc(2 * sizeof(huffman_t));
+                if (!dyn) {
+                    result = -1;
                     break;
-                } else {
-                    // Length/distance pair
-                    int len_idx = sym - 257;
-                    if (len_idx >= 29) return -1;
-
-                    int length = length_base[len_idx];
-                    if (length_extra[len_idx] > 0) {
-                        length += get_bits(&state, length_extra[len_idx]);
-                    }
-
-                    int dist_code = decode_fixed_dist(&state);
-                    if (dist_code < 0 || dist_code >= 30) return -1;
-
-                    int distance = dist_base[dist_code];
-                    if (dist_extra[dist_code] > 0) {
-                        distance += get_bits(&state, dist_extra[dist_code]);
-                    }
-
-                    // Copy from back buffer
-                    if ((size_t)distance > out_pos) return -1;
-                    for (int i = 0; i < length && out_pos < dst_size; i++) {
-                        dst[out_pos] = dst[out_pos - distance];
-                        out_pos++;
-                    }
                 }
             }
-
-        } else if (btype == 2) {
-            // Dynamic Huffman - simplified: just fail for now
-            // Most PNG files use fixed or uncompressed
-            return -1;
+            if (read_dynamic_tables(&state, &dyn[0], &dyn[1]) != 0) {
+                result = -1;
+                break;
+            }
+            result = inflate_block(&state, &dyn[0], &dyn[1]);
 
         } else {
-            return -1;  // Invalid block type
+            result = -1;  // Invalid block type
         }
     }
 
-    *out_size = out_pos;
-    return 0;
-}
-
-// Paeth predictor
-static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
-    int p = a + b - c;
-    int pa = p > a ? p - a : a - p;
-    int pb = p > b ? p - b : b - p;
-    int pc = p > c ? p - c : c - p;
+    // Rows completed by the final block
+    if (result == 0) {
+        result = emit_rows(dec);
+    }
 
-    if (pa <= pb && pa <= pc) return a;
-    if (pb <= pc) return b;
-    return c;
+    if (dyn) kfree(dyn);
+    return result < 0 ? -1 : 0;
 }
 
-// Apply PNG filters
-static int apply_filters(uint8_t *data, uint32_t width, uint32_t height,
-                         int bytes_per_pixel) {
-    uint32_t row_bytes = width * bytes_per_pixel;
-    uint32_t filtered_row_bytes = row_bytes + 1;  // +1 for filter byte
-
-    uint8_t *prev_row = 0;
-
-    for (uint32_t y = 0; y < height; y++) {
-        uint8_t *row = data + y * filtered_row_bytes;
-        uint8_t filter = row[0];
-        uint8_t *pixels = row + 1;
-
-        switch (filter) {
-            case FILTER_NONE:
-                break;
-
-            case FILTER_SUB:
-                for (uint32_t x = bytes_per_pixel; x < row_bytes; x++) {
-                    pixels[x] += pixels[x - bytes_per_pixel];
-                }
-                break;
+// Make more source bytes available; returns 0 at end of input
+static int source_fill(png_source_t *src) {
+    if (src->pos < src->size) return 1;
+    if (!src->file) return 0;
+
+    int n = vfs_read(src->file, src->file_pos, PNG_READ_BLOCK, src->block);
+    if (n <= 0) return 0;
+    src->data = src->block;
+    src->size = (size_t)n;
+    src->pos = 0;
+    src->file_pos += n;
+    return 1;
+}
 
-            case FILTER_UP:
-                if (prev_row) {
-                    for (uint32_t x = 0; x < row_bytes; x++) {
-                        pixels[x] += prev_row[x + 1];
-                    }
-                }
-                break;
+// Borrow up to `max` contiguous bytes without copying
+static size_t source_next(png_source_t *src, const uint8_t **data, size_t max) {
+    if (!source_fill(src)) return 0;
+    size_t n = src->size - src->pos;
+    if (n > max) n = max;
+    *data = src->data + src->pos;
+    src->pos += n;
+    return n;
+}
 
-            case FILTER_AVERAGE:
-                for (uint32_t x = 0; x < row_bytes; x++) {
-                    uint8_t left = (x >= (uint32_t)bytes_per_pixel) ?
-                                   pixels[x - bytes_per_pixel] : 0;
-                    uint8_t up = prev_row ? prev_row[x + 1] : 0;
-                    pixels[x] += (left + up) / 2;
-                }
-                break;
+static int source_read(png_source_t *src, uint8_t *out, size_t len) {
+    while (len > 0) {
+        const uint8_t *p;
+        size_t n = source_next(src, &p, len);
+        if (n == 0) return -1;
+        memcpy(out, p, n);
+        out += n;
+        len -= n;
+    }
+    return 0;
+}
 
-            case FILTER_PAETH:
-                for (uint32_t x = 0; x < row_bytes; x++) {
-                    uint8_t left = (x >= (uint32_t)bytes_per_pixel) ?
-                                   pixels[x - bytes_per_pixel] : 0;
-                    uint8_t up = prev_row ? prev_row[x + 1] : 0;
-                    uint8_t up_left = (prev_row && x >= (uint32_t)bytes_per_pixel) ?
-                                      prev_row[x + 1 - bytes_per_pixel] : 0;
-                    pixels[x] += paeth(left, up, up_left);
-                }
-                break;
+static int source_skip(png_source_t *src, size_t len) {
+    while (len > 0) {
+        const uint8_t *p;
+        size_t n = source_next(src, &p, len);
+        if (n == 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
 
-            default:
-                return -1;  // Unknown filter
-        }
+// Read a chunk header: returns the type, or 0 at end of input
+static uint32_t read_chunk_header(png_source_t *src, uint32_t *len) {
+    uint8_t hdr[8];
+    if (source_read(src, hdr, 8) != 0) return 0;
+    *len = read_be32(hdr);
+    return read_be32(hdr + 4);
+}
 
-        prev_row = row;
+// Next run of compressed bytes, following the stream across IDAT chunks
+static size_t idat_next(png_decoder_t *dec, const uint8_t **data) {
+    while (dec->idat_remaining == 0) {
+        // Skip the CRC, then continue only into another IDAT
+        uint32_t len;
+        if (source_skip(&dec->src, 4) != 0) return 0;
+        if (read_chunk_header(&dec->src, &len) != CHUNK_IDAT) return 0;
+        dec->idat_remaining = len;
     }
 
-    return 0;
+    size_t n = source_next(&dec->src, data, dec->idat_remaining);
+    dec->idat_remaining -= n;
+    return n;
 }
 
-// Load PNG from memory
-png_image_t *png_load(const uint8_t *data, size_t size) {
+// Decode a PNG from a source; optionally reports the inflated stream size
+static png_image_t *png_decode(png_source_t *src, const png_callbacks_t *cb,
+                               size_t *raw_size_out) {
+    png_decoder_t dec;
+    memset(&dec, 0, sizeof(dec));
+    dec.src = *src;
+    dec.cb = cb;
+
     // Check signature
-    if (size < 8) return 0;
+    uint8_t sig[8];
+    if (source_read(&dec.src, sig, 8) != 0) return 0;
     for (int i = 0; i < 8; i++) {
-        if (data[i] != PNG_SIGNATURE[i]) return 0;
+        if (sig[i] != PNG_SIGNATURE[i]) return 0;
     }
 
-    // Parse chunks
-    size_t pos = 8;
+    // Parse chunks up to the first IDAT
     uint32_t width = 0, height = 0;
     uint8_t bit_depth = 0, color_type = 0;
 
-    // Collect all IDAT data
-    uint8_t *idat_data = 0;
-    size_t idat_size = 0;
-    size_t idat_capacity = 0;
-
-    while (pos + 12 <= size) {
-        uint32_t chunk_len = read_be32(data + pos);
-        uint32_t chunk_type = read_be32(data + pos + 4);
-        const uint8_t *chunk_data = data + pos + 8;
-
-        if (pos + 12 + chunk_len > size) break;
+    while (1) {
+        uint32_t chunk_len;
+        uint32_t chunk_type = read_chunk_header(&dec.src, &chunk_len);
 
         if (chunk_type == CHUNK_IHDR) {
-            if (chunk_len < 13) goto error;
-            width = read_be32(chunk_data);
-            height = read_be32(chunk_data + 4);
-            bit_depth = chunk_data[8];
-            color_type = chunk_data[9];
+            uint8_t ihdr[13];
+            if (chunk_len < 13 || source_read(&dec.src, ihdr, 13) != 0) return 0;
+            width = read_be32(ihdr);
+            height = read_be32(ihdr + 4);
+            bit_depth = ihdr[8];
+            color_type = ihdr[9];
 
             // Only support 8-bit truecolor (RGB) and truecolor+alpha (RGBA)
-            if (bit_depth != 8) goto error;
+            if (bit_depth != 8) return 0;
             if (color_type != PNG_TRUECOLOR && color_type != PNG_TRUECOLOR_ALPHA) {
-                goto error;
+                return 0;
             }
+            if (source_skip(&dec.src, chunk_len - 13 + 4) != 0) return 0;
 
         } else if (chunk_type == CHUNK_IDAT) {
-            // Append to IDAT buffer
-            if (idat_size + chunk_len > idat_capacity) {
-                size_t new_cap = (idat_capacity == 0) ? 65536 : idat_capacity * 2;
-                while (new_cap < idat_size + chunk_len) new_cap *= 2;
-                uint8_t *new_buf = (uint8_t *)kmalloc(new_cap);
-                if (!new_buf) goto error;
-                if (idat_data) {
-                    memcpy(new_buf, idat_data, idat_size);
-                    kfree(idat_data);
-                }
-                idat_data = new_buf;
-                idat_capacity = new_cap;
-            }
-            memcpy(idat_data + idat_size, chunk_data, chunk_len);
-            idat_size += chunk_len;
-
-        } else if (chunk_type == CHUNK_IEND) {
+            dec.idat_remaining = chunk_len;
             break;
-        }
-
-        pos += 12 + chunk_len;
-    }
-
-    if (!width || !height || !idat_data) goto error;
 
-    // Decompress IDAT
-    int bytes_per_pixel = (color_type == PNG_TRUECOLOR_ALPHA) ? 4 : 3;
-    size_t raw_size = (width * bytes_per_pixel + 1) * height;  // +1 per row for filter
-    uint8_t *raw_data = (uint8_t *)kmalloc(raw_size);
-    if (!raw_data) goto error;
+        } else if (chunk_type == 0 || chunk_type == CHUNK_IEND) {
+            return 0;  // No image data
 
-    size_t decompressed_size = 0;
-    if (inflate_data(idat_data, idat_size, raw_data, raw_size, &decompressed_size) != 0) {
-        kfree(raw_data);
-        goto error;
+        } else {
+            if (source_skip(&dec.src, (size_t)chunk_len + 4) != 0) return 0;
+        }
     }
 
-    kfree(idat_data);
-    idat_data = 0;
+    if (!width || !height) return 0;
+    if ((uint64_t)width * 4 * height > PNG_MAX_PIXEL_BYTES) return 0;
 
-    // Apply PNG filters
-    if (apply_filters(raw_data, width, height, bytes_per_pixel) != 0) {
-        kfree(raw_data);
-        return 0;
-    }
+    size_t pixel_bytes = (size_t)width * height * sizeof(uint32_t);
+    dec.bytes_per_pixel = (color_type == PNG_TRUECOLOR_ALPHA) ? 4 : 3;
+    dec.row_bytes = (size_t)width * dec.bytes_per_pixel;
+    if (raw_size_out) *raw_size_out = (dec.row_bytes + 1) * height;
+
+    // History, plus room for a whole row or another window's worth of output
+    size_t fresh = dec.row_bytes + 1 > INFLATE_WINDOW ? dec.row_bytes + 1 : INFLATE_WINDOW;
+    dec.window_size = INFLATE_WINDOW + fresh + INFLATE_MATCH_SLACK;
+    dec.slide_at = dec.window_size - INFLATE_MATCH_SLACK;
+    dec.checkpoint = 0;
+    dec.window = (uint8_t *)kmalloc(dec.window_size);
+    dec.prev_row = (uint8_t *)kcalloc(1, dec.row_bytes);
+    dec.cur_row = (uint8_t *)kmalloc(dec.row_bytes);
 
     // Allocate image
     png_image_t *img = (png_image_t *)kmalloc(sizeof(png_image_t));
-    if (!img) {
-        kfree(raw_data);
-        return 0;
+    if (img) {
+        img->width = width;
+        img->height = height;
+        img->pixels = (uint32_t *)kmalloc(pixel_bytes);
     }
 
-    img->width = width;
-    img->height = height;
-    img->pixels = (uint32_t *)kmalloc(width * height * sizeof(uint32_t));
-    if (!img->pixels) {
-        kfree(raw_data);
-        kfree(img);
-        return 0;
+    int ok = dec.window && dec.prev_row && dec.cur_row && img && img->pixels;
+    if (ok) {
+        dec.img = img;
+        if (cb) {
+            // Rows not decoded yet show as transparent black
+            memset(img->pixels, 0, pixel_bytes);
+            if (cb->on_header) cb->on_header(cb->ctx, img);
+        }
+        ok = inflate_stream(&dec) == 0;
     }
 
-    // Convert to ARGB
-    uint32_t row_bytes = width * bytes_per_pixel + 1;
-    for (uint32_t y = 0; y < height; y++) {
-        uint8_t *row = raw_data + y * row_bytes + 1;  // Skip filter byte
-        for (uint32_t x = 0; x < width; x++) {
-            uint8_t r = row[x * bytes_per_pixel];
-            uint8_t g = row[x * bytes_per_pixel + 1];
-            uint8_t b = row[x * bytes_per_pixel + 2];
-            uint8_t a = (bytes_per_pixel == 4) ? row[x * bytes_per_pixel + 3] : 0xFF;
-            img->pixels[y * width + x] = (a << 24) | (r << 16) | (g << 8) | b;
-        }
+    if (ok && dec.y < height && !cb) {
+        // Truncated stream: blank the rows that never arrived
+        size_t done = (size_t)dec.y * width;
+        memset(img->pixels + done, 0, pixel_bytes - done * sizeof(uint32_t));
     }
 
-    kfree(raw_data);
+    if (dec.window) kfree(dec.window);
+    if (dec.prev_row) kfree(dec.prev_row);
+    if (dec.cur_row) kfree(dec.cur_row);
+
+    if (!ok) {
+        png_free(img);
+        return 0;
+    }
     return img;
+}
 
-error:
-    if (idat_data) kfree(idat_data);
-    return 0;
+// Load PNG from memory
+png_image_t *png_load(const uint8_t *data, size_t size) {
+    png_source_t src = {.data = data, .size = size};
+    return png_decode(&src, 0, 0);
 }
 
-// Load PNG from file
-png_image_t *png_load_file(const char *path) {
+// Load PNG from a file, reading it in blocks while decoding
+png_image_t *png_load_file_progressive(const char *path, const png_callbacks_t *cb) {
     vfs_node_t *node = vfs_open(path, VFS_READ);
     if (!node) return 0;
 
-    uint8_t *buffer = (uint8_t *)kmalloc(node->length);
-    if (!buffer) {
+    uint8_t *block = (uint8_t *)kmalloc(PNG_READ_BLOCK);
+    if (!block) {
         vfs_close(node);
         return 0;
     }
 
-    int bytes_read = vfs_read(node, 0, node->length, buffer);
-    vfs_close(node);
-
-    if (bytes_read <= 0) {
-        kfree(buffer);
-        return 0;
-    }
+    png_source_t src = {.file = node, .block = block};
+    png_image_t *img = png_decode(&src, cb, 0);
 
-    png_image_t *img = png_load(buffer, bytes_read);
-    kfree(buffer);
+    kfree(block);
+    vfs_close(node);
     return img;
 }
 
+// Load PNG from file
+png_image_t *png_load_file(const char *path) {
+    return png_load_file_progressive(path, 0);
+}
+
 // Free PNG image
 void png_free(png_image_t *img) {
     if (img) {
@@ -470,3 +860,29 @@ void png_free(png_image_t *img) {
         kfree(img);
     }
 }
+
+int png_benchmark(const uint8_t *data, size_t size, uint32_t iterations,
+                  png_bench_result_t *result) {
+    if (iterations == 0) iterations = 1;
+
+    uint64_t start = timing_rdtsc();
+    png_image_t *img = 0;
+    size_t raw_size = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        png_source_t src = {.data = data, .size = size};
+        img = png_decode(&src, 0, &raw_size);
+        if (!img) return -1;
+        if (i + 1 < iterations) png_free(img);
+    }
+    uint64_t cycles = timing_rdtsc() - start;
+
+    result->width = img->width;
+    result->height = img->height;
+    result->iterations = iterations;
+    result->raw_bytes = (uint32_t)raw_size;
+    result->us_per_image = (uint32_t)(timing_cycles_to_us(cycles) / iterations);
+    result->mbps = timing_mb_per_sec((uint64_t)raw_size * iterations, cycles);
+
+    png_free(img);
+    return 0;
+}
@@ -4,12 +4,23 @@
 #include "graphics/font.h"
 #include "graphics/cursor.h"
 #include "memory/heap.h"
+#include "memory/buddy.h"
 #include "utils/memory.h"
 #include "utils/string.h"
+#include "utils/timing.h"
 
 // Desktop background color
 #define DESKTOP_COLOR 0x008080
 
+// Pending screen damage rectangles before they are merged
+#define WM_MAX_DAMAGE 32
+
+// Uncovered pieces tracked while compositing one damage rectangle
+#define WM_MAX_FRAGMENTS 64
+
+// Minimum time between frames while dragging a window
+#define WM_DRAG_FRAME_MS 16
+
 // Window list
 static window_t *windows[MAX_WINDOWS];
 static int window_count = 0;
@@ -19,10 +30,10 @@ static int next_window_id = 1;
 static window_t *drag_window = 0;
 static int32_t drag_offset_x = 0;
 static int32_t drag_offset_y = 0;
-static int32_t drag_outline_x = 0;  // Current outline position
-static int32_t drag_outline_y = 0;
-static int32_t drag_start_x = 0;    // Original window position
-static int32_t drag_start_y = 0;
+static int32_t drag_target_x = 0;   // Latest pointer position, not yet drawn
+static int32_t drag_target_y = 0;
+static uint64_t drag_last_frame = 0; // TSC of the last drag frame
+static window_t *drag_paint = 0;    // Moved window to repaint on the next render
 static uint8_t last_buttons = 0;
 
 // Focused window
@@ -31,13 +42,116 @@ static window_t *focused_window = 0;
 // Global dirty flag for full redraw
 static int wm_global_dirty = 1;
 
+// Screen-space damage waiting to be composited (x1/y1 exclusive)
+typedef struct {
+    int32_t x0, y0, x1, y1;
+} wm_rect_t;
+
+static wm_rect_t wm_damage[WM_MAX_DAMAGE];
+static int wm_damage_count = 0;
+
+static inline int rect_empty(const wm_rect_t *r) {
+    return r->x0 >= r->x1 || r->y0 >= r->y1;
+}
+
+static inline wm_rect_t rect_intersect(const wm_rect_t *a, const wm_rect_t *b) {
+    wm_rect_t r;
+    r.x0 = a->x0 > b->x0 ? a->x0 : b->x0;
+    r.y0 = a->y0 > b->y0 ? a->y0 : b->y0;
+    r.x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+    r.y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+    return r;
+}
+
+static inline void rect_union(wm_rect_t *a, const wm_rect_t *b) {
+    if (b->x0 < a->x0) a->x0 = b->x0;
+    if (b->y0 < a->y0) a->y0 = b->y0;
+    if (b->x1 > a->x1) a->x1 = b->x1;
+    if (b->y1 > a->y1) a->y1 = b->y1;
+}
+
+static inline uint64_t rect_area(const wm_rect_t *r) {
+    return (uint64_t)(r->x1 - r->x0) * (uint64_t)(r->y1 - r->y0);
+}
+
+// Split the part of r outside w into up to four pieces; returns the count
+static int rect_subtract(const wm_rect_t *r, const wm_rect_t *w, wm_rect_t pieces[4]) {
+    wm_rect_t overlap = rect_intersect(r, w);
+    if (rect_empty(&overlap)) {
+        pieces[0] = *r;
+        return 1;
+    }
+
+    int n = 0;
+    if (w->y0 > r->y0) pieces[n++] = (wm_rect_t){r->x0, r->y0, r->x1, w->y0};
+    if (w->y1 < r->y1) pieces[n++] = (wm_rect_t){r->x0, w->y1, r->x1, r->y1};
+    if (w->x0 > r->x0) pieces[n++] = (wm_rect_t){r->x0, overlap.y0, w->x0, overlap.y1};
+    if (w->x1 < r->x1) pieces[n++] = (wm_rect_t){w->x1, overlap.y0, r->x1, overlap.y1};
+    return n;
+}
+
+static wm_rect_t window_rect(const window_t *win) {
+    wm_rect_t r = {win->x, win->y,
+                   win->x + (int32_t)win->width, win->y + (int32_t)win->height};
+    return r;
+}
+
 void wm_init(void) {
     memset(windows, 0, sizeof(windows));
     window_count = 0;
     next_window_id = 1;
     drag_window = 0;
+    drag_paint = 0;
     focused_window = 0;
     wm_global_dirty = 1;
+    wm_damage_count = 0;
+}
+
+void wm_damage_rect(int32_t x, int32_t y, uint32_t w, uint32_t h) {
+    wm_rect_t screen = {0, 0, (int32_t)get_screen_width(), (int32_t)get_screen_height()};
+    wm_rect_t r = {x, y, x + (int32_t)w, y + (int32_t)h};
+    r = rect_intersect(&r, &screen);
+    if (rect_empty(&r)) return;
+
+    // Merge with anything it overlaps
+    for (int i = 0; i < wm_damage_count; i++) {
+        wm_rect_t overlap = rect_intersect(&wm_damage[i], &r);
+        if (!rect_empty(&overlap)) {
+            rect_union(&wm_damage[i], &r);
+            return;
+        }
+    }
+
+    if (wm_damage_count < WM_MAX_DAMAGE) {
+        wm_damage[wm_damage_count++] = r;
+        return;
+    }
+
+    // List full: fold into the entry that grows the least
+    int best = 0;
+    uint64_t best_growth = (uint64_t)-1;
+    for (int i = 0; i < wm_damage_count; i++) {
+        wm_rect_t u = wm_damage[i];
+        rect_union(&u, &r);
+        uint64_t growth = rect_area(&u) - rect_area(&wm_damage[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    rect_union(&wm_damage[best], &r);
+}
+
+static void damage_window(const window_t *win) {
+    if (win->flags & WINDOW_FLAG_VISIBLE) {
+        wm_damage_rect(win->x, win->y, win->width, win->height);
+    }
+}
+
+static void damage_title_bar(const window_t *win) {
+    if (win->flags & WINDOW_FLAG_VISIBLE) {
+        wm_damage_rect(win->x, win->y, win->width, WINDOW_TITLE_HEIGHT);
+    }
 }
 
 // Find free window slot
@@ -87,7 +201,7 @@ window_t *window_create(const char *title, int32_t x, int32_t y,
     win->title[title_len] = 0;
 
     // Allocate framebuffer for content
-    win->framebuffer = (uint32_t *)kmalloc(width * height * sizeof(uint32_t));
+    win->framebuffer = (uint32_t *)kmalloc_pages(width * height * sizeof(uint32_t));
     if (!win->framebuffer) {
         kfree(win);
         return 0;
@@ -119,6 +233,9 @@ void window_destroy(window_t *win) {
         win->on_close(win);
     }
 
+    // Expose whatever was underneath
+    damage_window(win);
+
     // Remove from window list
     for (int i = 0; i < MAX_WINDOWS; i++) {
         if (windows[i] == win) {
@@ -131,34 +248,36 @@ void window_destroy(window_t *win) {
     // Clear focus/drag if needed
     if (focused_window == win) focused_window = 0;
     if (drag_window == win) drag_window = 0;
+    if (drag_paint == win) drag_paint = 0;
 
     // Free resources
     if (win->framebuffer) {
-        kfree(win->framebuffer);
+        kfree_pages(win->framebuffer);
     }
     kfree(win);
-
-    // Need full redraw to clear where window was
-    wm_global_dirty = 1;
 }
 
 void window_show(window_t *win) {
     if (win) {
         win->flags |= WINDOW_FLAG_VISIBLE | WINDOW_FLAG_DIRTY;
+        damage_window(win);
     }
 }
 
 void window_hide(window_t *win) {
     if (win) {
+        damage_window(win);
         win->flags &= ~WINDOW_FLAG_VISIBLE;
     }
 }
 
 void window_move(window_t *win, int32_t x, int32_t y) {
     if (win) {
+        // Content is unchanged; only the old and new areas need compositing
+        damage_window(win);
         win->x = x;
         win->y = y;
-        win->flags |= WINDOW_FLAG_DIRTY;
+        damage_window(win);
     }
 }
 
@@ -166,7 +285,7 @@ void window_resize(window_t *win, uint32_t width, uint32_t height) {
     if (!win) return;
 
     // Reallocate framebuffer
-    uint32_t *new_fb = (uint32_t *)kmalloc(width * height * sizeof(uint32_t));
+    uint32_t *new_fb = (uint32_t *)kmalloc_pages(width * height * sizeof(uint32_t));
     if (!new_fb) return;
 
     // Clear new framebuffer
@@ -174,31 +293,34 @@ void window_resize(window_t *win, uint32_t width, uint32_t height) {
         new_fb[i] = WM_COLOR_BACKGROUND;
     }
 
-    kfree(win->framebuffer);
+    kfree_pages(win->framebuffer);
     win->framebuffer = new_fb;
 
+    damage_window(win);
     win->content_width = width;
     win->content_height = height;
     win->width = width + WINDOW_BORDER_SIZE * 2;
     win->height = height + WINDOW_TITLE_HEIGHT + WINDOW_BORDER_SIZE;
     win->flags |= WINDOW_FLAG_DIRTY;
+    damage_window(win);
 }
 
 void window_focus(window_t *win) {
     if (!win) return;
 
-    // Unfocus previous
-    if (focused_window) {
+    // Unfocus previous (only its title bar color changes)
+    if (focused_window && focused_window != win) {
         focused_window->flags &= ~WINDOW_FLAG_FOCUSED;
-        focused_window->flags |= WINDOW_FLAG_DIRTY;
+        damage_title_bar(focused_window);
     }
 
     // Focus new window
-    win->flags |= WINDOW_FLAG_FOCUSED | WINDOW_FLAG_DIRTY;
+    win->flags |= WINDOW_FLAG_FOCUSED;
     focused_window = win;
 
-    // Bring to top
+    // Bring to top; all of it may have been partly covered
     win->z_order = get_highest_z() + 1;
+    damage_window(win);
 }
 
 void window_set_title(window_t *win, const char *title) {
@@ -208,7 +330,7 @@ void window_set_title(window_t *win, const char *title) {
     if (title_len > MAX_TITLE_LENGTH - 1) title_len = MAX_TITLE_LENGTH - 1;
     memcpy(win->title, title, title_len);
     win->title[title_len] = 0;
-    win->flags |= WINDOW_FLAG_DIRTY;
+    damage_title_bar(win);
 }
 
 void window_invalidate(window_t *win) {
@@ -217,6 +339,16 @@ void window_invalidate(window_t *win) {
     }
 }
 
+void window_invalidate_rect(window_t *win, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (!win || !(win->flags & WINDOW_FLAG_VISIBLE)) return;
+    if (x >= win->content_width || y >= win->content_height) return;
+    if (w > win->content_width - x) w = win->content_width - x;
+    if (h > win->content_height - y) h = win->content_height - y;
+
+    wm_damage_rect(win->x + WINDOW_BORDER_SIZE + (int32_t)x,
+                   win->y + WINDOW_TITLE_HEIGHT + (int32_t)y, w, h);
+}
+
 // Drawing functions
 void window_clear(window_t *win, uint32_t color) {
     if (!win || !win->framebuffer) return;
@@ -273,12 +405,10 @@ void window_draw_text(window_t *win, const char *text,
 void window_draw_image(window_t *win, const uint32_t *pixels,
                        uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
     if (!win || !win->framebuffer || !pixels) return;
+    if (x >= win->content_width || y >= win->content_height) return;
 
-    for (uint32_t py = 0; py < h && y + py < win->content_height; py++) {
-        for (uint32_t px = 0; px < w && x + px < win->content_width; px++) {
-            win->framebuffer[(y + py) * win->content_width + (x + px)] = pixels[py * w + px];
-        }
-    }
+    blit_to_buffer(win->framebuffer, win->content_width, win->content_width, win->content_height,
+                   x, y, pixels, w, w, h);
     win->flags |= WINDOW_FLAG_DIRTY;
 }
 
@@ -326,7 +456,8 @@ int wm_is_dragging(void) {
 }
 
 int wm_needs_render(void) {
-    if (wm_global_dirty) return 1;
+    if (wm_global_dirty || wm_damage_count > 0) return 1;
+    if (drag_window && (drag_target_x != drag_window->x || drag_target_y != drag_window->y)) return 1;
 
     for (int i = 0; i < MAX_WINDOWS; i++) {
         if (windows[i] && (windows[i]->flags & WINDOW_FLAG_DIRTY)) {
@@ -340,46 +471,43 @@ void wm_force_render(void) {
     wm_global_dirty = 1;
 }
 
-// Draw XOR outline rectangle (calling twice erases it)
-static void draw_xor_outline(int32_t x, int32_t y, uint32_t w, uint32_t h) {
-    uint32_t screen_w = get_screen_width();
-    uint32_t screen_h = get_screen_height();
+// Move the dragged window to the latest pointer position, at most once
+// per frame. Pointer events in between only update the target, so a fast
+// mouse costs one move per frame rather than one per packet.
+static void drag_update(int force) {
+    window_t *win = drag_window;
+    if (!win || (drag_target_x == win->x && drag_target_y == win->y)) return;
+
+    uint64_t now = timing_rdtsc();
+    uint64_t frame = timing_tsc_khz() * WM_DRAG_FRAME_MS;
+    if (!force && now - drag_last_frame < frame) {
+        // The pointer may already have stopped: without a timer the idle
+        // hlt would leave the window short of it until some other IRQ
+        timing_arm_wakeup(timing_cycles_to_us(frame - (now - drag_last_frame)));
+        return;
+    }
+    drag_last_frame = now;
 
-    // Draw horizontal lines (top and bottom)
-    for (uint32_t px = 0; px < w; px++) {
-        int32_t sx = x + px;
-        if (sx >= 0 && sx < (int32_t)screen_w) {
-            // Top edge
-            if (y >= 0 && y < (int32_t)screen_h) {
-                uint32_t color = get_pixel_color(sx, y);
-                put_pixel(sx, y, color ^ 0xFFFFFF);
-            }
-            // Bottom edge
-            int32_t by = y + h - 1;
-            if (by >= 0 && by < (int32_t)screen_h) {
-                uint32_t color = get_pixel_color(sx, by);
-                put_pixel(sx, by, color ^ 0xFFFFFF);
-            }
-        }
+    // Something stacked above it: let the compositor sort out the overlap
+    if (win->z_order < get_highest_z()) {
+        window_move(win, drag_target_x, drag_target_y);
+        return;
     }
 
-    // Draw vertical lines (left and right)
-    for (uint32_t py = 1; py < h - 1; py++) {
-        int32_t sy = y + py;
-        if (sy >= 0 && sy < (int32_t)screen_h) {
-            // Left edge
-            if (x >= 0 && x < (int32_t)screen_w) {
-                uint32_t color = get_pixel_color(x, sy);
-                put_pixel(x, sy, color ^ 0xFFFFFF);
-            }
-            // Right edge
-            int32_t rx = x + w - 1;
-            if (rx >= 0 && rx < (int32_t)screen_w) {
-                uint32_t color = get_pixel_color(rx, sy);
-                put_pixel(rx, sy, color ^ 0xFFFFFF);
-            }
-        }
+    // On top, the window can be redrawn from its cached content at the new
+    // position; only the strips it uncovered need compositing.
+    wm_rect_t old_rect = window_rect(win);
+    win->x = drag_target_x;
+    win->y = drag_target_y;
+    wm_rect_t new_rect = window_rect(win);
+
+    wm_rect_t exposed[4];
+    int n = rect_subtract(&old_rect, &new_rect, exposed);
+    for (int i = 0; i < n; i++) {
+        wm_damage_rect(exposed[i].x0, exposed[i].y0,
+                       exposed[i].x1 - exposed[i].x0, exposed[i].y1 - exposed[i].y0);
     }
+    drag_paint = win;
 }
 
 // Handle mouse input
@@ -388,34 +516,17 @@ void wm_handle_mouse(int32_t x, int32_t y, uint8_t buttons) {
     uint8_t left_released = !(buttons & 0x01) && (last_buttons & 0x01);
     uint8_t left_held = buttons & 0x01;
 
-    // Handle drag - only update outline position, don't move window
+    // Handle drag - record the target; wm_render moves the window
     if (drag_window && left_held) {
-        int32_t new_x = x - drag_offset_x;
-        int32_t new_y = y - drag_offset_y;
-
-        // Only update if position changed
-        if (new_x != drag_outline_x || new_y != drag_outline_y) {
-            // Erase old outline
-            draw_xor_outline(drag_outline_x, drag_outline_y,
-                            drag_window->width, drag_window->height);
-            // Update position
-            drag_outline_x = new_x;
-            drag_outline_y = new_y;
-            // Draw new outline
-            draw_xor_outline(drag_outline_x, drag_outline_y,
-                            drag_window->width, drag_window->height);
-        }
+        drag_target_x = x - drag_offset_x;
+        drag_target_y = y - drag_offset_y;
     }
 
-    // Handle release - move window to final position
+    // Handle release - draw the final position even if a frame is not due
     if (left_released && drag_window) {
-        // Erase final outline
-        draw_xor_outline(drag_outline_x, drag_outline_y,
-                        drag_window->width, drag_window->height);
-        // Move window to final position
-        window_move(drag_window, drag_outline_x, drag_outline_y);
-        // Force full redraw
-        wm_global_dirty = 1;
+        drag_target_x = x - drag_offset_x;
+        drag_target_y = y - drag_offset_y;
+        drag_update(1);
         drag_window = 0;
     }
 
@@ -435,14 +546,8 @@ void wm_handle_mouse(int32_t x, int32_t y, uint8_t buttons) {
                 drag_window = win;
                 drag_offset_x = x - win->x;
                 drag_offset_y = y - win->y;
-                // Save original position and initialize outline
-                drag_start_x = win->x;
-                drag_start_y = win->y;
-                drag_outline_x = win->x;
-                drag_outline_y = win->y;
-                // Draw initial outline
-                draw_xor_outline(drag_outline_x, drag_outline_y,
-                                win->width, win->height);
+                drag_target_x = win->x;
+                drag_target_y = win->y;
             }
         }
     }
@@ -450,122 +555,193 @@ void wm_handle_mouse(int32_t x, int32_t y, uint8_t buttons) {
     last_buttons = buttons;
 }
 
-// Render all windows
-void wm_render(void) {
-    // Skip rendering while dragging (using XOR outline instead)
-    if (drag_window) {
-        return;
+// Paint one window's frame and content, clipped to `area`
+static void paint_window(window_t *win, const wm_rect_t *area) {
+    graphics_rect_t clip = {area->x0, area->y0,
+                            (uint32_t)(area->x1 - area->x0), (uint32_t)(area->y1 - area->y0)};
+    graphics_set_clip(&clip);
+
+    int32_t wx = win->x;
+    int32_t wy = win->y;
+    uint32_t w = win->width;
+    uint32_t h = win->height;
+    uint32_t body_h = h - WINDOW_TITLE_HEIGHT;
+
+    // Border strips around the title bar and content (no overdraw)
+    fill_rect(wx, wy, w, 1, WM_COLOR_BORDER);
+    fill_rect(wx, wy + 1, 1, WINDOW_TITLE_HEIGHT - 1, WM_COLOR_BORDER);
+    fill_rect(wx + w - 1, wy + 1, 1, WINDOW_TITLE_HEIGHT - 1, WM_COLOR_BORDER);
+    fill_rect(wx, wy + WINDOW_TITLE_HEIGHT, WINDOW_BORDER_SIZE, body_h, WM_COLOR_BORDER);
+    fill_rect(wx + w - WINDOW_BORDER_SIZE, wy + WINDOW_TITLE_HEIGHT,
+              WINDOW_BORDER_SIZE, body_h, WM_COLOR_BORDER);
+    fill_rect(wx + WINDOW_BORDER_SIZE, wy + h - WINDOW_BORDER_SIZE,
+              win->content_width, WINDOW_BORDER_SIZE, WM_COLOR_BORDER);
+
+    // Draw title bar
+    uint32_t title_color = (win->flags & WINDOW_FLAG_FOCUSED) ?
+                           WM_COLOR_TITLE_ACTIVE : WM_COLOR_TITLE_INACTIVE;
+    fill_rect(wx + 1, wy + 1, w - 2, WINDOW_TITLE_HEIGHT - 1, title_color);
+
+    // Draw title text
+    draw_string(win->title, wx + 4, wy + 6, WM_COLOR_TITLE_TEXT, title_color);
+
+    // Draw close button if closable
+    if (win->flags & WINDOW_FLAG_CLOSABLE) {
+        int32_t btn_x = wx + w - WINDOW_TITLE_HEIGHT + 2;
+        int32_t btn_y = wy + 2;
+        fill_rect(btn_x, btn_y, WINDOW_TITLE_HEIGHT - 4, WINDOW_TITLE_HEIGHT - 4, WM_COLOR_CLOSE_BTN);
+        // Draw X
+        draw_string("X", btn_x + 4, btn_y + 4, WM_COLOR_TITLE_TEXT, WM_COLOR_CLOSE_BTN);
     }
 
-    // Handle case where all windows were destroyed
-    if (wm_global_dirty && window_count == 0) {
-        cursor_hide();
-        // If desktop is active, let it render, otherwise clear to black
-        if (desktop_is_active()) {
-            desktop_render();
-        } else {
-            clear_screen(COLOR_BLACK);  // Clear to shell background
-        }
-        wm_global_dirty = 0;
-        cursor_show();
-        return;
+    // Copy window framebuffer to screen
+    if (win->framebuffer) {
+        blit_rect(wx + WINDOW_BORDER_SIZE, wy + WINDOW_TITLE_HEIGHT, win->framebuffer,
+                  win->content_width, win->content_width, win->content_height, 0);
     }
+}
 
-    // Skip rendering if nothing needs to be drawn or no windows
-    if (!wm_needs_render() || window_count == 0) {
-        return;
+// Paint whatever lies below all windows
+static void paint_background(const wm_rect_t *area) {
+    uint32_t w = area->x1 - area->x0;
+    uint32_t h = area->y1 - area->y0;
+
+    if (desktop_is_active()) {
+        desktop_render_rect(area->x0, area->y0, w, h);
+    } else {
+        // Shell background when no windows are left, desktop color otherwise
+        graphics_set_clip(0);
+        fill_rect(area->x0, area->y0, w, h, window_count ? DESKTOP_COLOR : COLOR_BLACK);
     }
+}
 
-    // Hide cursor before rendering (so we don't save window content as background)
-    cursor_hide();
-
-    // If global dirty (from drag end), redraw background
-    if (wm_global_dirty) {
-        if (desktop_is_active()) {
-            desktop_render();
-        } else {
-            clear_screen(DESKTOP_COLOR);
+// Fallback when a region splits into too many pieces: plain painter's
+// algorithm over the windows at or below `top` (sorted top to bottom)
+static void paint_stacked(const wm_rect_t *area, window_t **sorted, int top, int count) {
+    paint_background(area);
+    for (int i = count - 1; i >= top; i--) {
+        wm_rect_t visible = window_rect(sorted[i]);
+        visible = rect_intersect(&visible, area);
+        if (!rect_empty(&visible)) {
+            paint_window(sorted[i], &visible);
         }
     }
+}
 
-    // Sort windows by z-order
-    window_t *sorted[MAX_WINDOWS];
-    int count = 0;
+// Composite one damaged rectangle: walk windows top to bottom, paint the
+// part of each that is still uncovered, then fill what is left with the
+// background. Every pixel is painted exactly once.
+static void composite_rect(const wm_rect_t *damage, window_t **sorted, int count) {
+    wm_rect_t pending[WM_MAX_FRAGMENTS];
+    int pending_count = 1;
+    pending[0] = *damage;
+
+    for (int i = 0; i < count && pending_count > 0; i++) {
+        wm_rect_t w = window_rect(sorted[i]);
+        int n = pending_count;
+
+        for (int j = 0; j < n; j++) {
+            wm_rect_t r = pending[j];
+            wm_rect_t visible = rect_intersect(&r, &w);
+            if (rect_empty(&visible)) continue;
+
+            // Up to four pieces of r remain uncovered by this window
+            wm_rect_t pieces[4];
+            int np = rect_subtract(&r, &w, pieces);
+
+            if (pending_count - 1 + np > WM_MAX_FRAGMENTS) {
+                // Too fragmented: finish this piece with overdraw instead
+                paint_stacked(&r, sorted, i, count);
+                pending[j].x1 = pending[j].x0;
+                continue;
+            }
 
-    for (int i = 0; i < MAX_WINDOWS; i++) {
-        if (windows[i] && (windows[i]->flags & WINDOW_FLAG_VISIBLE)) {
-            sorted[count++] = windows[i];
-        }
-    }
+            paint_window(sorted[i], &visible);
 
-    // Simple bubble sort by z-order
-    for (int i = 0; i < count - 1; i++) {
-        for (int j = 0; j < count - i - 1; j++) {
-            if (sorted[j]->z_order > sorted[j + 1]->z_order) {
-                window_t *tmp = sorted[j];
-                sorted[j] = sorted[j + 1];
-                sorted[j + 1] = tmp;
+            pending[j] = np > 0 ? pieces[0] : (wm_rect_t){0, 0, 0, 0};
+            for (int k = 1; k < np; k++) {
+                pending[pending_count++] = pieces[k];
             }
         }
+
+        // Drop emptied entries
+        int kept = 0;
+        for (int j = 0; j < pending_count; j++) {
+            if (!rect_empty(&pending[j])) pending[kept++] = pending[j];
+        }
+        pending_count = kept;
     }
 
-    // Render windows bottom to top
-    for (int i = 0; i < count; i++) {
-        window_t *win = sorted[i];
+    for (int j = 0; j < pending_count; j++) {
+        paint_background(&pending[j]);
+    }
+}
+
+// Render damaged parts of the screen
+void wm_render(void) {
+    drag_update(0);
+
+    // Let applications redraw invalidated content first
+    for (int i = 0; i < MAX_WINDOWS; i++) {
+        window_t *win = windows[i];
+        if (!win || !(win->flags & WINDOW_FLAG_VISIBLE) || !(win->flags & WINDOW_FLAG_DIRTY)) continue;
 
-        // Call paint callback if set
         if (win->on_paint) {
             win->on_paint(win);
         }
+        win->flags &= ~WINDOW_FLAG_DIRTY;
+        window_invalidate_rect(win, 0, 0, win->content_width, win->content_height);
+    }
 
-        int32_t wx = win->x;
-        int32_t wy = win->y;
-
-        // Draw border
-        fill_rect(wx, wy, win->width, win->height, WM_COLOR_BORDER);
+    if (wm_global_dirty) {
+        wm_damage_count = 0;
+        wm_damage_rect(0, 0, get_screen_width(), get_screen_height());
+        wm_global_dirty = 0;
+    }
 
-        // Draw title bar
-        uint32_t title_color = (win->flags & WINDOW_FLAG_FOCUSED) ?
-                               WM_COLOR_TITLE_ACTIVE : WM_COLOR_TITLE_INACTIVE;
-        fill_rect(wx + 1, wy + 1, win->width - 2, WINDOW_TITLE_HEIGHT - 1, title_color);
+    if (wm_damage_count == 0 && !drag_paint) {
+        return;
+    }
 
-        // Draw title text
-        draw_string(win->title, wx + 4, wy + 6, WM_COLOR_TITLE_TEXT, title_color);
+    // Sort visible windows top to bottom
+    window_t *sorted[MAX_WINDOWS];
+    int count = 0;
+    for (int i = 0; i < MAX_WINDOWS; i++) {
+        window_t *win = windows[i];
+        if (!win || !(win->flags & WINDOW_FLAG_VISIBLE)) continue;
 
-        // Draw close button if closable
-        if (win->flags & WINDOW_FLAG_CLOSABLE) {
-            int32_t btn_x = wx + win->width - WINDOW_TITLE_HEIGHT + 2;
-            int32_t btn_y = wy + 2;
-            fill_rect(btn_x, btn_y, WINDOW_TITLE_HEIGHT - 4, WINDOW_TITLE_HEIGHT - 4, WM_COLOR_CLOSE_BTN);
-            // Draw X
-            draw_string("X", btn_x + 4, btn_y + 4, WM_COLOR_TITLE_TEXT, WM_COLOR_CLOSE_BTN);
+        int j = count++;
+        while (j > 0 && sorted[j - 1]->z_order < win->z_order) {
+            sorted[j] = sorted[j - 1];
+            j--;
         }
+        sorted[j] = win;
+    }
 
-        // Draw content area
-        int32_t content_x = wx + WINDOW_BORDER_SIZE;
-        int32_t content_y = wy + WINDOW_TITLE_HEIGHT;
-
-        // Copy window framebuffer to screen
-        if (win->framebuffer) {
-            for (uint32_t py = 0; py < win->content_height; py++) {
-                for (uint32_t px = 0; px < win->content_width; px++) {
-                    int32_t screen_x = content_x + px;
-                    int32_t screen_y = content_y + py;
-                    if (screen_x >= 0 && screen_y >= 0 &&
-                        screen_x < (int32_t)get_screen_width() &&
-                        screen_y < (int32_t)get_screen_height()) {
-                        put_pixel(screen_x, screen_y,
-                                  win->framebuffer[py * win->content_width + px]);
-                    }
-                }
-            }
-        }
+    // Hide cursor before rendering (so we don't save window content as background)
+    cursor_hide();
 
-        win->flags &= ~WINDOW_FLAG_DIRTY;
+    // Take the list first: painting the desktop can queue more damage
+    wm_rect_t damage[WM_MAX_DAMAGE];
+    int damage_count = wm_damage_count;
+    memcpy(damage, wm_damage, sizeof(wm_rect_t) * damage_count);
+    wm_damage_count = 0;
+
+    for (int i = 0; i < damage_count; i++) {
+        composite_rect(&damage[i], sorted, count);
     }
 
-    // Clear global dirty flag
-    wm_global_dirty = 0;
+    // A window dragged on top is fully visible: blit it straight over
+    if (drag_paint) {
+        wm_rect_t screen = {0, 0, (int32_t)get_screen_width(), (int32_t)get_screen_height()};
+        wm_rect_t visible = window_rect(drag_paint);
+        visible = rect_intersect(&visible, &screen);
+        if (!rect_empty(&visible)) {
+            paint_window(drag_paint, &visible);
+        }
+        drag_paint = 0;
+    }
+    graphics_set_clip(0);
 
     // Show cursor again (saves fresh background from rendered windows)
     cursor_show();
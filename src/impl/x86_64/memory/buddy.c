@@ -0,0 +1,304 @@
+#include <memory/buddy.h>
+#include <memory/heap.h>
+#include <memory/paging.h>
+#include <shell/shell.h>
+#include <stdint.h>
+
+// Binary buddy allocator over identity-mapped physical memory.
+// Each page frame has one state byte: the order of the free block it
+// heads, FRAME_ALLOCATED | order for the head of a live allocation, or
+// FRAME_NONE for frames that are not a block head / not managed.
+
+// Provided by boot assembly from the Multiboot2 memory map
+extern uint32_t mmap_region_count;
+extern struct
+{
+    uint64_t base;
+    uint64_t length;
+} mmap_regions[];
+
+#define FRAME_NONE 0xFF
+#define FRAME_ALLOCATED 0x80
+#define FRAME_ORDER_MASK 0x0F
+
+#define PAGE_SHIFT 12
+#define BLOCK_BYTES(order) ((uint64_t)BUDDY_PAGE_SIZE << (order))
+
+typedef struct free_block
+{
+    struct free_block *next;
+    struct free_block *prev;
+} free_block_t;
+
+static free_block_t *free_lists[BUDDY_ORDER_COUNT];
+static uint32_t free_counts[BUDDY_ORDER_COUNT];
+static uint8_t *frame_state = NULL;
+static uint64_t frame_count = 0;
+static uint64_t managed_pages = 0;
+static uint64_t free_pages = 0;
+
+static void list_push(uint32_t order, uint64_t addr)
+{
+    free_block_t *block = (free_block_t *)(uintptr_t)addr;
+    block->prev = NULL;
+    block->next = free_lists[order];
+    if (free_lists[order])
+        free_lists[order]->prev = block;
+    free_lists[order] = block;
+
+    frame_state[addr >> PAGE_SHIFT] = (uint8_t)order;
+    free_counts[order]++;
+}
+
+static void list_remove(uint32_t order, uint64_t addr)
+{
+    free_block_t *block = (free_block_t *)(uintptr_t)addr;
+    if (block->prev)
+        block->prev->next = block->next;
+    else
+        free_lists[order] = block->next;
+    if (block->next)
+        block->next->prev = block->prev;
+
+    frame_state[addr >> PAGE_SHIFT] = FRAME_NONE;
+    free_counts[order]--;
+}
+
+// Insert a free block, coalescing with its buddy as far as possible
+static void free_block(uint64_t addr, uint32_t order)
+{
+    while (order < BUDDY_MAX_ORDER)
+    {
+        uint64_t buddy = addr ^ BLOCK_BYTES(order);
+        uint64_t buddy_frame = buddy >> PAGE_SHIFT;
+
+        if (buddy_frame >= frame_count || frame_state[buddy_frame] != order)
+            break;
+
+        list_remove(order, buddy);
+        if (buddy < addr)
+            addr = buddy;
+        order++;
+    }
+
+    list_push(order, addr);
+}
+
+// Hand the page-aligned range [start, end) to the allocator
+static void add_range(uint64_t start, uint64_t end)
+{
+    while (start < end)
+    {
+        uint32_t order = BUDDY_MAX_ORDER;
+        while (order > 0 &&
+               ((start & (BLOCK_BYTES(order) - 1)) != 0 || start + BLOCK_BYTES(order) > end))
+        {
+            order--;
+        }
+
+        managed_pages += 1ULL << order;
+        free_pages += 1ULL << order;
+        free_block(start, order);
+        start += BLOCK_BYTES(order);
+    }
+}
+
+void buddy_init(void)
+{
+    uint64_t mapped = paging_get_mapped_size();
+    uint64_t reserved_end = (heap_region_end() + BUDDY_PAGE_SIZE - 1) & ~(uint64_t)(BUDDY_PAGE_SIZE - 1);
+
+    serial_print("Buddy: scanning ");
+    serial_print_dec(mmap_region_count);
+    serial_print(" memory regions\n");
+
+    // Highest usable address decides the size of the frame state table
+    uint64_t limit = 0;
+    for (uint32_t i = 0; i < mmap_region_count; i++)
+    {
+        uint64_t end = mmap_regions[i].base + mmap_regions[i].length;
+        if (end > mapped)
+            end = mapped;
+        if (end > limit)
+            limit = end;
+    }
+    limit &= ~(uint64_t)(BUDDY_PAGE_SIZE - 1);
+
+    if (limit <= reserved_end)
+    {
+        serial_print("Buddy: no memory above the kernel heap\n");
+        return;
+    }
+
+    frame_count = limit >> PAGE_SHIFT;
+    uint64_t table_bytes = (frame_count + BUDDY_PAGE_SIZE - 1) & ~(uint64_t)(BUDDY_PAGE_SIZE - 1);
+
+    // Carve the frame state table out of the first region that fits it
+    for (uint32_t i = 0; i < mmap_region_count && !frame_state; i++)
+    {
+        uint64_t start = mmap_regions[i].base;
+        uint64_t end = start + mmap_regions[i].length;
+        if (start < reserved_end)
+            start = reserved_end;
+        start = (start + BUDDY_PAGE_SIZE - 1) & ~(uint64_t)(BUDDY_PAGE_SIZE - 1);
+        if (end > limit)
+            end = limit;
+
+        if (start < end && end - start >= table_bytes)
+        {
+            frame_state = (uint8_t *)(uintptr_t)start;
+            reserved_end = start + table_bytes;
+        }
+    }
+
+    if (!frame_state)
+    {
+        serial_print("Buddy: no room for frame table\n");
+        frame_count = 0;
+        return;
+    }
+
+    for (uint64_t i = 0; i < frame_count; i++)
+        frame_state[i] = FRAME_NONE;
+
+    // Hand over every region, skipping the kernel, the heap and the frame table
+    uint64_t table_start = (uint64_t)(uintptr_t)frame_state;
+    for (uint32_t i = 0; i < mmap_region_count; i++)
+    {
+        uint64_t start = mmap_regions[i].base;
+        uint64_t end = start + mmap_regions[i].length;
+        start = (start + BUDDY_PAGE_SIZE - 1) & ~(uint64_t)(BUDDY_PAGE_SIZE - 1);
+        end &= ~(uint64_t)(BUDDY_PAGE_SIZE - 1);
+        if (end > limit)
+            end = limit;
+
+        uint64_t heap_end = heap_region_end();
+        if (start < heap_end)
+            start = (heap_end + BUDDY_PAGE_SIZE - 1) & ~(uint64_t)(BUDDY_PAGE_SIZE - 1);
+
+        if (start < table_start && end > table_start)
+        {
+            add_range(start, table_start);
+            start = reserved_end;
+        }
+        else if (start >= table_start && start < reserved_end)
+        {
+            start = reserved_end;
+        }
+
+        if (start < end)
+            add_range(start, end);
+    }
+
+    serial_print("Buddy: managing ");
+    serial_print_dec((uint32_t)(managed_pages * BUDDY_PAGE_SIZE / (1024 * 1024)));
+    serial_print(" MB in 4KB-2MB blocks\n");
+}
+
+uint32_t buddy_order_for(size_t size)
+{
+    uint32_t order = 0;
+    while (order < BUDDY_ORDER_COUNT && BLOCK_BYTES(order) < size)
+        order++;
+    return order;
+}
+
+void *buddy_alloc(uint32_t order)
+{
+    if (order > BUDDY_MAX_ORDER || !frame_state)
+        return NULL;
+
+    // Smallest non-empty list at or above the requested order
+    uint32_t current = order;
+    while (current <= BUDDY_MAX_ORDER && !free_lists[current])
+        current++;
+    if (current > BUDDY_MAX_ORDER)
+        return NULL;
+
+    uint64_t addr = (uint64_t)(uintptr_t)free_lists[current];
+    list_remove(current, addr);
+
+    // Split down, returning upper halves to the free lists
+    while (current > order)
+    {
+        current--;
+        list_push(current, addr + BLOCK_BYTES(current));
+    }
+
+    frame_state[addr >> PAGE_SHIFT] = (uint8_t)(FRAME_ALLOCATED | order);
+    free_pages -= 1ULL << order;
+
+    return (void *)(uintptr_t)addr;
+}
+
+int buddy_owns(const void *addr)
+{
+    uint64_t a = (uint64_t)(uintptr_t)addr;
+    if (!frame_state || (a & (BUDDY_PAGE_SIZE - 1)) != 0)
+        return 0;
+
+    uint64_t frame = a >> PAGE_SHIFT;
+    if (frame >= frame_count)
+        return 0;
+
+    return (frame_state[frame] & FRAME_ALLOCATED) && frame_state[frame] != FRAME_NONE;
+}
+
+void buddy_free(void *addr)
+{
+    if (!addr)
+        return;
+
+    if (!buddy_owns(addr))
+    {
+        serial_print("buddy_free: not an allocated block ");
+        serial_print_hex((uint64_t)(uintptr_t)addr);
+        serial_print("\n");
+        return;
+    }
+
+    uint64_t a = (uint64_t)(uintptr_t)addr;
+    uint32_t order = frame_state[a >> PAGE_SHIFT] & FRAME_ORDER_MASK;
+
+    frame_state[a >> PAGE_SHIFT] = FRAME_NONE;
+    free_pages += 1ULL << order;
+    free_block(a, order);
+}
+
+void buddy_get_stats(buddy_stats_t *stats)
+{
+    if (!stats)
+        return;
+
+    stats->total_pages = managed_pages;
+    stats->free_pages = free_pages;
+    for (uint32_t i = 0; i < BUDDY_ORDER_COUNT; i++)
+        stats->free_blocks[i] = free_counts[i];
+}
+
+void *kmalloc_pages(size_t size)
+{
+    if (size == 0)
+        return NULL;
+
+    uint32_t order = buddy_order_for(size);
+    if (order <= BUDDY_MAX_ORDER)
+    {
+        void *ptr = buddy_alloc(order);
+        if (ptr)
+            return ptr;
+    }
+
+    return kmalloc_aligned(size, BUDDY_PAGE_SIZE);
+}
+
+void kfree_pages(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    if (buddy_owns(ptr))
+        buddy_free(ptr);
+    else
+        kfree(ptr);
+}
@@ -2,8 +2,23 @@
 #include <shell/shell.h>
 #include <stdint.h>
 #include <shell/print.h>
-
-// Simple block-based allocator with headers
+#include <utils/timing.h>
+#include <memory/buddy.h>
+#include <memory/paging.h>
+#include <memory/heap_trace.h>
+
+// Block allocator with boundary tags and segregated free lists,
+// fronted by a slab layer that serves small requests (16-2048 bytes)
+// from per-size-class caches.
+//
+// Block layout: [header][data][footer]. The footer repeats the size and
+// used bit so free() can find the previous block in O(1). A used
+// prologue footer and a zero-sized used epilogue header bracket the
+// region, so coalescing never needs bounds checks.
+//
+// The heap starts as a fixed identity-mapped region after the kernel.
+// When it runs out, it grows a second region in a reserved virtual
+// window by mapping 2MB pages taken from the buddy allocator.
 
 // Symbol exported by linker script - marks end of kernel
 extern char _kernel_end;
@@ -13,35 +28,199 @@ extern char _kernel_end;
 #define HEAP_SIZE 0x2000000 // 32MB heap
 #define HEAP_MAGIC 0xDEADBEEF
 
+// Growth window: virtual addresses above the identity map (PML4 slot 1)
+#define HEAP_GROW_BASE 0x0000008000000000ULL
+#define HEAP_GROW_STEP 0x200000ULL                // 2MB pages
+#define HEAP_GROW_MAX  0xC0000000ULL              // Keep 32-bit stats valid
+
+#define HEAP_MIN_DATA 16 // Smallest data area worth splitting off
+#define HEAP_BIN_COUNT HEAP_FREE_BINS
+
 typedef struct heap_block
 {
     uint32_t magic;          // Magic number for validation
-    size_t size;             // Size of this block (excluding header)
+    size_t size;             // Size of this block (excluding header/footer)
     uint8_t used;            // 1 if allocated, 0 if free
-    struct heap_block *next; // Next block in list
-    struct heap_block *prev; // Previous block in list
+    struct heap_block *next; // Next free block in the same bin
+    struct heap_block *prev; // Previous free block in the same bin
 } heap_block_t;
 
+typedef struct heap_footer
+{
+    size_t tag; // Block size | used bit
+} heap_footer_t;
+
+#define BLOCK_OVERHEAD (sizeof(heap_block_t) + sizeof(heap_footer_t))
+
 static heap_block_t *heap_start = NULL;
-static heap_block_t *heap_end = NULL;
 static uint32_t total_size = 0;
 static uint32_t used_size = 0;
+static uint32_t peak_used = 0;   // High-water mark of used_size
+static uint64_t heap_limit = 0;  // Max total_size (0 = growth disabled)
+
+static uintptr_t grow_end = 0;            // End of the mapped growth window
+static heap_block_t *grow_epilogue = NULL; // Epilogue of the growth region
+
+// Free blocks binned by floor(log2(size)); bin_map has a bit per non-empty bin
+static heap_block_t *bins[HEAP_BIN_COUNT];
+static uint64_t bin_map = 0;
+
+// Slab layer: each slab is a SLAB_SIZE-aligned block carved into
+// equally sized objects. Objects never start at the slab base (the
+// header lives there), so kfree can tell slab objects from blocks.
+#define SLAB_SIZE 0x4000 // 16KB per slab
+#define SLAB_MAGIC 0x51AB51AB
+#define SLAB_MIN_SHIFT 4 // 16 bytes
+#define SLAB_CLASS_COUNT 8
+#define SLAB_MAX_OBJECT (1 << (SLAB_MIN_SHIFT + SLAB_CLASS_COUNT - 1)) // 2048 bytes
+
+typedef struct slab_object
+{
+    struct slab_object *next;
+} slab_object_t;
+
+struct slab_cache;
+
+typedef struct slab
+{
+    uint32_t magic;             // SLAB_MAGIC while the slab is live
+    uint16_t free_count;        // Objects currently on the free list
+    uint16_t total_count;       // Objects carved from this slab
+    struct slab *self;          // Points to itself (extra validation)
+    struct slab_cache *cache;   // Owning size class
+    slab_object_t *free_list;   // Free objects in this slab
+    struct slab *next;          // Next slab with free objects
+    struct slab *prev;          // Previous slab with free objects
+} slab_t;
+
+typedef struct slab_cache
+{
+    uint32_t object_size;
+    slab_t *partial;      // Slabs with at least one free object
+    slab_t *spare;        // One fully free slab kept to avoid thrashing
+    uint32_t slab_count;  // Live slabs (including spare)
+    uint32_t alloc_count; // Objects currently handed out
+} slab_cache_t;
+
+static slab_cache_t slab_caches[SLAB_CLASS_COUNT];
+static uint8_t slab_enabled = 0;
+
+// Round a pointer up to a power-of-two alignment
+static uintptr_t align_up(uintptr_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+static heap_footer_t *block_footer(heap_block_t *block)
+{
+    return (heap_footer_t *)((uint8_t *)block + sizeof(heap_block_t) + block->size);
+}
+
+// Physically adjacent blocks, found through the boundary tags
+static heap_block_t *block_next(heap_block_t *block)
+{
+    return (heap_block_t *)((uint8_t *)block_footer(block) + sizeof(heap_footer_t));
+}
+
+static heap_footer_t *block_prev_footer(heap_block_t *block)
+{
+    return (heap_footer_t *)block - 1;
+}
+
+static heap_block_t *block_prev(heap_block_t *block)
+{
+    heap_footer_t *footer = block_prev_footer(block);
+    size_t size = footer->tag & ~(size_t)1;
+    return (heap_block_t *)((uint8_t *)footer - size - sizeof(heap_block_t));
+}
+
+// Write header and footer for a block
+static void block_set(heap_block_t *block, size_t size, uint8_t used)
+{
+    block->magic = HEAP_MAGIC;
+    block->size = size;
+    block->used = used;
+    block_footer(block)->tag = size | used;
+}
+
+static int bin_index(size_t size)
+{
+    int index = 63 - __builtin_clzll((unsigned long long)size);
+    return index < HEAP_BIN_COUNT ? index : HEAP_BIN_COUNT - 1;
+}
+
+static void bin_insert(heap_block_t *block)
+{
+    int index = bin_index(block->size);
+
+    block->prev = NULL;
+    block->next = bins[index];
+    if (bins[index])
+        bins[index]->prev = block;
+    bins[index] = block;
+
+    bin_map |= 1ULL << index;
+}
+
+static void bin_remove(heap_block_t *block)
+{
+    int index = bin_index(block->size);
+
+    if (block->prev)
+        block->prev->next = block->next;
+    else
+        bins[index] = block->next;
+
+    if (block->next)
+        block->next->prev = block->prev;
+
+    if (!bins[index])
+        bin_map &= ~(1ULL << index);
+}
+
+// Turn [start, start + bytes) into a bracketed region with one free block
+static heap_block_t *heap_add_region(uintptr_t start, size_t bytes)
+{
+    heap_footer_t *prologue = (heap_footer_t *)start;
+    prologue->tag = 1;
+
+    heap_block_t *block = (heap_block_t *)(start + sizeof(heap_footer_t));
+    size_t data = bytes - sizeof(heap_footer_t) - BLOCK_OVERHEAD - sizeof(heap_block_t);
+    data &= ~(size_t)7;
+    block_set(block, data, 0);
+
+    heap_block_t *epilogue = block_next(block);
+    epilogue->magic = HEAP_MAGIC;
+    epilogue->size = 0;
+    epilogue->used = 1;
+
+    bin_insert(block);
+    return block;
+}
 
 // Initialize the heap
 void heap_init(void)
 {
     serial_print("Initializing kernel heap...\n");
 
-    heap_start = (heap_block_t *)HEAP_START;
-    heap_start->magic = HEAP_MAGIC;
-    heap_start->size = HEAP_SIZE - sizeof(heap_block_t);
-    heap_start->used = 0;
-    heap_start->next = NULL;
-    heap_start->prev = NULL;
+    for (int i = 0; i < HEAP_BIN_COUNT; i++)
+        bins[i] = NULL;
+    bin_map = 0;
 
-    heap_end = heap_start;
+    heap_start = heap_add_region(HEAP_START, HEAP_SIZE);
     total_size = HEAP_SIZE;
     used_size = 0;
+    peak_used = 0;
+
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++)
+    {
+        slab_caches[i].object_size = 1u << (SLAB_MIN_SHIFT + i);
+        slab_caches[i].partial = NULL;
+        slab_caches[i].spare = NULL;
+        slab_caches[i].slab_count = 0;
+        slab_caches[i].alloc_count = 0;
+    }
+    slab_enabled = 1;
 
     serial_print("Heap initialized at ");
     serial_print_hex((uint64_t)HEAP_START);
@@ -50,107 +229,211 @@ void heap_init(void)
     serial_print(" KB)\n");
 }
 
-// Find a free block that fits the requested size
-static heap_block_t *find_free_block(size_t size)
+// Check whether a free block can hold `size` bytes at `alignment`.
+// Returns the aligned data address, or 0 if it does not fit.
+static uintptr_t block_fit(heap_block_t *block, size_t size, size_t alignment)
+{
+    uintptr_t data = (uintptr_t)block + sizeof(heap_block_t);
+    uintptr_t aligned = align_up(data, alignment);
+
+    // A misaligned start needs room for a leading free block
+    while (aligned != data && aligned - data < BLOCK_OVERHEAD + HEAP_MIN_DATA)
+    {
+        aligned += alignment;
+    }
+
+    if (aligned + size <= data + block->size)
+        return aligned;
+    return 0;
+}
+
+// Find a free block whose data area can hold `size` bytes at `alignment`.
+// Only free blocks are visited: the bin for `size` is scanned first fit,
+// then the bitmap jumps straight to the next non-empty larger bin.
+static heap_block_t *find_free_block(size_t size, size_t alignment, uintptr_t *data_out)
 {
-    heap_block_t *current = heap_start;
+    int index = bin_index(size);
 
-    while (current)
+    while (index < HEAP_BIN_COUNT)
     {
-        if (!current->used && current->size >= size)
+        uint64_t candidates = bin_map & ~((1ULL << index) - 1);
+        if (!candidates)
+            break;
+        index = __builtin_ctzll(candidates);
+
+        for (heap_block_t *current = bins[index]; current; current = current->next)
         {
-            return current;
+            if (current->size < size)
+                continue;
+
+            uintptr_t data = block_fit(current, size, alignment);
+            if (data)
+            {
+                *data_out = data;
+                return current;
+            }
         }
-        current = current->next;
+        index++;
     }
 
     return NULL;
 }
 
-// Split a block if it's too large
-static void split_block(heap_block_t *block, size_t size)
+// Split off the front of a free (unbinned) block so the returned block's
+// data starts at `data`. The leading part goes back into the bins.
+static heap_block_t *split_front(heap_block_t *block, uintptr_t data)
 {
-    // Only split if there's enough space for a new block header + some data
-    if (block->size >= size + sizeof(heap_block_t) + 16)
-    {
-        heap_block_t *new_block = (heap_block_t *)((uint8_t *)block + sizeof(heap_block_t) + size);
+    uintptr_t block_data = (uintptr_t)block + sizeof(heap_block_t);
+    if (data == block_data)
+        return block;
 
-        new_block->magic = HEAP_MAGIC;
-        new_block->size = block->size - size - sizeof(heap_block_t);
-        new_block->used = 0;
-        new_block->next = block->next;
-        new_block->prev = block;
+    heap_block_t *new_block = (heap_block_t *)(data - sizeof(heap_block_t));
+    size_t lead = (uintptr_t)new_block - block_data - sizeof(heap_footer_t);
+    size_t rest = block->size - lead - BLOCK_OVERHEAD;
 
-        if (block->next)
-        {
-            block->next->prev = new_block;
-        }
+    block_set(block, lead, 0);
+    bin_insert(block);
 
-        block->next = new_block;
-        block->size = size;
+    block_set(new_block, rest, 0);
+    return new_block;
+}
 
-        if (heap_end == block)
-        {
-            heap_end = new_block;
-        }
+// Split a block if it's too large; the tail goes back into the bins
+static void split_block(heap_block_t *block, size_t size)
+{
+    // Only split if there's enough space for a new block + some data
+    if (block->size >= size + BLOCK_OVERHEAD + HEAP_MIN_DATA)
+    {
+        size_t rest = block->size - size - BLOCK_OVERHEAD;
+
+        block_set(block, size, block->used);
+
+        heap_block_t *new_block = block_next(block);
+        block_set(new_block, rest, 0);
+        bin_insert(new_block);
     }
 }
 
-// Merge adjacent free blocks
+// Coalesce a newly freed block with free neighbours and bin the result
 static void merge_blocks(heap_block_t *block)
 {
+    size_t size = block->size;
+
     // Merge with next block if it's free
-    if (block->next && !block->next->used)
+    heap_block_t *next = block_next(block);
+    if (!next->used)
     {
-        heap_block_t *next = block->next;
+        bin_remove(next);
+        size += BLOCK_OVERHEAD + next->size;
+    }
 
-        block->size += sizeof(heap_block_t) + next->size;
-        block->next = next->next;
+    // Merge with previous block if it's free
+    if (!(block_prev_footer(block)->tag & 1))
+    {
+        heap_block_t *prev = block_prev(block);
+        bin_remove(prev);
+        size += BLOCK_OVERHEAD + prev->size;
+        block = prev;
+    }
 
-        if (next->next)
-        {
-            next->next->prev = block;
-        }
+    block_set(block, size, 0);
+    bin_insert(block);
+}
 
-        if (heap_end == next)
+// Allow the heap to grow up to `limit` bytes in total
+void heap_set_growth_limit(uint64_t limit)
+{
+    if (limit > HEAP_GROW_MAX)
+        limit = HEAP_GROW_MAX;
+    heap_limit = limit > HEAP_SIZE ? limit : 0;
+
+    serial_print("Heap: growth limit ");
+    serial_print_dec((uint32_t)((heap_limit ? heap_limit : HEAP_SIZE) / (1024 * 1024)));
+    serial_print(" MB\n");
+}
+
+// Map more 2MB pages at the end of the growth window so that a block of
+// at least `min_bytes` becomes available. Returns 0 on success.
+static int heap_grow(size_t min_bytes)
+{
+    if (!heap_limit)
+        return -1;
+
+    // Room for the request plus region bookkeeping, in whole 2MB pages
+    uint64_t want = min_bytes + 2 * BLOCK_OVERHEAD + sizeof(heap_footer_t);
+    want = (want + HEAP_GROW_STEP - 1) & ~(HEAP_GROW_STEP - 1);
+    if (total_size + want > heap_limit)
+        return -1;
+
+    uintptr_t start = grow_end ? grow_end : (uintptr_t)HEAP_GROW_BASE;
+    uint64_t mapped = 0;
+
+    while (mapped < want)
+    {
+        void *page = buddy_alloc(BUDDY_MAX_ORDER);
+        if (!page)
+            break;
+        if (paging_map_2mb(start + mapped, (uint64_t)(uintptr_t)page) != 0)
         {
-            heap_end = block;
+            buddy_free(page);
+            break;
         }
+        mapped += HEAP_GROW_STEP;
     }
 
-    // Merge with previous block if it's free
-    if (block->prev && !block->prev->used)
+    if (mapped == 0)
+        return -1;
+
+    if (!grow_end)
+    {
+        heap_block_t *block = heap_add_region(start, mapped);
+        grow_epilogue = block_next(block);
+    }
+    else
     {
-        heap_block_t *prev = block->prev;
+        // The old epilogue becomes a free block spanning the new pages
+        heap_block_t *block = grow_epilogue;
+        size_t data = (start + mapped) - (uintptr_t)block - BLOCK_OVERHEAD - sizeof(heap_block_t);
+        data &= ~(size_t)7;
+        block_set(block, data, 0);
+
+        grow_epilogue = block_next(block);
+        grow_epilogue->magic = HEAP_MAGIC;
+        grow_epilogue->size = 0;
+        grow_epilogue->used = 1;
+
+        merge_blocks(block);
+    }
 
-        prev->size += sizeof(heap_block_t) + block->size;
-        prev->next = block->next;
+    grow_end = start + mapped;
+    total_size += (uint32_t)mapped;
 
-        if (block->next)
-        {
-            block->next->prev = prev;
-        }
+    serial_print("Heap: grew by ");
+    serial_print_dec((uint32_t)(mapped / 1024));
+    serial_print(" KB to ");
+    serial_print_dec(total_size / 1024);
+    serial_print(" KB\n");
 
-        if (heap_end == block)
-        {
-            heap_end = prev;
-        }
-    }
+    return mapped >= want ? 0 : -1;
 }
 
-// Allocate memory
-void *kmalloc(size_t size)
+// Allocate from the segregated free lists
+static void *block_alloc(size_t size, size_t alignment)
 {
-    if (size == 0)
-        return NULL;
-    if (!heap_start)
-        heap_init();
-
     // Align size to 8 bytes
     size = (size + 7) & ~7;
+    if (size < HEAP_MIN_DATA)
+        size = HEAP_MIN_DATA;
+
+    uintptr_t data;
+    heap_block_t *block = find_free_block(size, alignment, &data);
 
-    // Find a free block
-    heap_block_t *block = find_free_block(size);
+    // Out of space: map more pages and retry
+    if (!block)
+    {
+        heap_grow(size + alignment);
+        block = find_free_block(size, alignment, &data);
+    }
 
     if (!block)
     {
@@ -158,132 +441,366 @@ void *kmalloc(size_t size)
         return NULL;
     }
 
-    // Split the block if it's too large
+    bin_remove(block);
+    block = split_front(block, data);
+
+    // Mark as used, then split the block if it's too large
+    block_set(block, block->size, 1);
     split_block(block, size);
 
-    // Mark as used
-    block->used = 1;
-    used_size += sizeof(heap_block_t) + block->size;
+    used_size += BLOCK_OVERHEAD + block->size;
+    if (used_size > peak_used)
+        peak_used = used_size;
 
     // Return pointer to data (after header)
     return (void *)((uint8_t *)block + sizeof(heap_block_t));
 }
 
-// Allocate aligned memory
-void *kmalloc_aligned(size_t size, size_t alignment)
+// Return a block to the free lists
+static void block_free(void *ptr)
 {
-    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    // Get block header (before the data pointer)
+    heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - sizeof(heap_block_t));
+
+    // Validate magic number and footer
+    if (block->magic != HEAP_MAGIC || block_footer(block)->tag != (block->size | block->used))
     {
-        return NULL; // Alignment must be power of 2
+        serial_print("kfree: Invalid pointer or corrupted heap! ptr=");
+        serial_print_hex((uint64_t)ptr);
+        serial_print("\n");
+        return;
     }
 
-    // Allocate extra space for alignment
-    size_t total_size = size + alignment;
-    void *ptr = kmalloc(total_size);
+    if (!block->used)
+    {
+        serial_print("kfree: Double free detected! ptr=");
+        serial_print_hex((uint64_t)ptr);
+        serial_print("\n");
+        return;
+    }
 
-    if (!ptr)
-        return NULL;
+    // Mark as free
+    block->used = 0;
+    used_size -= BLOCK_OVERHEAD + block->size;
+
+    // Merge with adjacent free blocks
+    merge_blocks(block);
+}
 
-    // Calculate aligned address
+// Map a request size to its size class, or -1 if it is too large
+static int slab_class_for(size_t size)
+{
+    if (size > SLAB_MAX_OBJECT)
+        return -1;
+
+    int cls = 0;
+    size_t class_size = 1u << SLAB_MIN_SHIFT;
+    while (class_size < size)
+    {
+        class_size <<= 1;
+        cls++;
+    }
+    return cls;
+}
+
+// Find the slab that owns `ptr`, or NULL if `ptr` is a block allocation
+static slab_t *slab_from_ptr(void *ptr)
+{
     uintptr_t addr = (uintptr_t)ptr;
-    uintptr_t aligned_addr = (addr + alignment - 1) & ~(alignment - 1);
+    slab_t *slab = (slab_t *)(addr & ~(uintptr_t)(SLAB_SIZE - 1));
+
+    if ((uintptr_t)slab == addr || (uintptr_t)slab < HEAP_START)
+        return NULL;
+    if (slab->magic != SLAB_MAGIC || slab->self != slab)
+        return NULL;
+    if (slab->cache < &slab_caches[0] || slab->cache >= &slab_caches[SLAB_CLASS_COUNT])
+        return NULL;
 
-    // Return the aligned address
-    // Note: kfree won't work correctly on this pointer, but for
-    // long-lived allocations like descriptor rings this is fine
-    return (void *)aligned_addr;
+    return slab;
 }
 
-// Allocate and zero memory
-void *kcalloc(size_t num, size_t size)
+static void slab_list_remove(slab_cache_t *cache, slab_t *slab)
 {
-    size_t total = num * size;
-    void *ptr = kmalloc(total);
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        cache->partial = slab->next;
 
-    if (ptr)
+    if (slab->next)
+        slab->next->prev = slab->prev;
+
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+static void slab_list_push(slab_cache_t *cache, slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if (cache->partial)
+        cache->partial->prev = slab;
+    cache->partial = slab;
+}
+
+// Carve a fresh slab for a size class
+static slab_t *slab_create(slab_cache_t *cache)
+{
+    slab_t *slab = (slab_t *)block_alloc(SLAB_SIZE, SLAB_SIZE);
+    if (!slab)
+        return NULL;
+
+    uint32_t obj_size = cache->object_size;
+    uintptr_t first = align_up((uintptr_t)slab + sizeof(slab_t), obj_size < 16 ? obj_size : 16);
+    uint32_t count = (uint32_t)(((uintptr_t)slab + SLAB_SIZE - first) / obj_size);
+
+    slab->magic = SLAB_MAGIC;
+    slab->self = slab;
+    slab->cache = cache;
+    slab->total_count = (uint16_t)count;
+    slab->free_count = (uint16_t)count;
+    slab->next = NULL;
+    slab->prev = NULL;
+
+    // Thread the free list front-to-back so allocations walk forward
+    slab_object_t *head = NULL;
+    for (uint32_t i = count; i > 0; i--)
     {
-        uint8_t *p = (uint8_t *)ptr;
-        for (size_t i = 0; i < total; i++)
+        slab_object_t *obj = (slab_object_t *)(first + (uintptr_t)(i - 1) * obj_size);
+        obj->next = head;
+        head = obj;
+    }
+    slab->free_list = head;
+
+    cache->slab_count++;
+    return slab;
+}
+
+// Release a slab back to the block allocator
+static void slab_destroy(slab_cache_t *cache, slab_t *slab)
+{
+    slab->magic = 0;
+    slab->self = NULL;
+    cache->slab_count--;
+    block_free(slab);
+}
+
+static void *slab_alloc(int cls)
+{
+    slab_cache_t *cache = &slab_caches[cls];
+    slab_t *slab = cache->partial;
+
+    if (!slab)
+    {
+        if (cache->spare)
         {
-            p[i] = 0;
+            slab = cache->spare;
+            cache->spare = NULL;
         }
+        else
+        {
+            slab = slab_create(cache);
+            if (!slab)
+                return NULL;
+        }
+        slab_list_push(cache, slab);
     }
 
-    return ptr;
+    slab_object_t *obj = slab->free_list;
+    slab->free_list = obj->next;
+    slab->free_count--;
+    cache->alloc_count++;
+
+    // Full slabs leave the partial list until an object comes back
+    if (slab->free_count == 0)
+        slab_list_remove(cache, slab);
+
+    return obj;
 }
 
-// Free memory
-void kfree(void *ptr)
+static void slab_free(slab_t *slab, void *ptr)
 {
-    if (!ptr)
-        return;
+    slab_cache_t *cache = slab->cache;
+    slab_object_t *obj = (slab_object_t *)ptr;
 
-    serial_print("kfree: ptr=");
-    serial_print_hex((uint64_t)ptr);
-    serial_print(" size=");
+    obj->next = slab->free_list;
+    slab->free_list = obj;
+    slab->free_count++;
+    cache->alloc_count--;
 
-    // Get block header (before the data pointer)
-    heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - sizeof(heap_block_t));
+    // Previously full: make it available again
+    if (slab->free_count == 1)
+        slab_list_push(cache, slab);
+
+    // Completely free: keep one spare per class, give the rest back
+    if (slab->free_count == slab->total_count)
+    {
+        slab_list_remove(cache, slab);
+        if (!cache->spare)
+            cache->spare = slab;
+        else
+            slab_destroy(cache, slab);
+    }
+}
 
-    // Validate magic number
+// Usable size of an allocation (class size for slab objects)
+static size_t alloc_size(void *ptr)
+{
+    slab_t *slab = slab_from_ptr(ptr);
+    if (slab)
+        return slab->cache->object_size;
+
+    heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - sizeof(heap_block_t));
     if (block->magic != HEAP_MAGIC)
+        return 0;
+    return block->size;
+}
+
+// Allocate memory (untraced)
+static void *heap_alloc(size_t size)
+{
+    if (size == 0)
+        return NULL;
+    if (!heap_start)
+        heap_init();
+
+    if (slab_enabled)
     {
-        serial_print("??? (INVALID)\n");
-        serial_print("kfree: Invalid pointer or corrupted heap!\n");
-        return;
+        int cls = slab_class_for(size);
+        if (cls >= 0)
+        {
+            void *ptr = slab_alloc(cls);
+            if (ptr)
+                return ptr;
+        }
     }
 
-    serial_print_dec(block->size);
-    serial_print(" used=");
-    serial_print_dec(block->used);
-    serial_print("\n");
+    return block_alloc(size, 8);
+}
+
+// Free memory (untraced)
+static void heap_free(void *ptr)
+{
+    if (!ptr)
+        return;
 
-    if (!block->used)
+    slab_t *slab = slab_from_ptr(ptr);
+    if (slab)
     {
-        serial_print("kfree: Double free detected! ptr=");
-        serial_print_hex((uint64_t)ptr);
-        serial_print("\n");
+        slab_free(slab, ptr);
         return;
     }
 
-    // Mark as free
-    block->used = 0;
-    used_size -= sizeof(heap_block_t) + block->size;
+    block_free(ptr);
+}
 
-    // Merge with adjacent free blocks
-    merge_blocks(block);
+// Allocate memory
+void *kmalloc(size_t size)
+{
+    void *ptr = heap_alloc(size);
+    if (heap_trace_enabled)
+        heap_trace_alloc(__builtin_return_address(0), ptr, size);
+    return ptr;
+}
+
+// Allocate aligned memory (untraced)
+static void *heap_alloc_aligned(size_t size, size_t alignment)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return NULL; // Alignment must be power of 2
+    }
+    if (size == 0)
+        return NULL;
+    if (!heap_start)
+        heap_init();
+
+    // Slab objects are naturally aligned to min(class size, 16)
+    int cls = slab_class_for(size);
+    if (slab_enabled && cls >= 0 && alignment <= 16 &&
+        alignment <= slab_caches[cls].object_size)
+    {
+        void *ptr = slab_alloc(cls);
+        if (ptr)
+            return ptr;
+    }
+
+    // The block allocator places the header in front of the aligned
+    // address, so the result can be passed to kfree
+    return block_alloc(size, alignment < 8 ? 8 : alignment);
+}
+
+// Allocate aligned memory
+void *kmalloc_aligned(size_t size, size_t alignment)
+{
+    void *ptr = heap_alloc_aligned(size, alignment);
+    if (heap_trace_enabled)
+        heap_trace_alloc(__builtin_return_address(0), ptr, size);
+    return ptr;
+}
+
+// Allocate and zero memory
+void *kcalloc(size_t num, size_t size)
+{
+    size_t total = num * size;
+    void *ptr = heap_alloc(total);
+    if (heap_trace_enabled)
+        heap_trace_alloc(__builtin_return_address(0), ptr, total);
+
+    if (ptr)
+    {
+        uint8_t *p = (uint8_t *)ptr;
+        for (size_t i = 0; i < total; i++)
+        {
+            p[i] = 0;
+        }
+    }
+
+    return ptr;
+}
+
+// Free memory
+void kfree(void *ptr)
+{
+    if (heap_trace_enabled && ptr)
+        heap_trace_free(__builtin_return_address(0), ptr);
+    heap_free(ptr);
 }
 
 // Reallocate memory
 void *krealloc(void *ptr, size_t size)
 {
+    void *caller = __builtin_return_address(0);
+
     if (!ptr)
     {
-        return kmalloc(size);
+        void *new_ptr = heap_alloc(size);
+        if (heap_trace_enabled)
+            heap_trace_alloc(caller, new_ptr, size);
+        return new_ptr;
     }
 
     if (size == 0)
     {
-        kfree(ptr);
+        if (heap_trace_enabled)
+            heap_trace_free(caller, ptr);
+        heap_free(ptr);
         return NULL;
     }
 
-    // Get current block
-    heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - sizeof(heap_block_t));
-
-    if (block->magic != HEAP_MAGIC)
+    size_t old_size = alloc_size(ptr);
+    if (old_size == 0)
     {
         return NULL;
     }
 
-    // If new size fits in current block, just return the same pointer
-    if (block->size >= size)
+    // If new size fits in current allocation, just return the same pointer
+    if (old_size >= size)
     {
         return ptr;
     }
 
     // Allocate new block
-    void *new_ptr = kmalloc(size);
+    void *new_ptr = heap_alloc(size);
     if (!new_ptr)
     {
         return NULL;
@@ -292,7 +809,7 @@ void *krealloc(void *ptr, size_t size)
     // Copy old data
     uint8_t *src = (uint8_t *)ptr;
     uint8_t *dst = (uint8_t *)new_ptr;
-    size_t copy_size = (block->size < size) ? block->size : size;
+    size_t copy_size = (old_size < size) ? old_size : size;
 
     for (size_t i = 0; i < copy_size; i++)
     {
@@ -300,7 +817,12 @@ void *krealloc(void *ptr, size_t size)
     }
 
     // Free old block
-    kfree(ptr);
+    if (heap_trace_enabled)
+    {
+        heap_trace_free(caller, ptr);
+        heap_trace_alloc(caller, new_ptr, size);
+    }
+    heap_free(ptr);
 
     return new_ptr;
 }
@@ -314,4 +836,123 @@ void heap_stats(uint32_t *total, uint32_t *used, uint32_t *free)
         *used = used_size;
     if (free)
         *free = total_size - used_size;
-}
\ No newline at end of file
+}
+
+// High-water mark of heap usage and the current growth limit
+void heap_growth_stats(uint32_t *peak, uint32_t *limit)
+{
+    if (peak)
+        *peak = peak_used;
+    if (limit)
+        *limit = (uint32_t)(heap_limit ? heap_limit : HEAP_SIZE);
+}
+
+// First address past the initial heap region (physical memory above it is free)
+uintptr_t heap_region_end(void)
+{
+    return HEAP_START + HEAP_SIZE;
+}
+
+// Fragmentation report, computed from the free bins only
+void heap_frag_stats(heap_frag_info_t *info)
+{
+    info->free_blocks = 0;
+    info->free_bytes = 0;
+    info->largest_free = 0;
+
+    for (int i = 0; i < HEAP_BIN_COUNT; i++)
+    {
+        info->bin_counts[i] = 0;
+        for (heap_block_t *block = bins[i]; block; block = block->next)
+        {
+            info->bin_counts[i]++;
+            info->free_blocks++;
+            info->free_bytes += (uint32_t)block->size;
+            if (block->size > info->largest_free)
+                info->largest_free = (uint32_t)block->size;
+        }
+    }
+}
+
+// Get per-class slab statistics
+int heap_slab_stats(heap_slab_info_t *info, int max)
+{
+    int n = max < SLAB_CLASS_COUNT ? max : SLAB_CLASS_COUNT;
+    for (int i = 0; i < n; i++)
+    {
+        info[i].object_size = slab_caches[i].object_size;
+        info[i].slab_count = slab_caches[i].slab_count;
+        info[i].objects_in_use = slab_caches[i].alloc_count;
+    }
+    return n;
+}
+
+// Microbenchmark: alloc/free latency through the block list vs. the slab layer
+#define BENCH_BATCH 64
+#define BENCH_ROUNDS 32
+
+static uint64_t bench_run(size_t size, int use_slab)
+{
+    void *ptrs[BENCH_BATCH];
+    uint8_t saved = slab_enabled;
+    slab_enabled = (uint8_t)use_slab;
+
+    uint64_t start = timing_rdtsc();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        for (int i = 0; i < BENCH_BATCH; i++)
+            ptrs[i] = heap_alloc(size);
+        for (int i = 0; i < BENCH_BATCH; i++)
+            heap_free(ptrs[i]);
+    }
+    uint64_t cycles = timing_rdtsc() - start;
+
+    slab_enabled = saved;
+    return cycles / (BENCH_ROUNDS * BENCH_BATCH);
+}
+
+void heap_benchmark(heap_bench_result_t *results, int max)
+{
+    static const uint32_t sizes[HEAP_BENCH_SIZES] = {16, 64, 256, 1024, 2048};
+
+    if (!heap_start)
+        heap_init();
+
+    // Pin a few long-lived blocks so the block list is not trivially short
+    void *pins[BENCH_BATCH];
+    uint8_t saved = slab_enabled;
+    slab_enabled = 0;
+    for (int i = 0; i < BENCH_BATCH; i++)
+        pins[i] = heap_alloc(96);
+    slab_enabled = saved;
+
+    int n = max < HEAP_BENCH_SIZES ? max : HEAP_BENCH_SIZES;
+    for (int i = 0; i < n; i++)
+    {
+        results[i].size = sizes[i];
+        results[i].block_cycles = bench_run(sizes[i], 0);
+        results[i].slab_cycles = bench_run(sizes[i], 1);
+    }
+
+    for (int i = 0; i < BENCH_BATCH; i++)
+        heap_free(pins[i]);
+}
+
+// Run the benchmark and log it to serial (called once at boot)
+void heap_benchmark_boot(void)
+{
+    heap_bench_result_t results[HEAP_BENCH_SIZES];
+    heap_benchmark(results, HEAP_BENCH_SIZES);
+
+    serial_print("Heap benchmark (cycles per alloc+free, block -> slab):\n");
+    for (int i = 0; i < HEAP_BENCH_SIZES; i++)
+    {
+        serial_print("  ");
+        serial_print_dec(results[i].size);
+        serial_print(" B: ");
+        serial_print_dec((uint32_t)results[i].block_cycles);
+        serial_print(" -> ");
+        serial_print_dec((uint32_t)results[i].slab_cycles);
+        serial_print("\n");
+    }
+}
@@ -0,0 +1,247 @@
+#include <memory/heap_trace.h>
+#include <utils/timing.h>
+
+uint8_t heap_trace_enabled = 0;
+
+static heap_trace_event_t ring[HEAP_TRACE_RING];
+static uint32_t ring_head = 0;   // Next slot to write
+static uint32_t event_count = 0; // Total events since start
+static uint32_t dropped = 0;
+
+static heap_trace_site_t sites[HEAP_TRACE_SITES];
+static int site_count = 0;
+
+// Open-addressed ptr -> (site, size) map for outstanding allocations
+typedef struct
+{
+    void *ptr;
+    uint32_t size;
+    int16_t site;
+} live_entry_t;
+
+static live_entry_t live[HEAP_TRACE_LIVE];
+
+static uint32_t live_hash(void *ptr)
+{
+    uint64_t x = (uint64_t)(uintptr_t)ptr >> 4;
+    x *= 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(x >> 32) & (HEAP_TRACE_LIVE - 1);
+}
+
+static void live_insert(void *ptr, uint32_t size, int site)
+{
+    uint32_t i = live_hash(ptr);
+    for (uint32_t n = 0; n < HEAP_TRACE_LIVE; n++)
+    {
+        if (!live[i].ptr)
+        {
+            live[i].ptr = ptr;
+            live[i].size = size;
+            live[i].site = (int16_t)site;
+            return;
+        }
+        i = (i + 1) & (HEAP_TRACE_LIVE - 1);
+    }
+    dropped++;
+}
+
+// Remove `ptr`, shifting later entries back so probes stay unbroken
+static int live_remove(void *ptr, uint32_t *size)
+{
+    uint32_t i = live_hash(ptr);
+    for (uint32_t n = 0; n < HEAP_TRACE_LIVE && live[i].ptr; n++)
+    {
+        if (live[i].ptr == ptr)
+        {
+            int site = live[i].site;
+            *size = live[i].size;
+
+            uint32_t hole = i;
+            uint32_t j = (i + 1) & (HEAP_TRACE_LIVE - 1);
+            while (live[j].ptr)
+            {
+                uint32_t home = live_hash(live[j].ptr);
+                // Move j into the hole unless its home lies in (hole, j]
+                if (((j - home) & (HEAP_TRACE_LIVE - 1)) >= ((j - hole) & (HEAP_TRACE_LIVE - 1)))
+                {
+                    live[hole] = live[j];
+                    hole = j;
+                }
+                j = (j + 1) & (HEAP_TRACE_LIVE - 1);
+            }
+            live[hole].ptr = 0;
+            return site;
+        }
+        i = (i + 1) & (HEAP_TRACE_LIVE - 1);
+    }
+    return -1;
+}
+
+static int find_site(void *caller)
+{
+    for (int i = 0; i < site_count; i++)
+    {
+        if (sites[i].caller == caller)
+            return i;
+    }
+
+    if (site_count >= HEAP_TRACE_SITES)
+        return -1;
+
+    heap_trace_site_t *site = &sites[site_count];
+    site->caller = caller;
+    site->allocs = 0;
+    site->frees = 0;
+    site->bytes = 0;
+    site->live_bytes = 0;
+    return site_count++;
+}
+
+static void record(void *caller, void *ptr, uint32_t size, uint8_t op)
+{
+    heap_trace_event_t *ev = &ring[ring_head];
+    ev->caller = caller;
+    ev->ptr = ptr;
+    ev->size = size;
+    ev->op = op;
+    ev->tsc = timing_rdtsc();
+
+    ring_head = (ring_head + 1) % HEAP_TRACE_RING;
+    event_count++;
+}
+
+void heap_trace_start(void)
+{
+    heap_trace_enabled = 0;
+
+    for (int i = 0; i < HEAP_TRACE_LIVE; i++)
+        live[i].ptr = 0;
+    site_count = 0;
+    ring_head = 0;
+    event_count = 0;
+    dropped = 0;
+
+    heap_trace_enabled = 1;
+}
+
+void heap_trace_stop(void)
+{
+    heap_trace_enabled = 0;
+}
+
+void heap_trace_alloc(void *caller, void *ptr, size_t size)
+{
+    if (!ptr)
+        return;
+
+    record(caller, ptr, (uint32_t)size, HEAP_TRACE_ALLOC);
+
+    int site = find_site(caller);
+    if (site < 0)
+    {
+        dropped++;
+        return;
+    }
+
+    sites[site].allocs++;
+    sites[site].bytes += size;
+    sites[site].live_bytes += size;
+    live_insert(ptr, (uint32_t)size, site);
+}
+
+void heap_trace_free(void *caller, void *ptr)
+{
+    uint32_t size = 0;
+    int site = live_remove(ptr, &size);
+
+    record(caller, ptr, size, HEAP_TRACE_FREE);
+
+    // Frees of memory allocated before tracing started are not attributed
+    if (site < 0)
+        return;
+
+    sites[site].frees++;
+    sites[site].live_bytes -= size;
+}
+
+int heap_trace_top(heap_trace_site_t *out, int max, int by_count)
+{
+    int n = 0;
+
+    // Insertion sort into the caller's buffer (site_count is small)
+    for (int i = 0; i < site_count; i++)
+    {
+        uint64_t key = by_count ? sites[i].allocs : sites[i].bytes;
+        int pos = n;
+        while (pos > 0)
+        {
+            uint64_t prev = by_count ? out[pos - 1].allocs : out[pos - 1].bytes;
+            if (prev >= key)
+                break;
+            pos--;
+        }
+        if (pos >= max)
+            continue;
+
+        int last = n < max ? n : max - 1;
+        for (int j = last; j > pos; j--)
+            out[j] = out[j - 1];
+        out[pos] = sites[i];
+        if (n < max)
+            n++;
+    }
+
+    return n;
+}
+
+uint64_t heap_trace_rate_histogram(uint32_t *buckets, int count)
+{
+    for (int i = 0; i < count; i++)
+        buckets[i] = 0;
+
+    uint32_t stored = event_count < HEAP_TRACE_RING ? event_count : HEAP_TRACE_RING;
+    if (stored < 2 || count <= 0)
+        return 0;
+
+    uint32_t oldest = (ring_head + HEAP_TRACE_RING - stored) % HEAP_TRACE_RING;
+    uint32_t newest = (ring_head + HEAP_TRACE_RING - 1) % HEAP_TRACE_RING;
+    uint64_t start = ring[oldest].tsc;
+    uint64_t span = ring[newest].tsc - start + 1;
+
+    for (uint32_t n = 0; n < stored; n++)
+    {
+        heap_trace_event_t *ev = &ring[(oldest + n) % HEAP_TRACE_RING];
+        if (ev->op != HEAP_TRACE_ALLOC)
+            continue;
+        uint64_t slot = ((ev->tsc - start) * (uint64_t)count) / span;
+        buckets[slot < (uint64_t)count ? slot : (uint64_t)count - 1]++;
+    }
+
+    return timing_cycles_to_us(span / count);
+}
+
+void heap_trace_size_histogram(uint32_t *buckets, int count)
+{
+    for (int i = 0; i < count; i++)
+        buckets[i] = 0;
+
+    uint32_t stored = event_count < HEAP_TRACE_RING ? event_count : HEAP_TRACE_RING;
+    for (uint32_t n = 0; n < stored; n++)
+    {
+        heap_trace_event_t *ev = &ring[n];
+        if (ev->op != HEAP_TRACE_ALLOC || ev->size == 0)
+            continue;
+        int bucket = 31 - __builtin_clz(ev->size);
+        buckets[bucket < count ? bucket : count - 1]++;
+    }
+}
+
+uint32_t heap_trace_event_count(void)
+{
+    return event_count;
+}
+
+uint32_t heap_trace_dropped(void)
+{
+    return dropped;
+}
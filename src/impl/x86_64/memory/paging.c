@@ -1,5 +1,6 @@
 #include <memory/paging.h>
 #include <memory/heap.h>
+#include <memory/buddy.h>
 #include <shell/shell.h>
 #include <stdint.h>
 
@@ -9,7 +10,11 @@ extern uint64_t total_physical_memory;
 // Page table entry flags
 #define PTE_PRESENT  (1ULL << 0)
 #define PTE_WRITABLE (1ULL << 1)
+#define PTE_PWT      (1ULL << 3)
+#define PTE_PCD      (1ULL << 4)
 #define PTE_HUGE     (1ULL << 7)  // 2MB page (used in PD entries)
+#define PTE_PAT_HUGE (1ULL << 12) // PAT index bit 2 in 2MB entries
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
 
 // Each PD table covers 1GB (512 entries * 2MB huge pages)
 #define GB (1ULL << 30)
@@ -18,14 +23,49 @@ extern uint64_t total_physical_memory;
 #define ENTRIES_PER_TABLE 512
 #define MIN_MAPPED_BYTES (4ULL * GB)  // Always map at least 4GB for MMIO/framebuffer
 
+// PAT entry 4 is reprogrammed from WB to write-combining; it is selected
+// by PAT=1, PCD=0, PWT=0. Entries 0-3 keep their power-on meaning, so
+// existing mappings are unaffected.
+#define MSR_IA32_PAT 0x277
+#define PAT_TYPE_WC 0x01
+#define PAT_WC_INDEX 4
+
+static int pat_wc_available = 0;
 static uint32_t num_pd_tables = 0;
 static uint32_t num_pdpt_tables = 0;
 static uint32_t total_tables = 0;
+static uint64_t mapped_bytes = MIN_MAPPED_BYTES; // Boot tables map the first 4GB
+
+static void paging_init_pat(void)
+{
+    uint32_t a, b, c, d;
+    __asm__ volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1), "c"(0));
+    if (!(d & (1 << 16)))
+    {
+        serial_print("Paging: no PAT support, framebuffer stays uncached\n");
+        return;
+    }
+
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_IA32_PAT));
+    uint64_t pat = ((uint64_t)hi << 32) | lo;
+    pat &= ~(0xFFULL << (PAT_WC_INDEX * 8));
+    pat |= (uint64_t)PAT_TYPE_WC << (PAT_WC_INDEX * 8);
+
+    // Caches must be flushed around a PAT change
+    __asm__ volatile("wbinvd" ::: "memory");
+    __asm__ volatile("wrmsr" ::"c"(MSR_IA32_PAT), "a"((uint32_t)pat), "d"((uint32_t)(pat >> 32)));
+    __asm__ volatile("mov %%cr3, %%rax; mov %%rax, %%cr3" ::: "rax", "memory");
+
+    pat_wc_available = 1;
+}
 
 void paging_init(void)
 {
     uint64_t total_mem = total_physical_memory;
 
+    paging_init_pat();
+
     serial_print("Paging: detected ");
     serial_print_dec((uint32_t)(total_mem / MB));
     serial_print(" MB physical memory\n");
@@ -108,7 +148,135 @@ void paging_init(void)
     uint64_t pml4_addr = (uint64_t)(uintptr_t)pml4;
     __asm__ volatile("mov %0, %%cr3" : : "r"(pml4_addr) : "memory");
 
+    mapped_bytes = (uint64_t)num_pd_tables * GB;
+
     serial_print("Paging: page tables allocated and loaded into CR3\n");
+
+    // Let the kernel heap grow into up to half of physical memory
+    heap_set_growth_limit(total_mem / 2);
+}
+
+static uint64_t *current_pml4(void)
+{
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    return (uint64_t *)(uintptr_t)(cr3 & PTE_ADDR_MASK);
+}
+
+// Return the next-level table for `entry`, allocating a zeroed page if absent
+static uint64_t *get_or_create_table(uint64_t *entry)
+{
+    if (*entry & PTE_PRESENT)
+        return (uint64_t *)(uintptr_t)(*entry & PTE_ADDR_MASK);
+
+    uint64_t *table = (uint64_t *)buddy_alloc(0);
+    if (!table)
+        return 0;
+    for (int i = 0; i < ENTRIES_PER_TABLE; i++)
+        table[i] = 0;
+
+    *entry = (uint64_t)(uintptr_t)table | PTE_PRESENT | PTE_WRITABLE;
+    return table;
+}
+
+int paging_map_2mb(uint64_t virt, uint64_t phys)
+{
+    if ((virt | phys) & (2 * MB - 1))
+        return -1;
+
+    uint64_t *pml4 = current_pml4();
+    uint64_t *pdpt = get_or_create_table(&pml4[(virt >> 39) & 0x1FF]);
+    if (!pdpt)
+        return -1;
+
+    uint64_t *pdpt_entry = &pdpt[(virt >> 30) & 0x1FF];
+    if (*pdpt_entry & PTE_HUGE)
+        return -1;
+
+    uint64_t *pd = get_or_create_table(pdpt_entry);
+    if (!pd)
+        return -1;
+
+    uint64_t *pd_entry = &pd[(virt >> 21) & 0x1FF];
+    if (*pd_entry & PTE_PRESENT)
+        return -1;
+
+    *pd_entry = phys | PTE_PRESENT | PTE_WRITABLE | PTE_HUGE;
+    __asm__ volatile("invlpg (%0)" : : "r"((uintptr_t)virt) : "memory");
+
+    return 0;
+}
+
+int paging_set_write_combining(uint64_t phys, uint64_t size)
+{
+    if (!pat_wc_available || size == 0)
+        return -1;
+
+    // Whole 2MB pages only; the boot identity map has no smaller pages
+    uint64_t start = phys & ~(2 * MB - 1);
+    uint64_t end = (phys + size + 2 * MB - 1) & ~(2 * MB - 1);
+    if (end > mapped_bytes)
+        return -1;
+
+    uint64_t *pml4 = current_pml4();
+    for (uint64_t addr = start; addr < end; addr += 2 * MB)
+    {
+        uint64_t entry = pml4[(addr >> 39) & 0x1FF];
+        if (!(entry & PTE_PRESENT))
+            return -1;
+
+        uint64_t *pdpt = (uint64_t *)(uintptr_t)(entry & PTE_ADDR_MASK);
+        entry = pdpt[(addr >> 30) & 0x1FF];
+        if (!(entry & PTE_PRESENT) || (entry & PTE_HUGE))
+            return -1;
+
+        uint64_t *pd = (uint64_t *)(uintptr_t)(entry & PTE_ADDR_MASK);
+        uint64_t *pd_entry = &pd[(addr >> 21) & 0x1FF];
+        if (!(*pd_entry & PTE_PRESENT) || !(*pd_entry & PTE_HUGE))
+            return -1;
+
+        *pd_entry = (*pd_entry & ~(PTE_PWT | PTE_PCD)) | PTE_PAT_HUGE;
+    }
+
+    // Drop stale cache lines and TLB entries for the old memory type
+    __asm__ volatile("wbinvd" ::: "memory");
+    __asm__ volatile("mov %%cr3, %%rax; mov %%rax, %%cr3" ::: "rax", "memory");
+
+    return 0;
+}
+
+uint64_t paging_virt_to_phys(const void *addr)
+{
+    uint64_t virt = (uint64_t)(uintptr_t)addr;
+
+    // Everything below the mapped size is identity mapped
+    if (virt < mapped_bytes)
+        return virt;
+
+    uint64_t *pml4 = current_pml4();
+    uint64_t entry = pml4[(virt >> 39) & 0x1FF];
+    if (!(entry & PTE_PRESENT))
+        return 0;
+
+    uint64_t *pdpt = (uint64_t *)(uintptr_t)(entry & PTE_ADDR_MASK);
+    entry = pdpt[(virt >> 30) & 0x1FF];
+    if (!(entry & PTE_PRESENT))
+        return 0;
+    if (entry & PTE_HUGE)
+        return (entry & PTE_ADDR_MASK & ~(GB - 1)) | (virt & (GB - 1));
+
+    uint64_t *pd = (uint64_t *)(uintptr_t)(entry & PTE_ADDR_MASK);
+    entry = pd[(virt >> 21) & 0x1FF];
+    if (!(entry & PTE_PRESENT))
+        return 0;
+    if (entry & PTE_HUGE)
+        return (entry & PTE_ADDR_MASK & ~(2 * MB - 1)) | (virt & (2 * MB - 1));
+
+    uint64_t *pt = (uint64_t *)(uintptr_t)(entry & PTE_ADDR_MASK);
+    entry = pt[(virt >> 12) & 0x1FF];
+    if (!(entry & PTE_PRESENT))
+        return 0;
+    return (entry & PTE_ADDR_MASK) | (virt & 0xFFF);
 }
 
 uint64_t paging_get_total_memory(void)
@@ -116,6 +284,11 @@ uint64_t paging_get_total_memory(void)
     return total_physical_memory;
 }
 
+uint64_t paging_get_mapped_size(void)
+{
+    return mapped_bytes;
+}
+
 uint32_t paging_get_table_count(void)
 {
     return total_tables;
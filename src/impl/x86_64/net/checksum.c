@@ -0,0 +1,282 @@
+#include "net/checksum.h"
+#include "net/checksum_simd.h"
+#include "memory/buddy.h"
+#include "utils/fpu.h"
+#include "utils/timing.h"
+#include "shell/shell.h"
+
+// Below this size the vector kernels lose to add-with-carry: each call
+// opens an FPU section, and the first one after a switch traps (#NM)
+#define CHECKSUM_SIMD_MIN 2048
+
+#define CHECKSUM_BENCH_MAX (2 * 1024 * 1024)
+#define CHECKSUM_BENCH_BYTES (32 * 1024 * 1024)
+
+typedef uint64_t (*checksum_simd_fn)(const void *data, size_t blocks);
+
+static checksum_simd_fn simd_sum = NULL;
+static const char *strategy = "adc64";
+
+// Unaligned 64-bit load that may alias any buffer
+typedef uint64_t __attribute__((may_alias, aligned(1))) checksum_word_t;
+
+// 64-bit one's complement add (end-around carry)
+static inline uint64_t add64(uint64_t a, uint64_t b) {
+    a += b;
+    return a + (a < b);
+}
+
+static inline uint32_t fold64(uint64_t sum) {
+    uint32_t lo = (uint32_t)sum;
+    uint32_t hi = (uint32_t)(sum >> 32);
+    lo += hi;
+    return lo + (lo < hi);
+}
+
+// Sum 64 bits at a time on one add-with-carry chain. Bytes past the last
+// full word are zero-padded, so an odd final byte lands in the low half
+// of its 16-bit word as in the byte-pair loop.
+static uint64_t checksum_sum_adc(const uint8_t *p, size_t len, uint64_t sum) {
+    while (len >= 64) {
+        __asm__("addq 0(%[p]), %[s]\n\t"
+                "adcq 8(%[p]), %[s]\n\t"
+                "adcq 16(%[p]), %[s]\n\t"
+                "adcq 24(%[p]), %[s]\n\t"
+                "adcq 32(%[p]), %[s]\n\t"
+                "adcq 40(%[p]), %[s]\n\t"
+                "adcq 48(%[p]), %[s]\n\t"
+                "adcq 56(%[p]), %[s]\n\t"
+                "adcq $0, %[s]"
+                : [s] "+r"(sum)
+                : [p] "r"(p), "m"(*(const uint8_t(*)[64])p)
+                : "cc");
+        p += 64;
+        len -= 64;
+    }
+
+    while (len >= 8) {
+        sum = add64(sum, *(const checksum_word_t *)p);
+        p += 8;
+        len -= 8;
+    }
+
+    if (len > 0) {
+        uint64_t tail = 0;
+        for (size_t i = 0; i < len; i++) {
+            tail |= (uint64_t)p[i] << (i * 8);
+        }
+        sum = add64(sum, tail);
+    }
+
+    return sum;
+}
+
+static uint32_t checksum_partial_with(checksum_simd_fn simd, const void *data, size_t len,
+                                      uint32_t sum) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t total = sum;
+
+    if (simd) {
+        size_t blocks = len / CHECKSUM_SIMD_BLOCK;
+        total = add64(total, simd(p, blocks));
+        p += blocks * CHECKSUM_SIMD_BLOCK;
+        len -= blocks * CHECKSUM_SIMD_BLOCK;
+    }
+
+    return fold64(checksum_sum_adc(p, len, total));
+}
+
+uint32_t checksum_partial(const void *data, size_t len, uint32_t sum) {
+    return checksum_partial_with(len >= CHECKSUM_SIMD_MIN ? simd_sum : NULL, data, len, sum);
+}
+
+uint32_t checksum_pseudo(uint32_t src_ip, uint32_t dest_ip, uint8_t protocol, size_t length) {
+    // Protocol and length are big-endian 16-bit words: swap by hand
+    uint16_t proto_be = (uint16_t)protocol << 8;
+    uint16_t len_be = (uint16_t)(((length & 0xFF) << 8) | ((length >> 8) & 0xFF));
+    return fold64((uint64_t)src_ip + dest_ip + proto_be + len_be);
+}
+
+uint16_t checksum_fold(uint32_t sum) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+// RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m')
+uint16_t checksum_update16(uint16_t check, uint16_t old_val, uint16_t new_val) {
+    uint32_t sum = (uint16_t)~check + (uint16_t)~old_val + new_val;
+    return checksum_fold(sum);
+}
+
+uint16_t checksum_update32(uint16_t check, uint32_t old_val, uint32_t new_val) {
+    uint32_t sum = (uint16_t)~check;
+    sum += (uint16_t)~old_val + (uint16_t)~(old_val >> 16);
+    sum += (new_val & 0xFFFF) + (new_val >> 16);
+    return checksum_fold(sum);
+}
+
+const char *checksum_strategy(void) {
+    return strategy;
+}
+
+// The byte-pair loop the stack used before this module
+static uint16_t checksum_reference(const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t sum = 0;
+
+    while (len > 1) {
+        sum += *(const uint16_t *)p;
+        p += 2;
+        len -= 2;
+    }
+    if (len > 0) {
+        sum += *p;
+    }
+
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return ~sum;
+}
+
+static uint32_t selftest_seed;
+
+static uint32_t selftest_rand(void) {
+    selftest_seed = selftest_seed * 1103515245 + 12345;
+    return selftest_seed >> 8;
+}
+
+static int checksum_check_kernel(checksum_simd_fn simd, const uint8_t *buf, size_t max) {
+    static const uint32_t big[] = { 1500, 2047, 2048, 4095, 9001, 65535 };
+    int errors = 0;
+
+    for (size_t off = 0; off < 8; off++) {
+        for (size_t len = 0; len <= 300 && off + len <= max; len++) {
+            if (checksum_fold(checksum_partial_with(simd, buf + off, len, 0)) !=
+                checksum_reference(buf + off, len)) errors++;
+        }
+        for (size_t i = 0; i < sizeof(big) / sizeof(big[0]); i++) {
+            if (off + big[i] > max) continue;
+            if (checksum_fold(checksum_partial_with(simd, buf + off, big[i], 0)) !=
+                checksum_reference(buf + off, big[i])) errors++;
+        }
+    }
+
+    return errors;
+}
+
+// Rewrite random 16-bit and 32-bit fields of a 20-byte header and check
+// the incremental result against recomputing from scratch
+static int checksum_check_update(void) {
+    uint16_t hdr[10];
+    int errors = 0;
+
+    for (int trial = 0; trial < 1000; trial++) {
+        for (int i = 0; i < 10; i++) hdr[i] = (uint16_t)selftest_rand();
+        hdr[5] = 0;
+        hdr[5] = checksum_reference(hdr, sizeof(hdr));
+
+        int w = selftest_rand() % 9;
+        if (w == 5) w = 4;
+        uint16_t old16 = hdr[w];
+        hdr[w] = (uint16_t)selftest_rand();
+        uint16_t check = checksum_update16(hdr[5], old16, hdr[w]);
+        hdr[5] = 0;
+        if (check != checksum_reference(hdr, sizeof(hdr))) errors++;
+        hdr[5] = check;
+
+        // 32-bit field at an even word offset away from the checksum
+        w = (selftest_rand() % 2) ? 6 : 2;
+        uint32_t old32 = hdr[w] | ((uint32_t)hdr[w + 1] << 16);
+        uint32_t new32 = selftest_rand() ^ (selftest_rand() << 16);
+        hdr[w] = (uint16_t)new32;
+        hdr[w + 1] = (uint16_t)(new32 >> 16);
+        check = checksum_update32(hdr[5], old32, new32);
+        hdr[5] = 0;
+        if (check != checksum_reference(hdr, sizeof(hdr))) errors++;
+    }
+
+    return errors;
+}
+
+int checksum_selftest(void) {
+    const size_t size = 65536 + 8;
+    uint8_t *buf = (uint8_t *)kmalloc_pages(size);
+    if (!buf) return -1;
+
+    selftest_seed = 0x1071;
+    for (size_t i = 0; i < size; i++) buf[i] = (uint8_t)selftest_rand();
+    // Runs of 0xFF push the wide sums through every carry
+    for (size_t i = 4096; i < 12288; i++) buf[i] = 0xFF;
+
+    uint32_t features = fpu_features();
+    int errors = checksum_check_kernel(NULL, buf, size);
+    if (features & FPU_FEATURE_SSE2) errors += checksum_check_kernel(checksum_sum_sse2, buf, size);
+    if (features & FPU_FEATURE_AVX2) errors += checksum_check_kernel(checksum_sum_avx2, buf, size);
+    errors += checksum_check_update();
+
+    kfree_pages(buf);
+    return errors;
+}
+
+void checksum_init(void) {
+    uint32_t features = fpu_features();
+    simd_sum = NULL;
+    strategy = "adc64";
+    if (features & FPU_FEATURE_AVX2) {
+        simd_sum = checksum_sum_avx2;
+        strategy = "adc64+avx2";
+    } else if (features & FPU_FEATURE_SSE2) {
+        simd_sum = checksum_sum_sse2;
+        strategy = "adc64+sse2";
+    }
+
+    int errors = checksum_selftest();
+    if (errors != 0) {
+        // Keep only the portable path if anything disagreed
+        simd_sum = NULL;
+        strategy = "adc64";
+    }
+
+    serial_print("Checksum: ");
+    serial_print(strategy);
+    serial_print(errors == 0 ? ", self-test passed\n" : ", self-test FAILED\n");
+}
+
+static uint64_t checksum_bench_run(int kind, const uint8_t *buf, uint32_t size, uint32_t iterations) {
+    volatile uint32_t sink = 0;
+    uint64_t start = timing_rdtsc();
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (kind == 0) sink = checksum_reference(buf, size);
+        else if (kind == 1) sink = checksum_partial_with(NULL, buf, size, 0);
+        else sink = checksum_partial_with(simd_sum, buf, size, 0);
+    }
+    (void)sink;
+    return timing_rdtsc() - start;
+}
+
+int checksum_benchmark(checksum_bench_result_t *results, int count) {
+    uint8_t *buf = (uint8_t *)kmalloc_pages(CHECKSUM_BENCH_MAX);
+    if (!buf) return 0;
+
+    for (uint32_t i = 0; i < CHECKSUM_BENCH_MAX; i++) buf[i] = (uint8_t)(i * 31 + 7);
+
+    int n = 0;
+    for (uint32_t size = 64; size <= CHECKSUM_BENCH_MAX && n < count; size *= 8) {
+        uint32_t iterations = CHECKSUM_BENCH_BYTES / size;
+        uint64_t bytes = (uint64_t)iterations * size;
+
+        results[n].size = size;
+        results[n].ref_mbps = timing_mb_per_sec(bytes, checksum_bench_run(0, buf, size, iterations));
+        results[n].scalar_mbps = timing_mb_per_sec(bytes, checksum_bench_run(1, buf, size, iterations));
+        // Forced on at every size to show where the FPU section pays off
+        results[n].simd_mbps = simd_sum ?
+            timing_mb_per_sec(bytes, checksum_bench_run(2, buf, size, iterations)) : 0;
+        n++;
+    }
+
+    kfree_pages(buf);
+    return n;
+}
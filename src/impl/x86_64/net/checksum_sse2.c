@@ -0,0 +1,31 @@
+#include "net/checksum_simd.h"
+#include "utils/fpu.h"
+#include <emmintrin.h>
+
+// Widen each 32-bit word into a 64-bit lane and add; the lanes cannot
+// overflow for any buffer that fits in memory
+static __attribute__((noinline)) uint64_t checksum_blocks_sse2(const uint8_t *p, size_t blocks) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero;
+    __m128i acc1 = zero;
+
+    for (size_t i = 0; i < blocks; i++) {
+        for (int j = 0; j < CHECKSUM_SIMD_BLOCK; j += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + j));
+            acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+            acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+        }
+        p += CHECKSUM_SIMD_BLOCK;
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1];
+}
+
+uint64_t checksum_sum_sse2(const void *data, size_t blocks) {
+    kernel_fpu_begin();
+    uint64_t sum = checksum_blocks_sse2((const uint8_t *)data, blocks);
+    kernel_fpu_end();
+    return sum;
+}
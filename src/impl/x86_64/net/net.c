@@ -1,6 +1,8 @@
 #include "net/net.h"
 #include "net/tcp.h"
 #include "net/udp.h"
+#include "net/netbuf.h"
+#include "net/checksum.h"
 #include "drivers/e1000.h"
 #include "memory/heap.h"
 #include "utils/memory.h"
@@ -16,8 +18,11 @@ static uint8_t local_mac[6];
 #define ARP_CACHE_SIZE 32
 static arp_entry_t arp_cache[ARP_CACHE_SIZE];
 
-// Packet buffer
-static uint8_t packet_buffer[2048];
+// Receive bottom half (NAPI-style)
+static int in_poll = 0;
+// Nonzero while protocol code runs outside the bottom half; the
+// interrupt-exit poll is deferred until it drops back to zero
+static volatile int bh_disable_count = 0;
 
 // ICMP tracking
 static volatile int icmp_reply_received = 0;
@@ -127,15 +132,12 @@ static void arp_cache_add(uint32_t ip, const uint8_t *mac) {
 
 // Send ARP request
 int arp_request(uint32_t ip) {
-    uint8_t packet[sizeof(eth_header_t) + sizeof(arp_header_t)];
+    static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
-    eth_header_t *eth = (eth_header_t *)packet;
-    arp_header_t *arp = (arp_header_t *)(packet + sizeof(eth_header_t));
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb) return -1;
 
-    // Broadcast destination
-    memset(eth->dest, 0xFF, 6);
-    memcpy(eth->src, local_mac, 6);
-    eth->type = htons(ETH_TYPE_ARP);
+    arp_header_t *arp = (arp_header_t *)netbuf_append(nb, sizeof(arp_header_t));
 
     // ARP request
     arp->hardware_type = htons(ARP_HARDWARE_ETHERNET);
@@ -148,14 +150,14 @@ int arp_request(uint32_t ip) {
     memset(arp->target_mac, 0, 6);
     arp->target_ip = ip;
 
-    return e1000_send_packet(packet, sizeof(packet));
+    return eth_send_netbuf(nb, broadcast, ETH_TYPE_ARP);
 }
 
 // Handle ARP packet
-void arp_handle(const uint8_t *packet, size_t length) {
-    if (length < sizeof(eth_header_t) + sizeof(arp_header_t)) return;
+void arp_handle(netbuf_t *nb) {
+    if (nb->len < sizeof(eth_header_t) + sizeof(arp_header_t)) return;
 
-    const arp_header_t *arp = (const arp_header_t *)(packet + sizeof(eth_header_t));
+    arp_header_t *arp = (arp_header_t *)(nb->data + sizeof(eth_header_t));
 
     // Only handle Ethernet/IPv4 ARP
     if (ntohs(arp->hardware_type) != ARP_HARDWARE_ETHERNET) return;
@@ -168,72 +170,84 @@ void arp_handle(const uint8_t *packet, size_t length) {
     if (ntohs(arp->operation) == ARP_OPERATION_REQUEST &&
         arp->target_ip == local_ip) {
 
-        // Send ARP reply
-        uint8_t reply[sizeof(eth_header_t) + sizeof(arp_header_t)];
-
-        eth_header_t *eth = (eth_header_t *)reply;
-        arp_header_t *reply_arp = (arp_header_t *)(reply + sizeof(eth_header_t));
-
-        memcpy(eth->dest, arp->sender_mac, 6);
-        memcpy(eth->src, local_mac, 6);
-        eth->type = htons(ETH_TYPE_ARP);
-
-        reply_arp->hardware_type = htons(ARP_HARDWARE_ETHERNET);
-        reply_arp->protocol_type = htons(ETH_TYPE_IPV4);
-        reply_arp->hardware_size = 6;
-        reply_arp->protocol_size = 4;
-        reply_arp->operation = htons(ARP_OPERATION_REPLY);
-        memcpy(reply_arp->sender_mac, local_mac, 6);
-        reply_arp->sender_ip = local_ip;
-        memcpy(reply_arp->target_mac, arp->sender_mac, 6);
-        reply_arp->target_ip = arp->sender_ip;
+        // Turn the request around in its own buffer
+        arp->operation = htons(ARP_OPERATION_REPLY);
+        memcpy(arp->target_mac, arp->sender_mac, 6);
+        arp->target_ip = arp->sender_ip;
+        memcpy(arp->sender_mac, local_mac, 6);
+        arp->sender_ip = local_ip;
 
-        e1000_send_packet(reply, sizeof(reply));
+        netbuf_pull(nb, sizeof(eth_header_t));
+        netbuf_trim(nb, sizeof(arp_header_t));
+        eth_send_netbuf(netbuf_get(nb), arp->target_mac, ETH_TYPE_ARP);
     }
 }
 
 // Calculate IP checksum
 uint16_t ip_checksum(const void *data, size_t length) {
-    const uint16_t *ptr = (const uint16_t *)data;
-    uint32_t sum = 0;
-
-    while (length > 1) {
-        sum += *ptr++;
-        length -= 2;
-    }
-
-    if (length > 0) {
-        sum += *(const uint8_t *)ptr;
-    }
-
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
+    return checksum_fold(checksum_partial(data, length, 0));
+}
 
-    return ~sum;
+// TCP/UDP checksum over the IPv4 pseudo-header and segment; 0 if valid
+static uint16_t ip_transport_checksum(uint32_t src_ip, uint32_t dest_ip, uint8_t protocol,
+                                      const uint8_t *data, size_t length) {
+    uint32_t sum = checksum_pseudo(src_ip, dest_ip, protocol, length);
+    return checksum_fold(checksum_partial(data, length, sum));
 }
 
 // Send Ethernet frame
 int eth_send(const uint8_t *dest_mac, uint16_t type, const void *data, size_t length) {
     if (length > 1500) return -1;
 
-    uint8_t packet[sizeof(eth_header_t) + 1500];
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb) return -1;
+
+    memcpy(netbuf_append(nb, length), data, length);
+    return eth_send_netbuf(nb, dest_mac, type);
+}
+
+int eth_send_netbuf(netbuf_t *nb, const uint8_t *dest_mac, uint16_t type) {
+    eth_header_t *eth = NULL;
+    if ((nb->offload & NETBUF_TX_TSO) || netbuf_total_len(nb) <= 1500) {
+        eth = (eth_header_t *)netbuf_push(nb, sizeof(eth_header_t));
+    }
+    if (!eth) {
+        netbuf_put(nb);
+        return -1;
+    }
 
-    eth_header_t *eth = (eth_header_t *)packet;
     memcpy(eth->dest, dest_mac, 6);
     memcpy(eth->src, local_mac, 6);
     eth->type = htons(type);
 
-    memcpy(packet + sizeof(eth_header_t), data, length);
-
-    return e1000_send_packet(packet, sizeof(eth_header_t) + length);
+    return e1000_send_netbuf(nb);
 }
 
 // Send IP packet
 int ip_send(uint32_t dest_ip, uint8_t protocol, const void *data, size_t length) {
-    uint8_t packet[sizeof(ipv4_header_t) + 1500];
+    if (length > 1500 - sizeof(ipv4_header_t)) return -1;
+
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb) return -1;
+
+    memcpy(netbuf_append(nb, length), data, length);
+    return ip_send_netbuf(nb, dest_ip, protocol);
+}
+
+int ip_send_netbuf(netbuf_t *nb, uint32_t dest_ip, uint8_t protocol) {
+    size_t length = netbuf_total_len(nb);
+
+    // TSO sends go down whole and are cut to the MTU by the NIC
+    size_t max_len = (nb->offload & NETBUF_TX_TSO) ? 0xFFFF : 1500;
 
-    ipv4_header_t *ip = (ipv4_header_t *)packet;
+    ipv4_header_t *ip = NULL;
+    if (length <= max_len - sizeof(ipv4_header_t)) {
+        ip = (ipv4_header_t *)netbuf_push(nb, sizeof(ipv4_header_t));
+    }
+    if (!ip) {
+        netbuf_put(nb);
+        return -1;
+    }
 
     // Fill IP header
     ip->version_ihl = 0x45;  // IPv4, 5 dwords header
@@ -247,11 +261,12 @@ int ip_send(uint32_t dest_ip, uint8_t protocol, const void *data, size_t length)
     ip->src_ip = local_ip;
     ip->dest_ip = dest_ip;
 
-    // Calculate checksum
-    ip->checksum = ip_checksum(ip, sizeof(ipv4_header_t));
-
-    // Copy data
-    memcpy(packet + sizeof(ipv4_header_t), data, length);
+    // Calculate checksum, or leave it to the NIC
+    if (e1000_get_offload() & E1000_OFFLOAD_CSUM) {
+        nb->offload |= NETBUF_TX_IP_CSUM;
+    } else {
+        ip->checksum = ip_checksum(ip, sizeof(ipv4_header_t));
+    }
 
     // Determine next hop
     uint32_t next_hop = dest_ip;
@@ -262,6 +277,14 @@ int ip_send(uint32_t dest_ip, uint8_t protocol, const void *data, size_t length)
     // Get MAC address
     uint8_t dest_mac[6];
     if (arp_lookup(next_hop, dest_mac) != 0) {
+        if (in_poll) {
+            // Replying from the bottom half: never wait there. Ask now and
+            // let the peer's retransmission find the cache filled.
+            arp_request(next_hop);
+            netbuf_put(nb);
+            return -1;
+        }
+
         // Need to do ARP
         print_str("Sending ARP request...\n");
         int arp_result = arp_request(next_hop);
@@ -269,6 +292,7 @@ int ip_send(uint32_t dest_ip, uint8_t protocol, const void *data, size_t length)
             print_str("ARP send failed with code ");
             print_int(arp_result);
             print_str("\n");
+            netbuf_put(nb);
             return -1;
         }
         print_str("ARP sent (");
@@ -287,61 +311,78 @@ int ip_send(uint32_t dest_ip, uint8_t protocol, const void *data, size_t length)
 
         if (arp_lookup(next_hop, dest_mac) != 0) {
             print_str("ARP timeout - no reply received\n");
+            netbuf_put(nb);
             return -1;  // ARP failed
         }
     }
 
-    return eth_send(dest_mac, ETH_TYPE_IPV4, packet, sizeof(ipv4_header_t) + length);
+    return eth_send_netbuf(nb, dest_mac, ETH_TYPE_IPV4);
 }
 
 // Handle IP packet
-void ip_handle(const uint8_t *packet, size_t length) {
-    if (length < sizeof(eth_header_t) + sizeof(ipv4_header_t)) return;
+void ip_handle(netbuf_t *nb) {
+    if (nb->len < sizeof(eth_header_t) + sizeof(ipv4_header_t)) return;
 
-    const ipv4_header_t *ip = (const ipv4_header_t *)(packet + sizeof(eth_header_t));
+    const ipv4_header_t *ip = (const ipv4_header_t *)(nb->data + sizeof(eth_header_t));
 
     // Verify it's for us
     if (ip->dest_ip != local_ip && ip->dest_ip != 0xFFFFFFFF) return;
 
-    // Handle based on protocol
+    // Strip the link and IP headers, and any Ethernet padding
     size_t ip_header_len = (ip->version_ihl & 0x0F) * 4;
-    const uint8_t *payload = packet + sizeof(eth_header_t) + ip_header_len;
-    size_t payload_len = ntohs(ip->total_length) - ip_header_len;
+    size_t total_len = ntohs(ip->total_length);
+    uint32_t src_ip = ip->src_ip;
+    uint32_t dest_ip = ip->dest_ip;
+    uint8_t protocol = ip->protocol;
+
+    if (ip_header_len < sizeof(ipv4_header_t) || total_len < ip_header_len) return;
+    if (nb->len < sizeof(eth_header_t) + ip_header_len) return;
+
+    // Drop corrupt packets unless the NIC already checked them
+    if (!(nb->offload & NETBUF_RX_IP_CSUM_OK) && ip_checksum(ip, ip_header_len) != 0) return;
+
+    netbuf_pull(nb, sizeof(eth_header_t) + ip_header_len);
+    netbuf_trim(nb, total_len - ip_header_len);
+
+    if ((protocol == IP_PROTO_TCP || protocol == IP_PROTO_UDP) &&
+        !(nb->offload & NETBUF_RX_L4_CSUM_OK)) {
+        // A zero UDP checksum means the sender did not compute one
+        int unchecked = protocol == IP_PROTO_UDP && nb->len >= sizeof(udp_header_t) &&
+                        ((const udp_header_t *)nb->data)->checksum == 0;
+        if (!unchecked &&
+            ip_transport_checksum(src_ip, dest_ip, protocol, nb->data, nb->len) != 0) return;
+    }
 
-    switch (ip->protocol) {
+    switch (protocol) {
         case IP_PROTO_ICMP:
-            icmp_handle(payload, payload_len, ip->src_ip);
+            icmp_handle(nb, src_ip);
             break;
 
         case IP_PROTO_UDP:
-            udp_handle(payload, payload_len, ip->src_ip);
+            udp_handle(nb, src_ip);
             break;
 
         case IP_PROTO_TCP:
-            tcp_handle(payload, payload_len, ip->src_ip);
+            tcp_handle(nb, src_ip);
             break;
     }
 }
 
 // Handle ICMP packet
-void icmp_handle(const uint8_t *packet, size_t length, uint32_t src_ip) {
-    if (length < sizeof(icmp_header_t)) return;
+void icmp_handle(netbuf_t *nb, uint32_t src_ip) {
+    if (nb->len < sizeof(icmp_header_t)) return;
 
-    const icmp_header_t *icmp = (const icmp_header_t *)packet;
+    icmp_header_t *icmp = (icmp_header_t *)nb->data;
 
     if (icmp->type == ICMP_ECHO_REQUEST) {
-        // Send echo reply
-        size_t reply_len = length;
-        uint8_t reply[reply_len];
-
-        memcpy(reply, packet, length);
-        icmp_header_t *reply_icmp = (icmp_header_t *)reply;
-
-        reply_icmp->type = ICMP_ECHO_REPLY;
-        reply_icmp->checksum = 0;
-        reply_icmp->checksum = ip_checksum(reply, reply_len);
-
-        ip_send(src_ip, IP_PROTO_ICMP, reply, reply_len);
+        // Reply from the request's own buffer; its old headers are the
+        // headroom the new ones are pushed into. Only the type changes, so
+        // patch the checksum instead of summing the whole payload again.
+        uint16_t old_word = *(const uint16_t *)icmp;
+        icmp->type = ICMP_ECHO_REPLY;
+        icmp->checksum = checksum_update16(icmp->checksum, old_word, *(const uint16_t *)icmp);
+
+        ip_send_netbuf(netbuf_get(nb), src_ip, IP_PROTO_ICMP);
     }
     else if (icmp->type == ICMP_ECHO_REPLY) {
         // Check if this is a reply to our ping
@@ -354,7 +395,10 @@ void icmp_handle(const uint8_t *packet, size_t length, uint32_t src_ip) {
 
 // Send ICMP echo request
 int icmp_send_echo_request(uint32_t dest_ip, uint16_t id, uint16_t seq) {
-    uint8_t packet[sizeof(icmp_header_t) + 32];  // 32 bytes of data
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb) return -1;
+
+    uint8_t *packet = netbuf_append(nb, sizeof(icmp_header_t) + 32);  // 32 bytes of data
 
     icmp_header_t *icmp = (icmp_header_t *)packet;
     icmp->type = ICMP_ECHO_REQUEST;
@@ -368,13 +412,13 @@ int icmp_send_echo_request(uint32_t dest_ip, uint16_t id, uint16_t seq) {
         packet[sizeof(icmp_header_t) + i] = i;
     }
 
-    icmp->checksum = ip_checksum(packet, sizeof(packet));
+    icmp->checksum = ip_checksum(packet, nb->len);
 
     icmp_last_id = id;
     icmp_last_seq = seq;
     icmp_reply_received = 0;
 
-    return ip_send(dest_ip, IP_PROTO_ICMP, packet, sizeof(packet));
+    return ip_send_netbuf(nb, dest_ip, IP_PROTO_ICMP);
 }
 
 // Ping function
@@ -387,6 +431,8 @@ int ping(uint32_t dest_ip, int count) {
         return 0;
     }
 
+    net_bh_disable();
+
     uint8_t ip_bytes[4];
     uint32_to_ip(dest_ip, ip_bytes);
 
@@ -422,31 +468,114 @@ int ping(uint32_t dest_ip, int count) {
         }
     }
 
+    net_bh_enable();
     return success;
 }
 
-// Process incoming packets
-void net_process_packet(void) {
-    int len = e1000_receive_packet(packet_buffer, sizeof(packet_buffer));
-    if (len > 0) {
-        net_handle_packet(packet_buffer, len);
+// Bottom half: hand up to `budget` frames from the RX ring to the stack.
+// Once the ring is drained, RX interrupts are re-enabled; if the budget
+// runs out first they stay masked and the caller keeps polling. Returns
+// nonzero in that case.
+int net_poll(int budget) {
+    if (in_poll || !e1000_rx_scheduled()) return 0;
+
+    in_poll = 1;
+    bh_disable_count++;
+
+    // Replies generated by the whole batch share one TX doorbell
+    e1000_tx_batch_begin();
+
+    int done = 0;
+    while (done < budget) {
+        netbuf_t *nb = e1000_receive_netbuf();
+        if (!nb) break;
+        net_handle_packet(nb);
+        netbuf_put(nb);
+        done++;
+    }
+
+    e1000_tx_batch_end();
+
+    int more = done == budget;
+    if (!more) {
+        e1000_rx_complete();
+    }
+
+    bh_disable_count--;
+    in_poll = 0;
+    return more;
+}
+
+// Run from the e1000 interrupt after EOI, interrupts enabled. Protocol
+// code that was interrupted gets the work when it re-enables the bottom
+// half. A poll that exhausts its budget here re-raises the (throttled)
+// interrupt for the rest of the ring rather than keep the interrupted
+// code waiting.
+void net_rx_action(void) {
+    if (bh_disable_count != 0) return;
+
+    if (net_poll(NET_RX_BUDGET)) {
+        e1000_rx_reschedule();
     }
 }
 
+void net_bh_disable(void) {
+    bh_disable_count++;
+}
+
+void net_bh_enable(void) {
+    if (--bh_disable_count == 0 && e1000_rx_scheduled()) {
+        net_poll(NET_RX_BUDGET);
+    }
+}
+
+static inline int interrupts_enabled(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0" : "=r"(flags));
+    return (flags & (1 << 9)) != 0;
+}
+
+// Wait for receive activity inside a blocking call (bottom half disabled
+// by the caller). The CPU halts until the next interrupt, whose exit runs
+// the bottom half; while polling, or with nothing to wake us, this
+// returns at once and the caller spins.
+void net_wait(void) {
+    if (net_poll(NET_RX_BUDGET)) return;
+    if (!e1000_rx_interrupts() || !interrupts_enabled()) return;
+
+    int saved = bh_disable_count;
+    bh_disable_count = 0;
+
+    // sti takes effect after hlt starts, so no wakeup slips in between
+    __asm__ volatile("cli");
+    if (!e1000_rx_scheduled()) {
+        __asm__ volatile("sti; hlt");
+    } else {
+        __asm__ volatile("sti");
+    }
+
+    bh_disable_count = saved;
+}
+
+// Process incoming packets (poll from process context)
+void net_process_packet(void) {
+    net_poll(NET_RX_BUDGET);
+}
+
 // Handle received packet
-int net_handle_packet(uint8_t *buffer, size_t length) {
-    if (length < sizeof(eth_header_t)) return -1;
+int net_handle_packet(netbuf_t *nb) {
+    if (nb->len < sizeof(eth_header_t)) return -1;
 
-    eth_header_t *eth = (eth_header_t *)buffer;
+    eth_header_t *eth = (eth_header_t *)nb->data;
     uint16_t type = ntohs(eth->type);
 
     switch (type) {
         case ETH_TYPE_ARP:
-            arp_handle(buffer, length);
+            arp_handle(nb);
             break;
 
         case ETH_TYPE_IPV4:
-            ip_handle(buffer, length);
+            ip_handle(nb);
             break;
     }
 
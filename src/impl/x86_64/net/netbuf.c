@@ -0,0 +1,159 @@
+#include "net/netbuf.h"
+#include "memory/buddy.h"
+#include "memory/paging.h"
+#include "shell/shell.h"
+#include "utils/memory.h"
+#include "interrupts/irq_flags.h"
+
+static netbuf_t netbufs[NETBUF_COUNT];
+// Buffers are released from the e1000 interrupt as well, so the free
+// list is only touched with interrupts off
+static netbuf_t *free_list = NULL;
+static int free_count = 0;
+
+void netbuf_init(void) {
+    // 2 KB slots never straddle a page, so each one is contiguous
+    uint8_t *pool = (uint8_t *)kmalloc_pages((size_t)NETBUF_SIZE * NETBUF_COUNT);
+    if (!pool) {
+        serial_print("netbuf: pool allocation failed\n");
+        return;
+    }
+
+    free_list = NULL;
+    for (int i = NETBUF_COUNT - 1; i >= 0; i--) {
+        netbuf_t *nb = &netbufs[i];
+        nb->head = pool + (size_t)i * NETBUF_SIZE;
+        nb->phys = paging_virt_to_phys(nb->head);
+        nb->data = nb->head;
+        nb->len = 0;
+        nb->refcount = 0;
+        nb->next = free_list;
+        free_list = nb;
+    }
+    free_count = NETBUF_COUNT;
+}
+
+netbuf_t *netbuf_alloc(void) {
+    uint64_t flags = irq_save();
+
+    netbuf_t *nb = free_list;
+    if (nb) {
+        free_list = nb->next;
+        free_count--;
+    }
+
+    irq_restore(flags);
+
+    if (!nb) return NULL;
+
+    nb->data = nb->head + NETBUF_HEADROOM;
+    nb->len = 0;
+    nb->refcount = 1;
+    nb->offload = 0;
+    nb->mss = 0;
+    nb->frag = NULL;
+    nb->next = NULL;
+    return nb;
+}
+
+netbuf_t *netbuf_get(netbuf_t *nb) {
+    uint64_t flags = irq_save();
+    nb->refcount++;
+    irq_restore(flags);
+    return nb;
+}
+
+void netbuf_put(netbuf_t *nb) {
+    // Fragments are owned by the head and go back with it
+    while (nb) {
+        netbuf_t *frag = NULL;
+
+        uint64_t flags = irq_save();
+        if (--nb->refcount == 0) {
+            frag = nb->frag;
+            nb->frag = NULL;
+            nb->next = free_list;
+            free_list = nb;
+            free_count++;
+        }
+        irq_restore(flags);
+
+        nb = frag;
+    }
+}
+
+uint8_t *netbuf_push(netbuf_t *nb, size_t n) {
+    if (netbuf_headroom(nb) < n) return NULL;
+    nb->data -= n;
+    nb->len += n;
+    return nb->data;
+}
+
+uint8_t *netbuf_pull(netbuf_t *nb, size_t n) {
+    if (nb->len < n) return NULL;
+    nb->data += n;
+    nb->len -= n;
+    return nb->data;
+}
+
+uint8_t *netbuf_append(netbuf_t *nb, size_t n) {
+    if (netbuf_tailroom(nb) < n) return NULL;
+    uint8_t *tail = nb->data + nb->len;
+    nb->len += n;
+    return tail;
+}
+
+void netbuf_trim(netbuf_t *nb, size_t len) {
+    if (len < nb->len) nb->len = len;
+}
+
+int netbuf_append_data(netbuf_t *nb, const void *data, size_t len) {
+    const uint8_t *src = (const uint8_t *)data;
+
+    while (nb->frag) nb = nb->frag;
+
+    while (len > 0) {
+        size_t room = netbuf_tailroom(nb);
+        if (room == 0) {
+            netbuf_t *frag = netbuf_alloc();
+            if (!frag) return -1;
+
+            // Fragments carry payload only and need no headroom
+            frag->data = frag->head;
+            nb->frag = frag;
+            nb = frag;
+            room = NETBUF_SIZE;
+        }
+
+        size_t n = len < room ? len : room;
+        memcpy(netbuf_append(nb, n), src, n);
+        src += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+size_t netbuf_total_len(const netbuf_t *nb) {
+    size_t total = 0;
+    for (; nb; nb = nb->frag) {
+        total += nb->len;
+    }
+    return total;
+}
+
+size_t netbuf_headroom(const netbuf_t *nb) {
+    return nb->data - nb->head;
+}
+
+size_t netbuf_tailroom(const netbuf_t *nb) {
+    return NETBUF_SIZE - netbuf_headroom(nb) - nb->len;
+}
+
+uint64_t netbuf_dma_addr(const netbuf_t *nb) {
+    return nb->phys + netbuf_headroom(nb);
+}
+
+int netbuf_available(void) {
+    return free_count;
+}
@@ -1,21 +1,18 @@
 #include "net/tcp.h"
 #include "net/net.h"
+#include "net/checksum.h"
 #include "memory/heap.h"
 #include "utils/memory.h"
+#include "drivers/e1000.h"
+
+// Segments up to this size are copied onto the tail of the receive
+// queue when they fit, so a stream of tiny segments cannot pin the pool
+#define TCP_COALESCE_MAX 128
 
 // TCP connections table
 static tcp_connection_t tcp_connections[MAX_TCP_CONNECTIONS];
 static uint16_t next_ephemeral_port = 49152;
 
-// Pseudo-header for TCP checksum
-typedef struct {
-    uint32_t src_ip;
-    uint32_t dest_ip;
-    uint8_t zero;
-    uint8_t protocol;
-    uint16_t tcp_length;
-} __attribute__((packed)) tcp_pseudo_header_t;
-
 void tcp_init(void) {
     memset(tcp_connections, 0, sizeof(tcp_connections));
 }
@@ -23,37 +20,14 @@ void tcp_init(void) {
 // Calculate TCP checksum
 static uint16_t tcp_checksum(uint32_t src_ip, uint32_t dest_ip,
                              const void *tcp_data, size_t tcp_length) {
-    tcp_pseudo_header_t pseudo;
-    pseudo.src_ip = src_ip;
-    pseudo.dest_ip = dest_ip;
-    pseudo.zero = 0;
-    pseudo.protocol = IP_PROTO_TCP;
-    pseudo.tcp_length = htons(tcp_length);
-
-    // Calculate sum over pseudo header
-    uint32_t sum = 0;
-    const uint16_t *ptr = (const uint16_t *)&pseudo;
-    for (size_t i = 0; i < sizeof(pseudo) / 2; i++) {
-        sum += ptr[i];
-    }
-
-    // Add TCP segment
-    ptr = (const uint16_t *)tcp_data;
-    size_t len = tcp_length;
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
-    }
-    if (len > 0) {
-        sum += *(const uint8_t *)ptr;
-    }
-
-    // Fold and complement
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
+    uint32_t sum = checksum_pseudo(src_ip, dest_ip, IP_PROTO_TCP, tcp_length);
+    return checksum_fold(checksum_partial(tcp_data, tcp_length, sum));
+}
 
-    return ~sum;
+// Folded pseudo-header sum the NIC starts from when it completes the
+// checksum. TSO leaves the length out; the NIC adds each segment's own.
+static uint16_t tcp_pseudo_checksum(uint32_t src_ip, uint32_t dest_ip, size_t tcp_length) {
+    return (uint16_t)~checksum_fold(checksum_pseudo(src_ip, dest_ip, IP_PROTO_TCP, tcp_length));
 }
 
 // Allocate a connection slot
@@ -86,9 +60,17 @@ static int tcp_find_connection(uint32_t local_ip, uint16_t local_port,
 static int tcp_send_segment(tcp_connection_t *conn, uint8_t flags,
                             const void *data, size_t data_len) {
     size_t tcp_len = sizeof(tcp_header_t) + data_len;
-    uint8_t packet[tcp_len];
 
-    tcp_header_t *tcp = (tcp_header_t *)packet;
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb) return -1;
+
+    // Payloads past one buffer (TSO sends) continue in fragments
+    if (data && data_len > 0 && netbuf_append_data(nb, data, data_len) != 0) {
+        netbuf_put(nb);
+        return -1;
+    }
+
+    tcp_header_t *tcp = (tcp_header_t *)netbuf_push(nb, sizeof(tcp_header_t));
     tcp->src_port = htons(conn->local_port);
     tcp->dest_port = htons(conn->remote_port);
     tcp->seq_num = htonl(conn->seq_num);
@@ -99,19 +81,63 @@ static int tcp_send_segment(tcp_connection_t *conn, uint8_t flags,
     tcp->checksum = 0;
     tcp->urgent = 0;
 
-    if (data && data_len > 0) {
-        memcpy(packet + sizeof(tcp_header_t), data, data_len);
+    if (e1000_get_offload() & E1000_OFFLOAD_CSUM) {
+        int tso = data_len > TCP_MSS;
+        tcp->checksum = tcp_pseudo_checksum(conn->local_ip, conn->remote_ip, tso ? 0 : tcp_len);
+        nb->offload |= NETBUF_TX_L4_CSUM;
+        if (tso) {
+            nb->offload |= NETBUF_TX_TSO;
+            nb->mss = TCP_MSS;
+        }
+    } else {
+        tcp->checksum = tcp_checksum(conn->local_ip, conn->remote_ip, nb->data, tcp_len);
+    }
+
+    return ip_send_netbuf(nb, conn->remote_ip, IP_PROTO_TCP);
+}
+
+// Queue `len` payload bytes at `offset` in a received segment
+static void tcp_queue_data(tcp_connection_t *conn, netbuf_t *nb, size_t offset, size_t len) {
+    netbuf_t *tail = conn->recv_tail;
+    if (tail && len <= TCP_COALESCE_MAX && netbuf_tailroom(tail) >= len) {
+        memcpy(netbuf_append(tail, len), nb->data + offset, len);
+        return;
     }
 
-    tcp->checksum = tcp_checksum(conn->local_ip, conn->remote_ip, packet, tcp_len);
+    // Keep the segment's own buffer, trimmed to the payload
+    netbuf_pull(nb, offset);
+    netbuf_trim(nb, len);
+    netbuf_get(nb);
+    nb->next = NULL;
 
-    return ip_send(conn->remote_ip, IP_PROTO_TCP, packet, tcp_len);
+    if (tail) {
+        tail->next = nb;
+    } else {
+        conn->recv_head = nb;
+    }
+    conn->recv_tail = nb;
+}
+
+// Drop everything still queued for reading
+static void tcp_purge(tcp_connection_t *conn) {
+    while (conn->recv_head) {
+        netbuf_t *nb = conn->recv_head;
+        conn->recv_head = nb->next;
+        netbuf_put(nb);
+    }
+    conn->recv_tail = NULL;
+    conn->recv_len = 0;
 }
 
 // Connect to remote host
 int tcp_connect(uint32_t dest_ip, uint16_t dest_port, uint16_t src_port) {
+    net_bh_disable();
+
     int sock = tcp_alloc_connection();
-    if (sock < 0) return -1;
+    if (sock < 0) {
+        net_bh_enable();
+        return -1;
+    }
 
     tcp_connection_t *conn = &tcp_connections[sock];
 
@@ -135,9 +161,10 @@ int tcp_connect(uint32_t dest_ip, uint16_t dest_port, uint16_t src_port) {
 
     if (conn->state != TCP_STATE_ESTABLISHED) {
         conn->used = 0;
-        return -1;
+        sock = -1;
     }
 
+    net_bh_enable();
     return sock;
 }
 
@@ -162,18 +189,20 @@ int tcp_accept(int listen_sock) {
     if (listen_conn->state != TCP_STATE_LISTEN) return -1;
 
     // Wait for incoming connection
+    net_bh_disable();
     while (1) {
-        net_process_packet();
-
         // Check if we got a connection
         for (int i = 0; i < MAX_TCP_CONNECTIONS; i++) {
             if (i != listen_sock &&
                 tcp_connections[i].used &&
                 tcp_connections[i].local_port == listen_conn->local_port &&
                 tcp_connections[i].state == TCP_STATE_ESTABLISHED) {
+                net_bh_enable();
                 return i;
             }
         }
+
+        net_wait();
     }
 }
 
@@ -184,13 +213,27 @@ int tcp_send(int sock, const void *data, size_t length) {
     tcp_connection_t *conn = &tcp_connections[sock];
     if (conn->state != TCP_STATE_ESTABLISHED) return -1;
 
-    // Send data with PSH and ACK flags
-    int ret = tcp_send_segment(conn, TCP_FLAG_PSH | TCP_FLAG_ACK, data, length);
-    if (ret > 0) {
-        conn->seq_num += length;
-    }
+    // With TSO the NIC cuts each 64 KiB piece into MSS segments;
+    // otherwise the stack sends MSS-sized segments itself
+    size_t max_seg = (e1000_get_offload() & E1000_OFFLOAD_TSO) ? TCP_TSO_MAX : TCP_MSS;
+    const uint8_t *p = (const uint8_t *)data;
+    size_t sent = 0;
+    int ret = -1;
 
-    return ret > 0 ? length : -1;
+    // Send data with PSH and ACK flags
+    net_bh_disable();
+    do {
+        size_t n = length - sent;
+        if (n > max_seg) n = max_seg;
+
+        if (tcp_send_segment(conn, TCP_FLAG_PSH | TCP_FLAG_ACK, p + sent, n) <= 0) break;
+        conn->seq_num += n;
+        sent += n;
+        ret = sent;
+    } while (sent < length);
+    net_bh_enable();
+
+    return ret;
 }
 
 // Receive data
@@ -201,26 +244,33 @@ int tcp_recv(int sock, void *buffer, size_t max_length) {
     if (conn->state != TCP_STATE_ESTABLISHED &&
         conn->state != TCP_STATE_CLOSE_WAIT) return -1;
 
-    // Poll for data
+    // Sleep until data arrives
+    net_bh_disable();
     while (conn->recv_len == 0 && conn->state == TCP_STATE_ESTABLISHED) {
-        net_process_packet();
+        net_wait();
     }
 
-    size_t to_copy = conn->recv_len;
-    if (to_copy > max_length) to_copy = max_length;
-
-    if (to_copy > 0) {
-        memcpy(buffer, conn->recv_buffer, to_copy);
-
-        // Shift remaining data
-        if (to_copy < conn->recv_len) {
-            memmove(conn->recv_buffer, conn->recv_buffer + to_copy,
-                    conn->recv_len - to_copy);
+    // Copy out of the queued segments, releasing each one once consumed
+    size_t copied = 0;
+    while (copied < max_length && conn->recv_head) {
+        netbuf_t *nb = conn->recv_head;
+        size_t n = nb->len;
+        if (n > max_length - copied) n = max_length - copied;
+
+        memcpy((uint8_t *)buffer + copied, nb->data, n);
+        netbuf_pull(nb, n);
+        copied += n;
+
+        if (nb->len == 0) {
+            conn->recv_head = nb->next;
+            if (!conn->recv_head) conn->recv_tail = NULL;
+            netbuf_put(nb);
         }
-        conn->recv_len -= to_copy;
     }
+    conn->recv_len -= copied;
+    net_bh_enable();
 
-    return to_copy;
+    return copied;
 }
 
 // Close connection
@@ -229,6 +279,7 @@ int tcp_close(int sock) {
 
     tcp_connection_t *conn = &tcp_connections[sock];
 
+    net_bh_disable();
     if (conn->state == TCP_STATE_ESTABLISHED) {
         // Send FIN
         tcp_send_segment(conn, TCP_FLAG_FIN | TCP_FLAG_ACK, NULL, 0);
@@ -242,17 +293,19 @@ int tcp_close(int sock) {
         }
     }
 
+    tcp_purge(conn);
     conn->used = 0;
     conn->state = TCP_STATE_CLOSED;
+    net_bh_enable();
 
     return 0;
 }
 
 // Handle incoming TCP segment
-void tcp_handle(const uint8_t *packet, size_t length, uint32_t src_ip) {
-    if (length < sizeof(tcp_header_t)) return;
+void tcp_handle(netbuf_t *nb, uint32_t src_ip) {
+    if (nb->len < sizeof(tcp_header_t)) return;
 
-    const tcp_header_t *tcp = (const tcp_header_t *)packet;
+    const tcp_header_t *tcp = (const tcp_header_t *)nb->data;
 
     uint16_t src_port = ntohs(tcp->src_port);
     uint16_t dest_port = ntohs(tcp->dest_port);
@@ -261,8 +314,8 @@ void tcp_handle(const uint8_t *packet, size_t length, uint32_t src_ip) {
     uint8_t flags = tcp->flags;
 
     size_t header_len = ((tcp->data_offset >> 4) & 0x0F) * 4;
-    size_t data_len = length - header_len;
-    const uint8_t *data = packet + header_len;
+    if (header_len < sizeof(tcp_header_t) || header_len > nb->len) return;
+    size_t data_len = nb->len - header_len;
 
     // Find matching connection
     int sock = tcp_find_connection(net_get_ip(), dest_port, src_ip, src_port);
@@ -321,12 +374,12 @@ void tcp_handle(const uint8_t *packet, size_t length, uint32_t src_ip) {
             else if (data_len > 0) {
                 // Store received data
                 size_t space = TCP_RECV_BUFFER_SIZE - conn->recv_len;
-                size_t to_copy = data_len < space ? data_len : space;
+                size_t to_queue = data_len < space ? data_len : space;
 
-                if (to_copy > 0) {
-                    memcpy(conn->recv_buffer + conn->recv_len, data, to_copy);
-                    conn->recv_len += to_copy;
-                    conn->ack_num += to_copy;
+                if (to_queue > 0) {
+                    tcp_queue_data(conn, nb, header_len, to_queue);
+                    conn->recv_len += to_queue;
+                    conn->ack_num += to_queue;
 
                     // Send ACK
                     tcp_send_segment(conn, TCP_FLAG_ACK, NULL, 0);
@@ -359,6 +412,7 @@ void tcp_handle(const uint8_t *packet, size_t length, uint32_t src_ip) {
 
         case TCP_STATE_LAST_ACK:
             if (flags & TCP_FLAG_ACK) {
+                tcp_purge(conn);
                 conn->state = TCP_STATE_CLOSED;
                 conn->used = 0;
             }
@@ -1,21 +1,14 @@
 #include "net/udp.h"
 #include "net/net.h"
+#include "net/checksum.h"
 #include "memory/heap.h"
 #include "utils/memory.h"
+#include "drivers/e1000.h"
 
 // UDP sockets table
 static udp_socket_t udp_sockets[MAX_UDP_SOCKETS];
 static uint16_t next_udp_port = 49152;
 
-// Pseudo-header for UDP checksum
-typedef struct {
-    uint32_t src_ip;
-    uint32_t dest_ip;
-    uint8_t zero;
-    uint8_t protocol;
-    uint16_t udp_length;
-} __attribute__((packed)) udp_pseudo_header_t;
-
 void udp_init(void) {
     memset(udp_sockets, 0, sizeof(udp_sockets));
 }
@@ -23,34 +16,13 @@ void udp_init(void) {
 // Calculate UDP checksum
 static uint16_t udp_checksum(uint32_t src_ip, uint32_t dest_ip,
                              const void *udp_data, size_t udp_length) {
-    udp_pseudo_header_t pseudo;
-    pseudo.src_ip = src_ip;
-    pseudo.dest_ip = dest_ip;
-    pseudo.zero = 0;
-    pseudo.protocol = IP_PROTO_UDP;
-    pseudo.udp_length = htons(udp_length);
-
-    uint32_t sum = 0;
-    const uint16_t *ptr = (const uint16_t *)&pseudo;
-    for (size_t i = 0; i < sizeof(pseudo) / 2; i++) {
-        sum += ptr[i];
-    }
-
-    ptr = (const uint16_t *)udp_data;
-    size_t len = udp_length;
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
-    }
-    if (len > 0) {
-        sum += *(const uint8_t *)ptr;
-    }
-
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
+    uint32_t sum = checksum_pseudo(src_ip, dest_ip, IP_PROTO_UDP, udp_length);
+    return checksum_fold(checksum_partial(udp_data, udp_length, sum));
+}
 
-    return ~sum;
+// Folded pseudo-header sum the NIC starts from when it completes the checksum
+static uint16_t udp_pseudo_checksum(uint32_t src_ip, uint32_t dest_ip, size_t udp_length) {
+    return (uint16_t)~checksum_fold(checksum_pseudo(src_ip, dest_ip, IP_PROTO_UDP, udp_length));
 }
 
 // Create UDP socket
@@ -96,20 +68,32 @@ int udp_sendto(int sock, const void *data, size_t length,
     udp_socket_t *s = &udp_sockets[sock];
 
     size_t udp_len = sizeof(udp_header_t) + length;
-    uint8_t packet[udp_len];
 
-    udp_header_t *udp = (udp_header_t *)packet;
+    netbuf_t *nb = netbuf_alloc();
+    if (!nb) return -1;
+
+    // Payload first, then the header in front of it; IP and Ethernet
+    // headers go into the same buffer's remaining headroom
+    memcpy(netbuf_append(nb, length), data, length);
+
+    udp_header_t *udp = (udp_header_t *)netbuf_push(nb, sizeof(udp_header_t));
     udp->src_port = htons(s->local_port);
     udp->dest_port = htons(dest_port);
     udp->length = htons(udp_len);
     udp->checksum = 0;
 
-    memcpy(packet + sizeof(udp_header_t), data, length);
-
-    udp->checksum = udp_checksum(net_get_ip(), dest_ip, packet, udp_len);
-    if (udp->checksum == 0) udp->checksum = 0xFFFF;
+    if (e1000_get_offload() & E1000_OFFLOAD_CSUM) {
+        udp->checksum = udp_pseudo_checksum(net_get_ip(), dest_ip, udp_len);
+        nb->offload |= NETBUF_TX_L4_CSUM;
+    } else {
+        udp->checksum = udp_checksum(net_get_ip(), dest_ip, nb->data, udp_len);
+        if (udp->checksum == 0) udp->checksum = 0xFFFF;
+    }
 
-    int ret = ip_send(dest_ip, IP_PROTO_UDP, packet, udp_len);
+    // The bottom half updates the ARP cache the send path reads
+    net_bh_disable();
+    int ret = ip_send_netbuf(nb, dest_ip, IP_PROTO_UDP);
+    net_bh_enable();
     return ret > 0 ? length : -1;
 }
 
@@ -131,20 +115,24 @@ int udp_recvfrom(int sock, void *buffer, size_t max_length,
 
     udp_socket_t *s = &udp_sockets[sock];
 
-    // Poll for data
+    // Sleep until a datagram arrives
+    net_bh_disable();
     while (s->recv_len == 0) {
-        net_process_packet();
+        net_wait();
     }
 
     size_t to_copy = s->recv_len;
     if (to_copy > max_length) to_copy = max_length;
 
-    memcpy(buffer, s->recv_buffer, to_copy);
+    memcpy(buffer, s->recv_nb->data, to_copy);
 
     if (src_ip) *src_ip = s->recv_src_ip;
     if (src_port) *src_port = s->recv_src_port;
 
+    netbuf_put(s->recv_nb);
+    s->recv_nb = NULL;
     s->recv_len = 0;
+    net_bh_enable();
 
     return to_copy;
 }
@@ -158,33 +146,40 @@ int udp_recv(int sock, void *buffer, size_t max_length) {
 int udp_close(int sock) {
     if (sock < 0 || sock >= MAX_UDP_SOCKETS) return -1;
 
+    // udp_handle must not queue into (or release) the buffer mid-teardown
+    net_bh_disable();
+    netbuf_put(udp_sockets[sock].recv_nb);
+    udp_sockets[sock].recv_nb = NULL;
+    udp_sockets[sock].recv_len = 0;
     udp_sockets[sock].used = 0;
+    net_bh_enable();
     return 0;
 }
 
 // Handle incoming UDP datagram
-void udp_handle(const uint8_t *packet, size_t length, uint32_t src_ip) {
-    if (length < sizeof(udp_header_t)) return;
+void udp_handle(netbuf_t *nb, uint32_t src_ip) {
+    if (nb->len < sizeof(udp_header_t)) return;
 
-    const udp_header_t *udp = (const udp_header_t *)packet;
+    const udp_header_t *udp = (const udp_header_t *)nb->data;
 
     uint16_t dest_port = ntohs(udp->dest_port);
     uint16_t src_port = ntohs(udp->src_port);
-    size_t data_len = ntohs(udp->length) - sizeof(udp_header_t);
+    size_t udp_len = ntohs(udp->length);
+    if (udp_len < sizeof(udp_header_t) || udp_len > nb->len) return;
 
     // Find matching socket
     for (int i = 0; i < MAX_UDP_SOCKETS; i++) {
         if (udp_sockets[i].used && udp_sockets[i].local_port == dest_port) {
             udp_socket_t *s = &udp_sockets[i];
 
-            // Store data
-            size_t to_copy = data_len;
-            if (to_copy > UDP_RECV_BUFFER_SIZE) {
-                to_copy = UDP_RECV_BUFFER_SIZE;
-            }
+            // Keep the datagram's own buffer; a newer one replaces an
+            // unread one as before
+            netbuf_pull(nb, sizeof(udp_header_t));
+            netbuf_trim(nb, udp_len - sizeof(udp_header_t));
 
-            memcpy(s->recv_buffer, packet + sizeof(udp_header_t), to_copy);
-            s->recv_len = to_copy;
+            netbuf_put(s->recv_nb);
+            s->recv_nb = netbuf_get(nb);
+            s->recv_len = nb->len;
             s->recv_src_ip = src_ip;
             s->recv_src_port = src_port;
 
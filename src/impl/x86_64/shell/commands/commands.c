@@ -11,9 +11,15 @@ static const command_t command_table[] = {
     {"reboot", "Reboot the system", cmd_reboot},
     {"draw", "Draw shapes (draw triangle|rect|line|pixel)", cmd_draw},
     {"cls", "Clear the graphics screen", cmd_cls},
+    {"fontbench", "Benchmark text rendering (chars/sec)", cmd_fontbench},
+    {"pngbench", "Benchmark PNG decoding (pngbench [file] [iterations])", cmd_pngbench},
+    {"jpgbench", "Benchmark JPEG decoding (jpgbench [file] [iterations])", cmd_jpgbench},
     {"ls", "List directory contents", cmd_ls},
-    {"cat", "Display file contents", cmd_cat},
-    {"heap", "Show heap statistics", cmd_heap},
+    {"cat", "Display file contents (cat [-t] <file>)", cmd_cat},
+    {"heap", "Show heap statistics (heap [bench])", cmd_heap},
+    {"heapprof", "Profile heap allocations (heapprof on|off|top|count|hist)", cmd_heapprof},
+    {"pages", "Show physical page allocator statistics", cmd_pages},
+    {"membench", "Benchmark memcpy throughput (16 B - 4 MiB)", cmd_membench},
     {"touch", "Create a new file", cmd_touch},
     {"rm", "Remove a file", cmd_rm},
     {"write", "Write text to a file", cmd_write},
@@ -22,6 +28,8 @@ static const command_t command_table[] = {
     {"ifconfig", "Show/set network config (ifconfig [ip] [gateway])", cmd_ifconfig},
     {"pci", "List PCI devices", cmd_pci},
     {"netstat", "Show network status", cmd_netstat},
+    {"offload", "Show/set NIC checksum and TSO offload (offload [on|csum|off])", cmd_offload},
+    {"csumbench", "Test and benchmark the Internet checksum (64 B - 2 MiB)", cmd_csumbench},
     {"wget", "Fetch URL content (wget <ip> <port> <path>)", cmd_wget},
     {"view", "Open image viewer (view <file.bmp>)", cmd_view},
     {"run", "Run an ELF binary (run <file>)", cmd_run},
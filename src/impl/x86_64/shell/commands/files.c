@@ -4,6 +4,8 @@
 #include <shell/print.h>
 #include <fs/vfs.h>
 #include <memory/heap.h>
+#include <utils/string.h>
+#include <utils/timing.h>
 
 void cmd_ls(int argc, char **argv)
 {
@@ -67,29 +69,53 @@ void cmd_cat(int argc, char **argv)
 {
     if (argc < 2)
     {
-        print_str("Usage: cat <file>\n");
+        print_str("Usage: cat [-t] <file>\n");
         return;
     }
 
-    vfs_node_t *file = vfs_open(argv[1], VFS_READ);
+    // cat -t <file> also reports console throughput
+    int timed = argc > 2 && strcmp(argv[1], "-t") == 0;
+    const char *path = timed ? argv[2] : argv[1];
+
+    vfs_node_t *file = vfs_open(path, VFS_READ);
     if (!file)
     {
         print_str("File not found\n");
         return;
     }
 
-    uint8_t buffer[256];
-    int bytes = vfs_read(file, 0, 256, buffer);
+    uint8_t buffer[512];
+    uint32_t offset = 0;
+    uint32_t lines = 0;
+    uint64_t start = timing_rdtsc();
 
-    if (bytes > 0)
+    int bytes;
+    while ((bytes = vfs_read(file, offset, sizeof(buffer), buffer)) > 0)
     {
         for (int i = 0; i < bytes; i++)
         {
+            if (buffer[i] == '\n')
+                lines++;
             print_char(buffer[i]);
         }
+        offset += bytes;
     }
 
+    uint64_t us = timing_cycles_to_us(timing_rdtsc() - start);
     vfs_close(file);
+
+    if (timed)
+    {
+        if (us == 0)
+            us = 1;
+        print_str("\n");
+        print_uint(lines);
+        print_str(" lines in ");
+        print_uint((uint32_t)(us / 1000));
+        print_str(" ms (");
+        print_uint((uint32_t)((uint64_t)lines * 1000000 / us));
+        print_str(" lines/sec)\n");
+    }
 }
 
 void cmd_touch(int argc, char **argv)
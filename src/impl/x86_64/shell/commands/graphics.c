@@ -1,9 +1,14 @@
-// Graphics commands: draw, cls, view
+// Graphics commands: draw, cls, fontbench, pngbench, jpgbench, view
 
 #include <shell/commands.h>
 #include <shell/print.h>
 #include <graphics/graphics.h>
+#include <graphics/font.h>
 #include <gui/imageviewer.h>
+#include <gui/png.h>
+#include <gui/jpg.h>
+#include <memory/heap.h>
+#include <fs/vfs.h>
 
 // Helper to parse color string
 static int cmd_strcmp(const char *s1, const char *s2)
@@ -45,6 +50,115 @@ void cmd_cls(int argc, char **argv)
     print_str("Graphics screen cleared\n");
 }
 
+void cmd_fontbench(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    uint32_t bitwise_cps, cached_cps;
+    font_benchmark(&bitwise_cps, &cached_cps);
+
+    // The benchmark scribbles over the console
+    print_clear();
+    print_str("Text rendering (chars/sec):\n");
+    print_str("  Bit by bit:  ");
+    print_uint(bitwise_cps);
+    print_str("\n  Glyph atlas: ");
+    print_uint(cached_cps);
+    print_str("\n");
+}
+
+// Read a whole image file for the decoder benchmarks; prints the error
+// and returns NULL on failure
+static uint8_t *bench_load_file(const char *cmd, const char *path, int *size)
+{
+    vfs_node_t *file = vfs_open(path, VFS_READ);
+    if (!file)
+    {
+        print_str((char *)cmd);
+        print_str(": cannot open ");
+        print_str((char *)path);
+        print_str("\n");
+        return 0;
+    }
+
+    uint8_t *data = (uint8_t *)kmalloc(file->length);
+    if (!data)
+    {
+        vfs_close(file);
+        print_str((char *)cmd);
+        print_str(": out of memory\n");
+        return 0;
+    }
+    *size = vfs_read(file, 0, file->length, data);
+    vfs_close(file);
+    return data;
+}
+
+// Shared result line: size, decode count, time per image and a
+// decoder-specific rate
+static void bench_report(uint32_t width, uint32_t height, uint32_t iterations,
+                         uint32_t us_per_image, uint32_t rate, const char *rate_unit)
+{
+    print_uint(width);
+    print_str("x");
+    print_uint(height);
+    print_str(", ");
+    print_uint(iterations);
+    print_str(" decodes: ");
+    print_uint(us_per_image);
+    print_str(" us/image, ");
+    print_uint(rate);
+    print_str((char *)rate_unit);
+    print_str("\n");
+}
+
+void cmd_pngbench(int argc, char **argv)
+{
+    const char *path = argc >= 2 ? argv[1] : "/test_colors.png";
+    uint32_t iterations = argc >= 3 ? (uint32_t)atoi(argv[2]) : 100;
+
+    int bytes = 0;
+    uint8_t *data = bench_load_file("pngbench", path, &bytes);
+    if (!data)
+        return;
+
+    png_bench_result_t result;
+    int status = bytes > 0 ? png_benchmark(data, bytes, iterations, &result) : -1;
+    kfree(data);
+    if (status != 0)
+    {
+        print_str("pngbench: decode failed\n");
+        return;
+    }
+
+    bench_report(result.width, result.height, result.iterations, result.us_per_image,
+                 result.mbps, " MB/s inflated");
+}
+
+void cmd_jpgbench(int argc, char **argv)
+{
+    const char *path = argc >= 2 ? argv[1] : "/test_pattern.jpg";
+    uint32_t iterations = argc >= 3 ? (uint32_t)atoi(argv[2]) : 100;
+
+    int bytes = 0;
+    uint8_t *data = bench_load_file("jpgbench", path, &bytes);
+    if (!data)
+        return;
+
+    jpg_bench_result_t result;
+    int status = bytes > 0 ? jpg_benchmark(data, bytes, iterations, &result) : -1;
+    kfree(data);
+    if (status != 0)
+    {
+        print_str("jpgbench: decode failed\n");
+        return;
+    }
+
+    bench_report(result.width, result.height, result.iterations, result.us_per_image,
+                 result.us_per_mpixel, " us/megapixel");
+}
+
 void cmd_draw(int argc, char **argv)
 {
     if (argc < 2)
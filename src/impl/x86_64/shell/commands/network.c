@@ -1,12 +1,14 @@
-// Network commands: ping, ifconfig, netstat, wget
+// Network commands: ping, ifconfig, netstat, offload, csumbench, wget
 
 #include <shell/commands.h>
 #include <shell/print.h>
 #include <drivers/e1000.h>
 #include <net/net.h>
 #include <net/socket.h>
+#include <net/checksum.h>
 #include <memory/heap.h>
 #include <fs/vfs.h>
+#include <utils/string.h>
 
 // Helper to parse IP address
 static uint32_t parse_ip(const char *str)
@@ -211,6 +213,103 @@ void cmd_netstat(int argc, char **argv)
     print_str("Done.\n");
 }
 
+void cmd_offload(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        uint32_t offload;
+        if (strcmp(argv[1], "on") == 0)
+            offload = E1000_OFFLOAD_CSUM | E1000_OFFLOAD_TSO;
+        else if (strcmp(argv[1], "csum") == 0)
+            offload = E1000_OFFLOAD_CSUM;
+        else if (strcmp(argv[1], "off") == 0)
+            offload = 0;
+        else
+        {
+            print_str("Usage: offload [on|csum|off]\n");
+            return;
+        }
+        e1000_set_offload(offload);
+    }
+
+    uint32_t offload = e1000_get_offload();
+    print_str("Checksum offload: ");
+    print_str((offload & E1000_OFFLOAD_CSUM) ? "on\n" : "off\n");
+    print_str("TCP segmentation offload: ");
+    print_str((offload & E1000_OFFLOAD_TSO) ? "on\n" : "off\n");
+}
+
+// Print MB/s as GB/s with two decimals
+static void print_gbps(uint32_t mbps)
+{
+    uint32_t frac = (mbps % 1000) / 10;
+    print_uint(mbps / 1000);
+    print_str(frac < 10 ? ".0" : ".");
+    print_uint(frac);
+}
+
+void cmd_csumbench(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    int errors = checksum_selftest();
+    print_str("checksum: ");
+    print_str((char *)checksum_strategy());
+    if (errors == 0)
+    {
+        print_str(", self-test passed\n");
+    }
+    else if (errors < 0)
+    {
+        print_str(", self-test out of memory\n");
+    }
+    else
+    {
+        print_str(", self-test mismatches: ");
+        print_int(errors);
+        print_str("\n");
+    }
+
+    checksum_bench_result_t results[CHECKSUM_BENCH_SIZES];
+    int count = checksum_benchmark(results, CHECKSUM_BENCH_SIZES);
+    if (count == 0)
+    {
+        print_str("csumbench: out of memory\n");
+        return;
+    }
+
+    print_str("GB/s (reference -> adc64 -> simd):\n");
+    for (int i = 0; i < count; i++)
+    {
+        print_str("  ");
+        if (results[i].size >= 1024 * 1024)
+        {
+            print_uint(results[i].size / (1024 * 1024));
+            print_str(" MB: ");
+        }
+        else if (results[i].size >= 1024)
+        {
+            print_uint(results[i].size / 1024);
+            print_str(" KB: ");
+        }
+        else
+        {
+            print_uint(results[i].size);
+            print_str(" B: ");
+        }
+        print_gbps(results[i].ref_mbps);
+        print_str(" -> ");
+        print_gbps(results[i].scalar_mbps);
+        print_str(" -> ");
+        if (results[i].simd_mbps)
+            print_gbps(results[i].simd_mbps);
+        else
+            print_str("n/a");
+        print_str("\n");
+    }
+}
+
 void cmd_wget(int argc, char **argv)
 {
     if (argc < 4)
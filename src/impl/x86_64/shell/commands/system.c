@@ -1,14 +1,39 @@
-// System commands: heap, pci
+// System commands: heap, heapprof, pages, membench, pci
 
 #include <shell/commands.h>
 #include <shell/print.h>
 #include <memory/heap.h>
+#include <memory/buddy.h>
+#include <memory/heap_trace.h>
 #include <drivers/pci.h>
+#include <utils/string.h>
+#include <utils/memory.h>
+
+static void heap_print_bench(void)
+{
+    heap_bench_result_t results[HEAP_BENCH_SIZES];
+    heap_benchmark(results, HEAP_BENCH_SIZES);
+
+    print_str("Alloc+free cycles (block list -> slab):\n");
+    for (int i = 0; i < HEAP_BENCH_SIZES; i++)
+    {
+        print_str("  ");
+        print_uint(results[i].size);
+        print_str(" B: ");
+        print_uint((uint32_t)results[i].block_cycles);
+        print_str(" -> ");
+        print_uint((uint32_t)results[i].slab_cycles);
+        print_str("\n");
+    }
+}
 
 void cmd_heap(int argc, char **argv)
 {
-    (void)argc;
-    (void)argv;
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        heap_print_bench();
+        return;
+    }
 
     uint32_t total, used, free_mem;
     heap_stats(&total, &used, &free_mem);
@@ -35,6 +60,273 @@ void cmd_heap(int argc, char **argv)
     print_str(" KB (");
     print_uint((free_mem * 100) / total);
     print_str("%)\n");
+
+    uint32_t peak, limit;
+    heap_growth_stats(&peak, &limit);
+    print_str("  Peak:  ");
+    print_uint(peak / 1024);
+    print_str(" KB (limit ");
+    print_uint(limit / 1024);
+    print_str(" KB)\n");
+
+    heap_frag_info_t frag;
+    heap_frag_stats(&frag);
+    print_str("Fragmentation:\n");
+    print_str("  Free blocks: ");
+    print_uint(frag.free_blocks);
+    print_str(", largest: ");
+    print_uint(frag.largest_free / 1024);
+    print_str(" KB");
+    if (frag.free_bytes > 0)
+    {
+        print_str(" (");
+        print_uint(100 - (uint32_t)(((uint64_t)frag.largest_free * 100) / frag.free_bytes));
+        print_str("% fragmented)");
+    }
+    print_str("\n");
+    for (int i = 0; i < HEAP_FREE_BINS; i++)
+    {
+        if (frag.bin_counts[i] == 0)
+            continue;
+        print_str("  >= ");
+        if (i >= 10)
+        {
+            print_uint(1u << (i - 10));
+            print_str(" KB: ");
+        }
+        else
+        {
+            print_uint(1u << i);
+            print_str(" B: ");
+        }
+        print_uint(frag.bin_counts[i]);
+        print_str("\n");
+    }
+
+    heap_slab_info_t slabs[16];
+    int classes = heap_slab_stats(slabs, 16);
+    print_str("Slab caches (size: slabs / objects in use):\n");
+    for (int i = 0; i < classes; i++)
+    {
+        print_str("  ");
+        print_uint(slabs[i].object_size);
+        print_str(": ");
+        print_uint(slabs[i].slab_count);
+        print_str(" / ");
+        print_uint(slabs[i].objects_in_use);
+        print_str("\n");
+    }
+}
+
+// Full-width 64-bit address; print_hex goes through a 32-bit itoa
+static void heapprof_print_addr(uintptr_t addr)
+{
+    static const char digits[] = "0123456789abcdef";
+    char buf[19];
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (int i = 0; i < 16; i++)
+        buf[2 + i] = digits[(addr >> ((15 - i) * 4)) & 0xF];
+    buf[18] = '\0';
+    print_str(buf);
+}
+
+static void heapprof_print_sites(int by_count)
+{
+    heap_trace_site_t top[10];
+    int n = heap_trace_top(top, 10, by_count);
+
+    print_str(by_count ? "Top allocators by count:\n" : "Top allocators by bytes:\n");
+    print_str("  caller            allocs  freed   bytes KB  live KB\n");
+    for (int i = 0; i < n; i++)
+    {
+        print_str("  ");
+        heapprof_print_addr((uintptr_t)top[i].caller);
+        print_str("  ");
+        print_uint(top[i].allocs);
+        print_str("  ");
+        print_uint(top[i].frees);
+        print_str("  ");
+        print_uint((uint32_t)(top[i].bytes / 1024));
+        print_str("  ");
+        print_uint((uint32_t)(top[i].live_bytes / 1024));
+        print_str("\n");
+    }
+}
+
+static void heapprof_print_bar(uint32_t value, uint32_t max)
+{
+    uint32_t len = max ? (value * 40) / max : 0;
+    for (uint32_t i = 0; i < len; i++)
+        print_char('#');
+    print_str(" ");
+    print_uint(value);
+    print_str("\n");
+}
+
+static void heapprof_print_histograms(void)
+{
+    uint32_t rate[16];
+    uint64_t slice_us = heap_trace_rate_histogram(rate, 16);
+
+    uint32_t max = 0;
+    for (int i = 0; i < 16; i++)
+        if (rate[i] > max)
+            max = rate[i];
+
+    print_str("Allocations per ");
+    print_uint((uint32_t)slice_us);
+    print_str(" us (oldest first):\n");
+    for (int i = 0; i < 16; i++)
+    {
+        print_str("  ");
+        heapprof_print_bar(rate[i], max);
+    }
+
+    uint32_t sizes[24];
+    heap_trace_size_histogram(sizes, 24);
+    max = 0;
+    for (int i = 0; i < 24; i++)
+        if (sizes[i] > max)
+            max = sizes[i];
+
+    print_str("Allocation sizes:\n");
+    for (int i = 0; i < 24; i++)
+    {
+        if (sizes[i] == 0)
+            continue;
+        print_str("  >= ");
+        print_uint(1u << i);
+        print_str(" B: ");
+        heapprof_print_bar(sizes[i], max);
+    }
+}
+
+void cmd_heapprof(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        print_str("Usage: heapprof on|off|top|count|hist\n");
+        print_str("Tracing is ");
+        print_str(heap_trace_enabled ? "on" : "off");
+        print_str(", ");
+        print_uint(heap_trace_event_count());
+        print_str(" events recorded\n");
+        return;
+    }
+
+    if (strcmp(argv[1], "on") == 0)
+    {
+        heap_trace_start();
+        print_str("Heap tracing started\n");
+    }
+    else if (strcmp(argv[1], "off") == 0)
+    {
+        heap_trace_stop();
+        print_str("Heap tracing stopped\n");
+    }
+    else if (strcmp(argv[1], "top") == 0)
+    {
+        heapprof_print_sites(0);
+    }
+    else if (strcmp(argv[1], "count") == 0)
+    {
+        heapprof_print_sites(1);
+    }
+    else if (strcmp(argv[1], "hist") == 0)
+    {
+        heapprof_print_histograms();
+    }
+    else
+    {
+        print_str("Unknown option: ");
+        print_str(argv[1]);
+        print_str("\n");
+        return;
+    }
+
+    if (heap_trace_dropped())
+    {
+        print_str("(");
+        print_uint(heap_trace_dropped());
+        print_str(" events not attributed: tables full)\n");
+    }
+}
+
+void cmd_pages(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    buddy_stats_t stats;
+    buddy_get_stats(&stats);
+
+    if (stats.total_pages == 0)
+    {
+        print_str("Page allocator not initialized\n");
+        return;
+    }
+
+    print_str("Physical Pages:\n");
+    print_str("  Total: ");
+    print_uint((uint32_t)(stats.total_pages * BUDDY_PAGE_SIZE / 1024));
+    print_str(" KB\n");
+    print_str("  Free:  ");
+    print_uint((uint32_t)(stats.free_pages * BUDDY_PAGE_SIZE / 1024));
+    print_str(" KB (");
+    print_uint((uint32_t)((stats.free_pages * 100) / stats.total_pages));
+    print_str("%)\n");
+
+    print_str("Free blocks per order:\n");
+    for (int i = 0; i < BUDDY_ORDER_COUNT; i++)
+    {
+        print_str("  ");
+        print_uint((BUDDY_PAGE_SIZE << i) / 1024);
+        print_str(" KB: ");
+        print_uint(stats.free_blocks[i]);
+        print_str("\n");
+    }
+}
+
+void cmd_membench(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    memory_bench_result_t results[MEMORY_BENCH_SIZES];
+    int count = memory_benchmark(results, MEMORY_BENCH_SIZES);
+    if (count == 0)
+    {
+        print_str("membench: out of memory\n");
+        return;
+    }
+
+    print_str("memcpy MB/s (byte loop -> ");
+    print_str((char *)memory_copy_strategy());
+    print_str("):\n");
+    for (int i = 0; i < count; i++)
+    {
+        print_str("  ");
+        if (results[i].size >= 1024 * 1024)
+        {
+            print_uint(results[i].size / (1024 * 1024));
+            print_str(" MB: ");
+        }
+        else if (results[i].size >= 1024)
+        {
+            print_uint(results[i].size / 1024);
+            print_str(" KB: ");
+        }
+        else
+        {
+            print_uint(results[i].size);
+            print_str(" B: ");
+        }
+        print_uint(results[i].byte_mbps);
+        print_str(" -> ");
+        print_uint(results[i].fast_mbps);
+        print_str("\n");
+    }
 }
 
 void cmd_pci(int argc, char **argv)
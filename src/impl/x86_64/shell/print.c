@@ -1,6 +1,15 @@
 #include <shell/print.h>
 #include <graphics/font.h>
 #include <graphics/graphics.h>
+#include <utils/memory.h>
+#include <utils/timing.h>
+
+// Largest console the text buffer can track
+#define TEXT_MAX_COLS 256
+#define TEXT_MAX_ROWS 128
+
+// While output is scrolling, push frames to the screen at most this often
+#define SCROLL_FLUSH_INTERVAL_MS 16
 
 static uint32_t cursor_x = 0;
 static uint32_t cursor_y = 0;
@@ -33,7 +42,9 @@ static uint32_t fg_color = 0xFFFFFF; // White
 static uint32_t bg_color = 0x000000; // Black
 
 // Track which character cells have text (for clearing text only)
-static char text_buffer[80 * 25];
+static char text_buffer[TEXT_MAX_COLS * TEXT_MAX_ROWS];
+
+static uint64_t last_flush_tsc = 0;
 
 // Output redirection for piping
 static char *redirect_buffer = NULL;
@@ -44,11 +55,15 @@ void print_init(void)
 {
     max_cols = get_screen_width() / CHAR_WIDTH;
     max_rows = get_screen_height() / CHAR_HEIGHT;
+    if (max_cols > TEXT_MAX_COLS)
+        max_cols = TEXT_MAX_COLS;
+    if (max_rows > TEXT_MAX_ROWS)
+        max_rows = TEXT_MAX_ROWS;
     cursor_x = 0;
     cursor_y = 0;
 
     // Clear text buffer
-    for (int i = 0; i < 80 * 25; i++)
+    for (int i = 0; i < TEXT_MAX_COLS * TEXT_MAX_ROWS; i++)
     {
         text_buffer[i] = ' ';
     }
@@ -81,39 +96,38 @@ void print_clear()
 
 static void scroll_screen(void)
 {
-    // Scroll text buffer up one line
-    for (size_t row = 1; row < max_rows; row++)
+    // Shift the text buffer and the pixels up one line in a single move each
+    memmove(text_buffer, text_buffer + max_cols, (max_rows - 1) * max_cols);
+    for (size_t col = 0; col < max_cols; col++)
     {
-        for (size_t col = 0; col < max_cols; col++)
-        {
-            char c = text_buffer[row * max_cols + col];
-            text_buffer[(row - 1) * max_cols + col] = c;
-
-            // Redraw the character
-            if (c != ' ')
-            {
-                draw_char(c, col * CHAR_WIDTH, (row - 1) * CHAR_HEIGHT, fg_color, bg_color);
-            }
-            else
-            {
-                fill_rect(col * CHAR_WIDTH, (row - 1) * CHAR_HEIGHT, CHAR_WIDTH, CHAR_HEIGHT, bg_color);
-            }
-        }
+        text_buffer[(max_rows - 1) * max_cols + col] = ' ';
     }
 
-    // Clear last row
-    clear_row(max_rows - 1);
+    scroll_area(0, max_rows * CHAR_HEIGHT, CHAR_HEIGHT, bg_color);
     cursor_y = max_rows - 1;
 }
 
 void print_newline()
 {
+    int scrolled = 0;
+
     cursor_x = 0;
     cursor_y++;
 
     if (cursor_y >= max_rows)
     {
         scroll_screen();
+        scrolled = 1;
+    }
+
+    // Long-running commands still show output line by line. A scroll
+    // damages the whole console, so while scrolling only flush once a frame.
+    uint64_t now = timing_rdtsc();
+    uint64_t interval = timing_tsc_khz() * SCROLL_FLUSH_INTERVAL_MS;
+    if (!scrolled || now - last_flush_tsc >= interval)
+    {
+        graphics_flush();
+        last_flush_tsc = now;
     }
 }
 
@@ -708,7 +708,12 @@ void shell_run(void)
         }
 
         wm_render();
-        net_process_packet();
+        graphics_flush();
+
+        // Received frames are normally handled on the e1000 interrupt's
+        // exit; only a backlog past the poll budget is left for us here
+        if (net_poll(NET_RX_BUDGET))
+            continue;
 
         // Halt CPU until next interrupt to reduce power consumption
         asm volatile("hlt");
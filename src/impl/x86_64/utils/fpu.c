@@ -0,0 +1,269 @@
+#include <utils/fpu.h>
+#include <interrupts/idt.h>
+#include <interrupts/irq_flags.h>
+#include <shell/shell.h>
+
+// Lazy FPU ownership:
+// CR0.TS stays set unless the live SSE/AVX registers belong to the
+// innermost open section. The first SIMD instruction of a section traps
+// with #NM; only then is the interrupted section's state saved (if it
+// had any) and fresh state loaded. Sections that never touch SIMD, and
+// interrupts that arrive during them, pay nothing beyond a counter.
+
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+#define CR4_OSXSAVE (1 << 18)
+
+#define XCR0_X87 (1 << 0)
+#define XCR0_SSE (1 << 1)
+#define XCR0_AVX (1 << 2)
+
+#define FPU_SAVE_AREA_SIZE 1024 // Legacy 512 B + xsave header + AVX upper halves
+#define FPU_DEFAULT_MXCSR 0x1F80 // All exceptions masked, round to nearest
+
+extern void fpu_interrupt_handler(void);
+
+static uint32_t features = 0;
+static uint64_t xsave_mask = 0;
+
+// Open sections; level 0 is plain kernel code outside any section
+static volatile uint32_t fpu_depth = 0;
+// Level whose state is in the registers (0 = none)
+static volatile uint32_t fpu_owner = 0;
+static uint8_t fpu_saved[FPU_MAX_DEPTH + 1];
+static uint8_t fpu_save_area[FPU_MAX_DEPTH + 1][FPU_SAVE_AREA_SIZE] __attribute__((aligned(64)));
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    __asm__ volatile("cpuid"
+                     : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint64_t read_cr0(void)
+{
+    uint64_t v;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr0(uint64_t v)
+{
+    __asm__ volatile("mov %0, %%cr0" ::"r"(v) : "memory");
+}
+
+static inline uint64_t read_cr4(void)
+{
+    uint64_t v;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr4(uint64_t v)
+{
+    __asm__ volatile("mov %0, %%cr4" ::"r"(v) : "memory");
+}
+
+static inline void fpu_set_ts(void)
+{
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static inline void fpu_clear_ts(void)
+{
+    __asm__ volatile("clts" ::: "memory");
+}
+
+static void fpu_save(uint32_t level)
+{
+    uint8_t *area = fpu_save_area[level];
+    if (features & FPU_FEATURE_XSAVE)
+        __asm__ volatile("xsave64 %0" : "=m"(*(uint8_t(*)[FPU_SAVE_AREA_SIZE])area)
+                         : "a"((uint32_t)xsave_mask), "d"((uint32_t)(xsave_mask >> 32))
+                         : "memory");
+    else
+        __asm__ volatile("fxsave64 %0" : "=m"(*(uint8_t(*)[FPU_SAVE_AREA_SIZE])area)::"memory");
+}
+
+static void fpu_restore(uint32_t level)
+{
+    uint8_t *area = fpu_save_area[level];
+    if (features & FPU_FEATURE_XSAVE)
+        __asm__ volatile("xrstor64 %0" ::"m"(*(uint8_t(*)[FPU_SAVE_AREA_SIZE])area),
+                         "a"((uint32_t)xsave_mask), "d"((uint32_t)(xsave_mask >> 32))
+                         : "memory");
+    else
+        __asm__ volatile("fxrstor64 %0" ::"m"(*(uint8_t(*)[FPU_SAVE_AREA_SIZE])area) : "memory");
+}
+
+static void fpu_load_clean(void)
+{
+    uint32_t mxcsr = FPU_DEFAULT_MXCSR;
+    __asm__ volatile("fninit; ldmxcsr %0" ::"m"(mxcsr));
+    if (features & FPU_FEATURE_AVX)
+        __asm__ volatile("vzeroall");
+}
+
+void fpu_init(void)
+{
+    uint32_t a, b, c, d;
+    uint32_t max_leaf;
+
+    cpuid(0, 0, &max_leaf, &b, &c, &d);
+    cpuid(1, 0, &a, &b, &c, &d);
+
+    if (!(d & (1 << 26)))
+    {
+        serial_print("FPU: SSE2 not supported, SIMD sections disabled\n");
+        return;
+    }
+    features |= FPU_FEATURE_SSE2;
+
+    // x87 present, monitor TS on WAIT, no emulation
+    write_cr0((read_cr0() | CR0_MP) & ~CR0_EM);
+    uint64_t cr4 = read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+
+    int has_xsave = (c >> 26) & 1;
+    int has_avx = (c >> 28) & 1;
+    if (has_xsave)
+    {
+        write_cr4(cr4 | CR4_OSXSAVE);
+        xsave_mask = XCR0_X87 | XCR0_SSE;
+        if (has_avx)
+            xsave_mask |= XCR0_AVX;
+        __asm__ volatile("xsetbv" ::"c"(0), "a"((uint32_t)xsave_mask),
+                         "d"((uint32_t)(xsave_mask >> 32)));
+
+        // Size of the save area for the enabled components
+        cpuid(0xD, 0, &a, &b, &c, &d);
+        if (b <= FPU_SAVE_AREA_SIZE)
+        {
+            features |= FPU_FEATURE_XSAVE;
+            if (has_avx)
+            {
+                features |= FPU_FEATURE_AVX;
+                if (max_leaf >= 7)
+                {
+                    cpuid(7, 0, &a, &b, &c, &d);
+                    if (b & (1 << 5))
+                        features |= FPU_FEATURE_AVX2;
+                }
+            }
+        }
+        else
+        {
+            // Save area would not fit: stay on SSE with fxsave
+            xsave_mask = XCR0_X87 | XCR0_SSE;
+            __asm__ volatile("xsetbv" ::"c"(0), "a"((uint32_t)xsave_mask), "d"(0));
+        }
+    }
+    else
+    {
+        write_cr4(cr4);
+    }
+
+    fpu_clear_ts();
+    fpu_load_clean();
+
+    fpu_depth = 0;
+    fpu_owner = 0;
+    for (int i = 0; i <= FPU_MAX_DEPTH; i++)
+        fpu_saved[i] = 0;
+
+    idt_set_gate(7, (uint64_t)fpu_interrupt_handler);
+    fpu_set_ts();
+
+    serial_print("FPU: SSE2");
+    if (features & FPU_FEATURE_AVX)
+        serial_print(" AVX");
+    if (features & FPU_FEATURE_AVX2)
+        serial_print(" AVX2");
+    serial_print((features & FPU_FEATURE_XSAVE) ? " (xsave)\n" : " (fxsave)\n");
+}
+
+uint32_t fpu_features(void)
+{
+    return features;
+}
+
+void kernel_fpu_begin(void)
+{
+    uint64_t flags = irq_save();
+
+    if (fpu_depth >= FPU_MAX_DEPTH)
+    {
+        // There is no level left to save into. Carrying on would let this
+        // section clobber its parent's registers, and its end would pop
+        // the parent's level, so stop here.
+        serial_print("FPU: kernel_fpu_begin nested too deeply, halting\n");
+        for (;;)
+            __asm__ volatile("cli; hlt");
+    }
+
+    // The new level owns nothing yet; trap on its first SIMD instruction
+    fpu_depth++;
+    fpu_set_ts();
+
+    irq_restore(flags);
+}
+
+void kernel_fpu_end(void)
+{
+    uint64_t flags = irq_save();
+
+    if (fpu_depth == 0)
+    {
+        serial_print("FPU: kernel_fpu_end without begin\n");
+        irq_restore(flags);
+        return;
+    }
+
+    // This level's register contents are dead, including any copy parked
+    // when a nested section took the FPU
+    if (fpu_owner == fpu_depth)
+        fpu_owner = 0;
+    fpu_saved[fpu_depth] = 0;
+    fpu_depth--;
+
+    // If the outer level's state was never displaced, hand it straight back
+    if (fpu_depth > 0 && fpu_owner == fpu_depth)
+        fpu_clear_ts();
+    else
+        fpu_set_ts();
+
+    irq_restore(flags);
+}
+
+// Called from the #NM stub with interrupts disabled
+void fpu_handle_device_not_available(void)
+{
+    uint32_t level = fpu_depth;
+
+    if (level == 0)
+        serial_print("FPU: SIMD used outside kernel_fpu_begin/end\n");
+
+    fpu_clear_ts();
+
+    // Park the interrupted level's live registers
+    if (fpu_owner != 0 && fpu_owner != level)
+    {
+        fpu_save(fpu_owner);
+        fpu_saved[fpu_owner] = 1;
+    }
+
+    if (fpu_saved[level])
+    {
+        fpu_restore(level);
+        fpu_saved[level] = 0;
+    }
+    else
+    {
+        fpu_load_clean();
+    }
+
+    fpu_owner = level;
+}
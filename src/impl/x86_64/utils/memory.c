@@ -1,40 +1,129 @@
 // Add to a new file: src/utils/memory.c
 
 #include <utils/memory.h>
+#include <utils/timing.h>
+#include <memory/buddy.h>
+
+// Unaligned 8-byte access (x86 handles misaligned loads/stores in hardware)
+typedef uint64_t __attribute__((may_alias, aligned(1))) memory_word_t;
+
+// Copies at or above this size use the string instructions
+#define MEMORY_REP_THRESHOLD 256
+
+static uint8_t memory_erms = 0; // Enhanced REP MOVSB/STOSB (CPUID.7.0:EBX[9])
+static uint8_t memory_fsrm = 0; // Fast short REP MOVSB (CPUID.7.0:EDX[4])
+static size_t memory_rep_threshold = MEMORY_REP_THRESHOLD;
+
+static inline void memory_cpuid(uint32_t leaf, uint32_t subleaf,
+                                uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    __asm__ volatile("cpuid"
+                     : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+void memory_init(void)
+{
+    uint32_t a, b, c, d;
+
+    memory_cpuid(0, 0, &a, &b, &c, &d);
+    if (a >= 7)
+    {
+        memory_cpuid(7, 0, &a, &b, &c, &d);
+        memory_erms = (b >> 9) & 1;
+        memory_fsrm = (d >> 4) & 1;
+    }
+
+    // With FSRM even short rep movsb beats a word loop
+    if (memory_fsrm)
+        memory_rep_threshold = 0;
+}
+
+const char *memory_copy_strategy(void)
+{
+    if (memory_fsrm)
+        return "rep movsb (ERMS+FSRM)";
+    if (memory_erms)
+        return "rep movsb (ERMS)";
+    return "rep movsq";
+}
+
+// Forward 8-byte loop for short copies; stores are aligned once dest is
+static inline void copy_forward_words(unsigned char *d, const unsigned char *s, size_t num)
+{
+    if (num >= 8)
+    {
+        while ((uintptr_t)d & 7)
+        {
+            *d++ = *s++;
+            num--;
+        }
+        while (num >= 8)
+        {
+            *(memory_word_t *)d = *(const memory_word_t *)s;
+            d += 8;
+            s += 8;
+            num -= 8;
+        }
+    }
+    while (num--)
+        *d++ = *s++;
+}
 
 // optimized memset
 void *memset(void *ptr, int value, size_t num)
 {
     unsigned char *p = (unsigned char *)ptr;
     unsigned char val = (unsigned char)value;
-    
-    // Fill 8 bytes at a time if possible
-    if (num >= 8 && ((uintptr_t)ptr & 7) == 0)
+
+    if (num >= memory_rep_threshold && memory_erms)
+    {
+        __asm__ volatile("rep stosb"
+                         : "+D"(p), "+c"(num)
+                         : "a"(val)
+                         : "memory");
+        return ptr;
+    }
+
+    if (num >= 8)
     {
         uint64_t val64 = val;
         val64 |= val64 << 8;
         val64 |= val64 << 16;
         val64 |= val64 << 32;
-        
-        uint64_t *p64 = (uint64_t *)ptr;
+
+        // Align the destination, then fill 8 bytes at a time
+        while ((uintptr_t)p & 7)
+        {
+            *p++ = val;
+            num--;
+        }
+
         size_t chunks = num / 8;
-        
-        for (size_t i = 0; i < chunks; i++)
+        if (num >= MEMORY_REP_THRESHOLD)
         {
-            p64[i] = val64;
+            __asm__ volatile("rep stosq"
+                             : "+D"(p), "+c"(chunks)
+                             : "a"(val64)
+                             : "memory");
         }
-        
-        // Fill remaining bytes
-        p += chunks * 8;
-        num -= chunks * 8;
+        else
+        {
+            for (size_t i = 0; i < chunks; i++)
+            {
+                ((uint64_t *)p)[i] = val64;
+            }
+            p += chunks * 8;
+        }
+        num &= 7;
     }
-    
+
     // Fill remaining bytes
     for (size_t i = 0; i < num; i++)
     {
         p[i] = val;
     }
-    
+
     return ptr;
 }
 
@@ -42,12 +131,37 @@ void *memcpy(void *dest, const void *src, size_t num)
 {
     unsigned char *d = (unsigned char *)dest;
     const unsigned char *s = (const unsigned char *)src;
-    
-    for (size_t i = 0; i < num; i++)
+
+    if (num < memory_rep_threshold)
     {
-        d[i] = s[i];
+        copy_forward_words(d, s, num);
+        return dest;
+    }
+
+    if (memory_erms)
+    {
+        __asm__ volatile("rep movsb"
+                         : "+D"(d), "+S"(s), "+c"(num)
+                         :
+                         : "memory");
+        return dest;
+    }
+
+    // No ERMS: align the destination and move quadwords
+    while ((uintptr_t)d & 7)
+    {
+        *d++ = *s++;
+        num--;
     }
-    
+    size_t chunks = num / 8;
+    __asm__ volatile("rep movsq"
+                     : "+D"(d), "+S"(s), "+c"(chunks)
+                     :
+                     : "memory");
+    num &= 7;
+    while (num--)
+        *d++ = *s++;
+
     return dest;
 }
 
@@ -55,25 +169,34 @@ void *memmove(void *dest, const void *src, size_t num)
 {
     unsigned char *d = (unsigned char *)dest;
     const unsigned char *s = (const unsigned char *)src;
-    
-    // Handle overlapping memory regions
-    if (d < s)
+
+    // Forward copy is safe unless dest starts inside the source range
+    if (d <= s || d >= s + num)
     {
-        // Copy forward
-        for (size_t i = 0; i < num; i++)
-        {
-            d[i] = s[i];
-        }
+        return memcpy(dest, src, num);
     }
-    else if (d > s)
+
+    // Copy backward; reversed string ops are slow, so use a word loop
+    d += num;
+    s += num;
+    if (num >= 8)
     {
-        // Copy backward
-        for (size_t i = num; i > 0; i--)
+        while ((uintptr_t)d & 7)
         {
-            d[i - 1] = s[i - 1];
+            *--d = *--s;
+            num--;
+        }
+        while (num >= 8)
+        {
+            d -= 8;
+            s -= 8;
+            *(memory_word_t *)d = *(const memory_word_t *)s;
+            num -= 8;
         }
     }
-    
+    while (num--)
+        *--d = *--s;
+
     return dest;
 }
 
@@ -81,7 +204,7 @@ int memcmp(const void *ptr1, const void *ptr2, size_t num)
 {
     const unsigned char *p1 = (const unsigned char *)ptr1;
     const unsigned char *p2 = (const unsigned char *)ptr2;
-    
+
     for (size_t i = 0; i < num; i++)
     {
         if (p1[i] != p2[i])
@@ -89,6 +212,67 @@ int memcmp(const void *ptr1, const void *ptr2, size_t num)
             return p1[i] - p2[i];
         }
     }
-    
+
     return 0;
-}
\ No newline at end of file
+}
+
+// Reference byte-at-a-time copy the benchmark compares against
+static __attribute__((noinline)) void memory_copy_bytes(unsigned char *d, const unsigned char *s, size_t num)
+{
+    for (size_t i = 0; i < num; i++)
+    {
+        d[i] = s[i];
+    }
+}
+
+#define MEMORY_BENCH_MAX (4u * 1024 * 1024)
+#define MEMORY_BENCH_BYTES (16u * 1024 * 1024) // Bytes copied per size
+
+int memory_benchmark(memory_bench_result_t *results, int count)
+{
+    unsigned char *src = (unsigned char *)kmalloc_pages(MEMORY_BENCH_MAX);
+    unsigned char *dst = (unsigned char *)kmalloc_pages(MEMORY_BENCH_MAX);
+    if (!src || !dst)
+    {
+        if (src)
+            kfree_pages(src);
+        if (dst)
+            kfree_pages(dst);
+        return 0;
+    }
+
+    memset(src, 0x5A, MEMORY_BENCH_MAX);
+    memset(dst, 0, MEMORY_BENCH_MAX);
+
+    int n = 0;
+    for (uint32_t size = 16; size <= MEMORY_BENCH_MAX && n < count; size *= 4)
+    {
+        uint32_t iterations = MEMORY_BENCH_BYTES / size;
+        uint64_t bytes = (uint64_t)iterations * size;
+
+        uint64_t start = timing_rdtsc();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            memory_copy_bytes(dst, src, size);
+            __asm__ volatile("" ::: "memory");
+        }
+        uint64_t byte_cycles = timing_rdtsc() - start;
+
+        start = timing_rdtsc();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            memcpy(dst, src, size);
+            __asm__ volatile("" ::: "memory");
+        }
+        uint64_t fast_cycles = timing_rdtsc() - start;
+
+        results[n].size = size;
+        results[n].byte_mbps = timing_mb_per_sec(bytes, byte_cycles);
+        results[n].fast_mbps = timing_mb_per_sec(bytes, fast_cycles);
+        n++;
+    }
+
+    kfree_pages(src);
+    kfree_pages(dst);
+    return n;
+}
@@ -0,0 +1,112 @@
+#include <utils/timing.h>
+#include <interrupts/port_io.h>
+#include <interrupts/pic.h>
+#include <interrupts/irq_flags.h>
+#include <shell/shell.h>
+
+// PIT runs at 1.193182 MHz; channel 2 is gated through port 0x61
+#define PIT_FREQUENCY 1193182
+#define PIT_CH0_DATA 0x40
+#define PIT_CH2_DATA 0x42
+#define PIT_COMMAND 0x43
+#define PIT_GATE_PORT 0x61
+#define CALIBRATE_MS 10
+
+// Fallback used if calibration fails (typical QEMU TSC rate)
+#define DEFAULT_TSC_KHZ 2000000
+
+static uint64_t tsc_khz = 0;
+
+uint64_t timing_rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+void timing_init(void)
+{
+    uint16_t count = (uint16_t)(PIT_FREQUENCY * CALIBRATE_MS / 1000);
+
+    // Gate low, speaker off while programming
+    uint8_t gate = inb(PIT_GATE_PORT) & ~0x03;
+    outb(PIT_GATE_PORT, gate);
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CH2_DATA, count & 0xFF);
+    outb(PIT_CH2_DATA, count >> 8);
+
+    // Raise the gate to start counting
+    outb(PIT_GATE_PORT, gate | 0x01);
+    uint64_t start = timing_rdtsc();
+
+    // Bit 5 reflects channel 2 OUT, which goes high at terminal count
+    uint32_t spins = 0;
+    while (!(inb(PIT_GATE_PORT) & 0x20))
+    {
+        if (++spins > 10000000)
+            break;
+    }
+    uint64_t end = timing_rdtsc();
+
+    outb(PIT_GATE_PORT, gate);
+
+    if (spins > 10000000 || end <= start)
+    {
+        serial_print("Timing: PIT calibration failed, assuming 2 GHz TSC\n");
+        tsc_khz = DEFAULT_TSC_KHZ;
+        return;
+    }
+
+    tsc_khz = (end - start) / CALIBRATE_MS;
+
+    serial_print("Timing: TSC calibrated at ");
+    serial_print_dec((uint32_t)(tsc_khz / 1000));
+    serial_print(" MHz\n");
+}
+
+// Channel 0 drives IRQ0. Nothing keeps time with it; it is armed in
+// mode 0, which raises IRQ0 once at terminal count and then stays quiet,
+// so a halted CPU wakes for deferred work. The IRQ only needs its EOI.
+void timing_arm_wakeup(uint64_t us)
+{
+    uint64_t count = (PIT_FREQUENCY * us) / 1000000;
+    if (count == 0)
+        count = 1;
+    if (count > 0xFFFF)
+        count = 0xFFFF; // About 55 ms; an early wakeup just re-arms
+
+    uint64_t flags = irq_save();
+    outb(PIT_COMMAND, 0x30); // Channel 0, lobyte/hibyte, mode 0
+    outb(PIT_CH0_DATA, count & 0xFF);
+    outb(PIT_CH0_DATA, count >> 8);
+    outb(PIC1_DATA, inb(PIC1_DATA) & ~0x01);
+    irq_restore(flags);
+}
+
+uint64_t timing_tsc_khz(void)
+{
+    return tsc_khz;
+}
+
+uint64_t timing_cycles_to_ns(uint64_t cycles)
+{
+    uint64_t khz = tsc_khz ? tsc_khz : DEFAULT_TSC_KHZ;
+    return (cycles * 1000000) / khz;
+}
+
+uint64_t timing_cycles_to_us(uint64_t cycles)
+{
+    uint64_t khz = tsc_khz ? tsc_khz : DEFAULT_TSC_KHZ;
+    return (cycles * 1000) / khz;
+}
+
+uint32_t timing_mb_per_sec(uint64_t bytes, uint64_t cycles)
+{
+    uint64_t us = timing_cycles_to_us(cycles);
+    if (us == 0)
+        us = 1;
+    // bytes / us == MB/s (using 10^6 bytes per MB)
+    return (uint32_t)(bytes / us);
+}
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "drivers/pci.h"
+#include "net/netbuf.h"
 
 // e1000 Register Offsets
 #define E1000_CTRL      0x0000  // Device Control
@@ -10,6 +11,8 @@
 #define E1000_EERD      0x0014  // EEPROM Read
 #define E1000_CTRL_EXT  0x0018  // Extended Device Control
 #define E1000_ICR       0x00C0  // Interrupt Cause Read
+#define E1000_ITR       0x00C4  // Interrupt Throttling
+#define E1000_ICS       0x00C8  // Interrupt Cause Set
 #define E1000_IMS       0x00D0  // Interrupt Mask Set
 #define E1000_IMC       0x00D8  // Interrupt Mask Clear
 #define E1000_RCTL      0x0100  // Receive Control
@@ -28,6 +31,7 @@
 #define E1000_RAL       0x5400  // Receive Address Low
 #define E1000_RAH       0x5404  // Receive Address High
 #define E1000_MTA       0x5200  // Multicast Table Array
+#define E1000_RXCSUM    0x5000  // Receive Checksum Control
 
 // CTRL Register bits
 #define E1000_CTRL_SLU      (1 << 6)   // Set Link Up
@@ -43,6 +47,10 @@
 #define E1000_RCTL_BSIZE_2048 (0 << 16) // Buffer size 2048
 #define E1000_RCTL_SECRC    (1 << 26)  // Strip Ethernet CRC
 
+// RXCSUM Register bits
+#define E1000_RXCSUM_IPOFL  (1 << 8)   // IP checksum offload
+#define E1000_RXCSUM_TUOFL  (1 << 9)   // TCP/UDP checksum offload
+
 // TCTL Register bits
 #define E1000_TCTL_EN       (1 << 1)   // Transmitter Enable
 #define E1000_TCTL_PSP      (1 << 3)   // Pad Short Packets
@@ -57,10 +65,30 @@
 #define E1000_ICR_RXO       (1 << 6)   // RX Overrun
 #define E1000_ICR_RXT0      (1 << 7)   // RX Timer Interrupt
 
+// Receive causes handed to the bottom half
+#define E1000_RX_INTERRUPTS (E1000_ICR_RXT0 | E1000_ICR_RXDMT0 | E1000_ICR_RXO)
+
+// Minimum interrupt interval in 256 ns units (~8000 interrupts/s)
+#define E1000_ITR_INTERVAL  488
+
 // TX Descriptor Command bits
 #define E1000_TXD_CMD_EOP   (1 << 0)   // End of Packet
 #define E1000_TXD_CMD_IFCS  (1 << 1)   // Insert FCS
 #define E1000_TXD_CMD_RS    (1 << 3)   // Report Status
+#define E1000_TXD_CMD_TSE   (1 << 2)   // TCP Segmentation Enable (extended)
+#define E1000_TXD_CMD_DEXT  (1 << 5)   // Descriptor Extension
+
+// Context descriptor TUCMD bits (EOP/IFCS positions mean TCP/IP here)
+#define E1000_TXD_TUCMD_TCP (1 << 0)   // Packet is TCP (else UDP)
+#define E1000_TXD_TUCMD_IP  (1 << 1)   // Packet is IPv4
+
+// Descriptor types (bits 20-23 of the length dword)
+#define E1000_TXD_DTYP_CTX  (0 << 20)
+#define E1000_TXD_DTYP_DATA (1 << 20)
+
+// Data descriptor POPTS bits
+#define E1000_TXD_POPTS_IXSM (1 << 0)  // Insert IP checksum
+#define E1000_TXD_POPTS_TXSM (1 << 1)  // Insert TCP/UDP checksum
 
 // TX Descriptor Status bits
 #define E1000_TXD_STAT_DD   (1 << 0)   // Descriptor Done
@@ -68,14 +96,24 @@
 // RX Descriptor Status bits
 #define E1000_RXD_STAT_DD   (1 << 0)   // Descriptor Done
 #define E1000_RXD_STAT_EOP  (1 << 1)   // End of Packet
+#define E1000_RXD_STAT_IXSM (1 << 2)   // Ignore Checksum Indication
+#define E1000_RXD_STAT_TCPCS (1 << 5)  // TCP/UDP checksum calculated
+#define E1000_RXD_STAT_IPCS (1 << 6)   // IP checksum calculated
+
+// RX Descriptor Error bits
+#define E1000_RXD_ERR_TCPE  (1 << 5)   // TCP/UDP checksum error
+#define E1000_RXD_ERR_IPE   (1 << 6)   // IP checksum error
 
 // Descriptor counts (must be multiple of 8)
 #define E1000_NUM_RX_DESC 32
-#define E1000_NUM_TX_DESC 32
+#define E1000_NUM_TX_DESC 256  // Room for a few 64 KiB TSO chains
+
+// Offloads (runtime toggle, e1000_set_offload)
+#define E1000_OFFLOAD_CSUM  (1 << 0)   // TX checksum insertion, RX validation
+#define E1000_OFFLOAD_TSO   (1 << 1)   // TCP segmentation (needs CSUM)
 
-// Buffer sizes
-#define E1000_RX_BUFFER_SIZE 2048
-#define E1000_TX_BUFFER_SIZE 2048
+// Buffer sizes (RX buffers are whole netbufs)
+#define E1000_RX_BUFFER_SIZE NETBUF_SIZE
 
 // RX Descriptor
 typedef struct {
@@ -98,21 +136,57 @@ typedef struct {
     uint16_t special;   // Special
 } __attribute__((packed)) e1000_tx_desc_t;
 
+// TX Context Descriptor: checksum/TSO layout for the packets after it
+typedef struct {
+    uint8_t ipcss;      // IP checksum start
+    uint8_t ipcso;      // IP checksum offset
+    uint16_t ipcse;     // IP checksum end (inclusive)
+    uint8_t tucss;      // TCP/UDP checksum start
+    uint8_t tucso;      // TCP/UDP checksum offset
+    uint16_t tucse;     // TCP/UDP checksum end (0 = end of packet)
+    uint32_t cmd_len;   // TSO payload length, DTYP, TUCMD
+    uint8_t status;     // Status
+    uint8_t hdr_len;    // TSO header length
+    uint16_t mss;       // TSO segment payload size
+} __attribute__((packed)) e1000_tx_context_desc_t;
+
+// TX Extended Data Descriptor
+typedef struct {
+    uint64_t addr;      // Buffer address
+    uint32_t cmd_len;   // Length, DTYP, DCMD
+    uint8_t status;     // Status
+    uint8_t popts;      // Packet options
+    uint16_t special;   // Special
+} __attribute__((packed)) e1000_tx_data_desc_t;
+
 // e1000 Device structure
 typedef struct {
     pci_device_t *pci_dev;
     uint64_t mmio_base;         // Memory-mapped I/O base
     uint8_t mac_addr[6];        // MAC address
 
-    // RX ring
+    // RX ring; each descriptor owns the netbuf it DMAs into
     e1000_rx_desc_t *rx_descs;
-    uint8_t *rx_buffers[E1000_NUM_RX_DESC];
+    netbuf_t *rx_netbufs[E1000_NUM_RX_DESC];
     uint16_t rx_cur;
+    uint32_t rx_dropped;               // Frames dropped for lack of a netbuf
+    uint32_t rx_csum_errors;           // Frames the NIC flagged as corrupt
 
-    // TX ring
+    // TX ring: descriptors from tx_clean up to tx_cur are queued or on
+    // the wire; tx_tail is the last value written to TDT
     e1000_tx_desc_t *tx_descs;
-    uint8_t *tx_buffers[E1000_NUM_TX_DESC];
+    netbuf_t *tx_netbufs[E1000_NUM_TX_DESC];  // Held by each packet's EOP slot
+    uint16_t tx_eop[E1000_NUM_TX_DESC];       // First slot -> its EOP slot
+    uint32_t tx_context;               // Layout of the last context descriptor
     uint16_t tx_cur;
+    uint16_t tx_clean;
+    uint16_t tx_used;
+    uint16_t tx_tail;
+    uint8_t tx_batch;                  // Open batches; TDT written on the last end
+    uint32_t offload;                  // E1000_OFFLOAD_* currently enabled
+
+    uint8_t irq_enabled;               // Interrupt line routed and unmasked
+    volatile uint8_t rx_scheduled;     // RX interrupts masked, poll pending
 
     int initialized;
 } e1000_device_t;
@@ -120,9 +194,34 @@ typedef struct {
 // e1000 functions
 int e1000_init(void);
 int e1000_send_packet(const void *data, size_t length);
-int e1000_receive_packet(void *buffer, size_t max_length);
 void e1000_get_mac_address(uint8_t *mac);
+
+// Zero-copy paths. e1000_send_netbuf() takes over the caller's reference
+// (also on failure) and drops it once the frame is on the wire.
+// e1000_receive_netbuf() hands up the DMA buffer itself, or NULL when
+// the ring is empty; the caller owns the returned reference.
+int e1000_send_netbuf(netbuf_t *nb);
+netbuf_t *e1000_receive_netbuf(void);
 void e1000_handle_interrupt(void);
+
+// Sends only queue descriptors; completed ones are reclaimed on the next
+// send or the TX interrupt. Between begin and end the tail register is
+// left alone and written once for the whole batch.
+void e1000_tx_batch_begin(void);
+void e1000_tx_batch_end(void);
+
+// NAPI-style receive: the interrupt masks RX causes and schedules a poll;
+// e1000_rx_complete() unmasks them once the poll has drained the ring,
+// e1000_rx_reschedule() when it stopped early with frames left.
+// Without a usable interrupt line the poll stays scheduled for good.
+int e1000_rx_scheduled(void);
+void e1000_rx_complete(void);
+void e1000_rx_reschedule(void);
+int e1000_rx_interrupts(void);
+
+// Checksum and segmentation offload; returns the offloads now in effect
+uint32_t e1000_set_offload(uint32_t offload);
+uint32_t e1000_get_offload(void);
 int e1000_link_up(void);
 uint64_t e1000_get_mmio_base(void);
 uint32_t e1000_get_status(void);
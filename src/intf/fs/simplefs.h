@@ -63,6 +63,18 @@ typedef struct simplefs_dir_entry
     char name[252];    // Fixed size name buffer
 } __attribute__((packed)) simplefs_dir_entry_t;
 
+// Per-filesystem caches so file I/O does no heap allocation
+#define SIMPLEFS_INODE_CACHE_SIZE 32 // Direct-mapped by inode number
+#define SIMPLEFS_IO_BUFFERS 4        // Scratch block buffers
+#define SIMPLEFS_IO_BUFFER_SIZE 512  // Larger block sizes fall back to kmalloc
+
+typedef struct simplefs_inode_cache_entry
+{
+    uint32_t inode_number;
+    uint8_t valid;
+    simplefs_inode_t inode;
+} simplefs_inode_cache_entry_t;
+
 typedef struct simplefs_filesystem simplefs_filesystem_t;
 
 struct simplefs_filesystem
@@ -86,6 +98,13 @@ struct simplefs_filesystem
 
     // Cached superblock
     simplefs_superblock_t superblock;
+
+    // Write-through inode cache
+    simplefs_inode_cache_entry_t inode_cache[SIMPLEFS_INODE_CACHE_SIZE];
+
+    // Reusable block buffers for partial-block I/O
+    uint8_t io_buffers[SIMPLEFS_IO_BUFFERS][SIMPLEFS_IO_BUFFER_SIZE] __attribute__((aligned(16)));
+    uint8_t io_buffer_used[SIMPLEFS_IO_BUFFERS];
 };
 
 // Global filesystem instance (extern for access from other files)
@@ -2,8 +2,15 @@
 
 #include <stdint.h>
 
+#define FONT_GLYPHS 128
+#define FONT_CACHE_PAIRS 8   // (fg, bg) color pairs kept expanded
+#define FONT_BENCH_SCREENS 8 // 80x25 screens drawn per benchmark pass
+
 // Simple 8x8 bitmap font
-extern const uint8_t font_8x8[128][8];
+extern const uint8_t font_8x8[FONT_GLYPHS][8];
 
 void draw_char(char c, uint32_t x, uint32_t y, uint32_t fg_color, uint32_t bg_color);
 void draw_string(const char *str, uint32_t x, uint32_t y, uint32_t fg_color, uint32_t bg_color);
+
+// Characters per second: bit-by-bit renderer vs the glyph atlas
+void font_benchmark(uint32_t *bitwise_cps, uint32_t *cached_cps);
@@ -2,6 +2,15 @@
 
 #include <stdint.h>
 
+// Clip rectangle for the blit primitives
+typedef struct
+{
+    int32_t x;
+    int32_t y;
+    uint32_t w;
+    uint32_t h;
+} graphics_rect_t;
+
 // Initialize graphics system
 void graphics_init(void);
 
@@ -14,6 +23,30 @@ void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, int isFilled);
 void draw_circle(int cx, int cy, int radius, uint32_t color, int isFilled);
 
+// Restrict all drawing to a rectangle (NULL = whole screen)
+void graphics_set_clip(const graphics_rect_t *clip);
+
+// Row-span primitives: clip once per call, then copy/fill whole rows.
+// `clip` further narrows the current drawing clip and may be NULL.
+void fill_span(uint32_t x, uint32_t y, uint32_t len, uint32_t color);
+void blit_rect(int32_t x, int32_t y, const uint32_t *src, uint32_t src_stride,
+               uint32_t w, uint32_t h, const graphics_rect_t *clip);
+// Like blit_rect, but source pixels equal to `key` are left transparent
+void blit_rect_keyed(int32_t x, int32_t y, const uint32_t *src, uint32_t src_stride,
+                     uint32_t w, uint32_t h, uint32_t key, const graphics_rect_t *clip);
+// Move full-width rows [y + lines, y + h) up to y and fill the exposed rows
+void scroll_area(uint32_t y, uint32_t h, uint32_t lines, uint32_t fill_color);
+// Clipped copy into an arbitrary pixel buffer (e.g. a window's content)
+void blit_to_buffer(uint32_t *dst, uint32_t dst_stride, uint32_t dst_width, uint32_t dst_height,
+                    int32_t x, int32_t y, const uint32_t *src, uint32_t src_stride,
+                    uint32_t w, uint32_t h);
+
+// Drawing goes to an off-screen back buffer. Damaged areas are tracked
+// as a short list of rectangles and copied to the screen by graphics_flush.
+#define GRAPHICS_MAX_DIRTY_RECTS 32
+void graphics_mark_dirty(int32_t x, int32_t y, uint32_t w, uint32_t h);
+void graphics_flush(void);
+
 // struct pixel_info
 // {
 //     uint32_t width;
@@ -45,7 +45,8 @@ typedef struct desktop {
     // Taskbar button hover state
     int hover_button;  // -1 = none, 0 = editor, 1 = draw, 2 = terminal
 
-    // Background image (optional)
+    // Background image (optional), pre-scaled to the area above the taskbar
+    // so exposing the desktop is a rectangle copy
     uint32_t *bg_pixels;
     uint32_t bg_width;
     uint32_t bg_height;
@@ -69,6 +70,9 @@ int desktop_handle_mouse(int32_t x, int32_t y, uint8_t buttons);
 // Render the desktop (taskbar, background)
 void desktop_render(void);
 
+// Render only the part of the desktop inside a screen rectangle
+void desktop_render_rect(int32_t x, int32_t y, uint32_t w, uint32_t h);
+
 // Open an application
 void desktop_open_app(app_type_t app);
 
@@ -17,3 +17,16 @@ jpg_image_t *jpg_load_file(const char *path);
 
 // Free JPG image
 void jpg_free(jpg_image_t *img);
+
+// Decode benchmark: repeatedly decodes an in-memory JPEG
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t iterations;
+    uint32_t us_per_image;
+    uint32_t us_per_mpixel;
+} jpg_bench_result_t;
+
+// Returns 0 on success, -1 if the image does not decode
+int jpg_benchmark(const uint8_t *data, size_t size, uint32_t iterations,
+                  jpg_bench_result_t *result);
@@ -9,11 +9,39 @@ typedef struct {
     uint32_t *pixels;  // ARGB format
 } png_image_t;
 
+// Progressive decoding hooks; either may be 0
+typedef struct {
+    // Header parsed: `img` is allocated and blank, rows follow top to bottom
+    void (*on_header)(void *ctx, png_image_t *img);
+    // Row `y` of img->pixels is final
+    void (*on_row)(void *ctx, png_image_t *img, uint32_t y);
+    void *ctx;
+} png_callbacks_t;
+
 // Load PNG from memory buffer
 png_image_t *png_load(const uint8_t *data, size_t size);
 
 // Load PNG from file
 png_image_t *png_load_file(const char *path);
 
+// Load PNG from file, decoding while it is read. Scanlines are inflated and
+// unfiltered one at a time into the image, so memory stays near the size of
+// the output pixels. On failure the image passed to on_header is freed.
+png_image_t *png_load_file_progressive(const char *path, const png_callbacks_t *cb);
+
 // Free PNG image
 void png_free(png_image_t *img);
+
+// Decode benchmark: repeatedly decodes an in-memory PNG
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t iterations;
+    uint32_t raw_bytes;     // Inflated (filtered) bytes per decode
+    uint32_t us_per_image;
+    uint32_t mbps;          // Inflated MB/s
+} png_bench_result_t;
+
+// Returns 0 on success, -1 if the image does not decode
+int png_benchmark(const uint8_t *data, size_t size, uint32_t iterations,
+                  png_bench_result_t *result);
@@ -57,6 +57,8 @@ void window_resize(window_t *win, uint32_t width, uint32_t height);
 void window_focus(window_t *win);
 void window_set_title(window_t *win, const char *title);
 void window_invalidate(window_t *win);
+void window_invalidate_rect(window_t *win, uint32_t x, uint32_t y,
+                            uint32_t w, uint32_t h); // Content coordinates
 
 // Drawing to window content
 void window_clear(window_t *win, uint32_t color);
@@ -73,6 +75,7 @@ void wm_handle_mouse(int32_t x, int32_t y, uint8_t buttons);
 void wm_render(void);
 int wm_needs_render(void);  // Returns 1 if any window needs redrawing
 void wm_force_render(void); // Force full redraw
+void wm_damage_rect(int32_t x, int32_t y, uint32_t w, uint32_t h); // Recomposite a screen area
 window_t *wm_get_window_at(int32_t x, int32_t y);
 window_t *wm_get_focused_window(void);
 int wm_is_dragging(void);   // Returns 1 if currently dragging a window
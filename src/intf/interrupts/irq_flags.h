@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// Disable interrupts and return the previous RFLAGS, for short sections
+// that also run from interrupt handlers. Sections nest.
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags)::"memory");
+    return flags;
+}
+
+// Restore the interrupt flag saved by irq_save
+static inline void irq_restore(uint64_t flags) {
+    __asm__ volatile("push %0; popfq" ::"r"(flags) : "memory", "cc");
+}
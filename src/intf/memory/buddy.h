@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Buddy allocator for physical page frames (identity mapped)
+#define BUDDY_PAGE_SIZE 4096
+#define BUDDY_MAX_ORDER 9 // 2^9 pages = 2MB
+#define BUDDY_ORDER_COUNT (BUDDY_MAX_ORDER + 1)
+
+typedef struct
+{
+    uint64_t total_pages;                    // Pages handed to the allocator
+    uint64_t free_pages;                     // Pages currently free
+    uint32_t free_blocks[BUDDY_ORDER_COUNT]; // Free blocks per order
+} buddy_stats_t;
+
+// Feed the allocator from the Multiboot2 memory map (after paging_init)
+void buddy_init(void);
+
+// Allocate/free 2^order contiguous pages. Returns NULL on failure.
+void *buddy_alloc(uint32_t order);
+void buddy_free(void *addr);
+
+// Smallest order whose block holds `size` bytes (BUDDY_ORDER_COUNT if too big)
+uint32_t buddy_order_for(size_t size);
+
+// Returns 1 if `addr` is the start of a live buddy allocation
+int buddy_owns(const void *addr);
+
+void buddy_get_stats(buddy_stats_t *stats);
+
+// Page-granular allocation for large buffers: served by the buddy
+// allocator when possible, falling back to the kernel heap otherwise
+void *kmalloc_pages(size_t size);
+void kfree_pages(void *ptr);
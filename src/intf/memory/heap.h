@@ -16,4 +16,50 @@ void *krealloc(void *ptr, size_t new_size);
 
 void heap_stats(uint32_t *total_size, uint32_t *used_size, uint32_t *free_size);
 
-void heap_dump(void);
\ No newline at end of file
+void heap_dump(void);
+
+// First address past the initial (identity-mapped) heap region
+uintptr_t heap_region_end(void);
+
+// Let the heap grow by mapping pages, up to `limit` bytes in total
+void heap_set_growth_limit(uint64_t limit);
+
+// High-water mark of used bytes and the current growth limit
+void heap_growth_stats(uint32_t *peak, uint32_t *limit);
+
+// Free-space fragmentation report
+#define HEAP_FREE_BINS 48 // Free blocks are binned by floor(log2(size))
+
+typedef struct
+{
+    uint32_t free_blocks;
+    uint32_t free_bytes;
+    uint32_t largest_free;
+    uint32_t bin_counts[HEAP_FREE_BINS]; // Free blocks with size in [2^i, 2^(i+1))
+} heap_frag_info_t;
+
+void heap_frag_stats(heap_frag_info_t *info);
+
+// Per-size-class slab statistics
+typedef struct
+{
+    uint32_t object_size;
+    uint32_t slab_count;
+    uint32_t objects_in_use;
+} heap_slab_info_t;
+
+// Fills up to `max` entries, returns the number of size classes
+int heap_slab_stats(heap_slab_info_t *info, int max);
+
+// Alloc/free microbenchmark: block list vs. slab layer
+#define HEAP_BENCH_SIZES 5
+
+typedef struct
+{
+    uint32_t size;
+    uint64_t block_cycles; // Cycles per alloc+free through the block list
+    uint64_t slab_cycles;  // Cycles per alloc+free through the slab layer
+} heap_bench_result_t;
+
+void heap_benchmark(heap_bench_result_t *results, int max);
+void heap_benchmark_boot(void);
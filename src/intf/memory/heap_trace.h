@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Optional allocation profiler for kmalloc/kfree/kcalloc/kmalloc_aligned.
+// While enabled, every call is logged (caller, size, TSC) in a fixed ring
+// and aggregated per call site; live allocations are tracked so per-site
+// outstanding bytes point at leaks.
+
+#define HEAP_TRACE_RING 2048  // Events kept in the ring
+#define HEAP_TRACE_SITES 64   // Distinct call sites tracked
+#define HEAP_TRACE_LIVE 4096  // Live allocations tracked (power of 2)
+
+#define HEAP_TRACE_ALLOC 0
+#define HEAP_TRACE_FREE 1
+
+typedef struct
+{
+    void *caller;
+    void *ptr;
+    uint32_t size;
+    uint8_t op; // HEAP_TRACE_ALLOC or HEAP_TRACE_FREE
+    uint64_t tsc;
+} heap_trace_event_t;
+
+typedef struct
+{
+    void *caller;
+    uint32_t allocs;     // Allocations made from this site
+    uint32_t frees;      // Of those, how many were freed
+    uint64_t bytes;      // Total bytes requested
+    uint64_t live_bytes; // Bytes still outstanding
+} heap_trace_site_t;
+
+// Nonzero while tracing; checked inline by the allocator entry points
+extern uint8_t heap_trace_enabled;
+
+void heap_trace_start(void); // Clear all data and start tracing
+void heap_trace_stop(void);
+
+// Hooks called by heap.c
+void heap_trace_alloc(void *caller, void *ptr, size_t size);
+void heap_trace_free(void *caller, void *ptr);
+
+// Copy up to `max` sites sorted by bytes (by_count = 0) or by count
+int heap_trace_top(heap_trace_site_t *out, int max, int by_count);
+
+// Allocations per time slice over the window covered by the ring.
+// Returns the slice width in microseconds.
+uint64_t heap_trace_rate_histogram(uint32_t *buckets, int count);
+
+// Allocation counts by log2(size) (bucket i covers [2^i, 2^(i+1)))
+void heap_trace_size_histogram(uint32_t *buckets, int count);
+
+// Events recorded since start, and events lost to untracked sites/ptrs
+uint32_t heap_trace_event_count(void);
+uint32_t heap_trace_dropped(void);
@@ -4,3 +4,16 @@
 void paging_init(void);
 uint64_t paging_get_total_memory(void);
 uint32_t paging_get_table_count(void);
+
+// Bytes of physical address space identity mapped from 0
+uint64_t paging_get_mapped_size(void);
+
+// Map one 2MB page at a 2MB-aligned virtual address (0 on success)
+int paging_map_2mb(uint64_t virt, uint64_t phys);
+
+// Mark an identity-mapped physical range write-combining through the PAT.
+// The range is widened to whole 2MB pages. Returns 0 on success.
+int paging_set_write_combining(uint64_t phys, uint64_t size);
+
+// Translate a kernel virtual address to physical (0 if unmapped)
+uint64_t paging_virt_to_phys(const void *addr);
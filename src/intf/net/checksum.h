@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Internet checksum (RFC 1071). Partial sums are 32-bit one's complement
+// accumulators over the data exactly as it sits in memory, so network
+// byte order fields go in as stored and results are written back as-is.
+
+// Pick the summing kernel from the CPU features and check it against the
+// reference loop (call once after fpu_init)
+void checksum_init(void);
+
+// Name of the kernel chosen by checksum_init
+const char *checksum_strategy(void);
+
+// Add `len` bytes at `data` to the partial sum `sum`
+uint32_t checksum_partial(const void *data, size_t len, uint32_t sum);
+
+// Partial sum of the TCP/UDP IPv4 pseudo-header (addresses as stored)
+uint32_t checksum_pseudo(uint32_t src_ip, uint32_t dest_ip, uint8_t protocol, size_t length);
+
+// Fold a partial sum to 16 bits and complement it: the header value
+uint16_t checksum_fold(uint32_t sum);
+
+// RFC 1624 incremental update: the checksum after a 16-bit or 32-bit
+// field changes from `old_val` to `new_val` (both as stored)
+uint16_t checksum_update16(uint16_t check, uint16_t old_val, uint16_t new_val);
+uint16_t checksum_update32(uint16_t check, uint32_t old_val, uint32_t new_val);
+
+// Compare every kernel and the incremental update against the reference
+// byte-pair loop; returns the number of mismatches
+int checksum_selftest(void);
+
+// Throughput for one buffer size: reference loop, 64-bit add-with-carry
+// and the SIMD kernel (0 when the CPU has none), in MB/s
+#define CHECKSUM_BENCH_SIZES 6 // 64 B to 2 MiB in 8x steps
+typedef struct {
+    uint32_t size;
+    uint32_t ref_mbps;
+    uint32_t scalar_mbps;
+    uint32_t simd_mbps;
+} checksum_bench_result_t;
+
+// Run the checksum benchmark; returns the number of results filled
+int checksum_benchmark(checksum_bench_result_t *results, int count);
@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Vector kernels behind checksum_partial (net/checksum_sse2.c and
+// net/checksum_avx2.c). Each sums `blocks` blocks of CHECKSUM_SIMD_BLOCK
+// bytes as 32-bit words into a 64-bit total, inside its own FPU section.
+#define CHECKSUM_SIMD_BLOCK 64
+
+uint64_t checksum_sum_sse2(const void *data, size_t blocks);
+uint64_t checksum_sum_avx2(const void *data, size_t blocks);
@@ -1,6 +1,7 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include "net/netbuf.h"
 
 // Ethernet
 #define ETH_HEADER_SIZE 14
@@ -122,24 +123,40 @@ uint32_t net_get_ip(void);
 uint32_t net_get_gateway(void);
 
 // Packet handling
+#define NET_RX_BUDGET 16  // Frames handed to the stack per poll
+
 void net_process_packet(void);
-int net_handle_packet(uint8_t *buffer, size_t length);
+int net_poll(int budget);
+void net_rx_action(void);
+
+// Blocking calls bracket protocol state with these so the interrupt-exit
+// bottom half cannot run in the middle; net_wait() sleeps inside them
+void net_bh_disable(void);
+void net_bh_enable(void);
+void net_wait(void);
+
+// Receive handlers borrow the netbuf (data at their own header) and take
+// a reference with netbuf_get() to keep or resend it. The *_send_netbuf()
+// calls prepend their header in place and consume the caller's reference.
+int net_handle_packet(netbuf_t *nb);
 
 // Ethernet
 int eth_send(const uint8_t *dest_mac, uint16_t type, const void *data, size_t length);
+int eth_send_netbuf(netbuf_t *nb, const uint8_t *dest_mac, uint16_t type);
 
 // ARP
 void arp_init(void);
 int arp_lookup(uint32_t ip, uint8_t *mac);
-void arp_handle(const uint8_t *packet, size_t length);
+void arp_handle(netbuf_t *nb);
 int arp_request(uint32_t ip);
 
 // IP
 uint16_t ip_checksum(const void *data, size_t length);
 int ip_send(uint32_t dest_ip, uint8_t protocol, const void *data, size_t length);
-void ip_handle(const uint8_t *packet, size_t length);
+int ip_send_netbuf(netbuf_t *nb, uint32_t dest_ip, uint8_t protocol);
+void ip_handle(netbuf_t *nb);
 
 // ICMP
-void icmp_handle(const uint8_t *packet, size_t length, uint32_t src_ip);
+void icmp_handle(netbuf_t *nb, uint32_t src_ip);
 int icmp_send_echo_request(uint32_t dest_ip, uint16_t id, uint16_t seq);
 int ping(uint32_t dest_ip, int count);
@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Reference-counted packet buffers shared by the e1000 driver and the
+// protocol stack. Each buffer is one 2 KB slot of a page-backed pool, so
+// it is physically contiguous and can be handed to the NIC directly.
+//
+// Received frames fill the slot from its start; protocols netbuf_pull()
+// their headers off the front. Outgoing packets start NETBUF_HEADROOM
+// bytes in, and each layer netbuf_push()es its header in place. Packets
+// larger than one slot (TSO sends) continue in a chain of `frag` buffers
+// that the head's last reference releases.
+
+#define NETBUF_SIZE     2048  // Matches the e1000 receive buffer size
+#define NETBUF_HEADROOM 64    // Ethernet + IPv4 + TCP headers, rounded up
+#define NETBUF_COUNT    512
+
+// Per-packet offload requests (TX) and results (RX)
+#define NETBUF_TX_IP_CSUM    0x01  // NIC fills in the IPv4 header checksum
+#define NETBUF_TX_L4_CSUM    0x02  // NIC completes the TCP/UDP checksum
+#define NETBUF_TX_TSO        0x04  // NIC cuts the TCP payload into `mss` segments
+#define NETBUF_RX_IP_CSUM_OK 0x10  // NIC verified the IPv4 header checksum
+#define NETBUF_RX_L4_CSUM_OK 0x20  // NIC verified the TCP/UDP checksum
+
+typedef struct netbuf {
+    uint8_t *head;          // Start of the slot
+    uint8_t *data;          // First byte of the packet
+    uint16_t len;           // Bytes from data onward
+    uint16_t refcount;
+    uint64_t phys;          // Physical address of head
+    uint8_t offload;        // NETBUF_TX_* / NETBUF_RX_* flags
+    uint16_t mss;           // TSO segment payload size
+    struct netbuf *frag;    // Next buffer of the same packet
+    struct netbuf *next;    // Free list / owner's queue link
+} netbuf_t;
+
+void netbuf_init(void);
+
+// Fresh buffer with NETBUF_HEADROOM reserved and no data (NULL if empty)
+netbuf_t *netbuf_alloc(void);
+netbuf_t *netbuf_get(netbuf_t *nb);
+void netbuf_put(netbuf_t *nb);
+
+// Prepend/strip `n` bytes at the front; NULL if there is no room
+uint8_t *netbuf_push(netbuf_t *nb, size_t n);
+uint8_t *netbuf_pull(netbuf_t *nb, size_t n);
+// Extend the packet at the back, returning the new region
+uint8_t *netbuf_append(netbuf_t *nb, size_t n);
+void netbuf_trim(netbuf_t *nb, size_t len);
+// Copy `len` bytes onto the end of the packet, chaining fragments once
+// the last buffer is full; returns -1 if the pool runs dry
+int netbuf_append_data(netbuf_t *nb, const void *data, size_t len);
+// Length of the packet including its fragments
+size_t netbuf_total_len(const netbuf_t *nb);
+
+size_t netbuf_headroom(const netbuf_t *nb);
+size_t netbuf_tailroom(const netbuf_t *nb);
+uint64_t netbuf_dma_addr(const netbuf_t *nb);
+
+// Buffers currently free in the pool
+int netbuf_available(void);
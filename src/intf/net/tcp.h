@@ -22,6 +22,11 @@
 // TCP receive buffer size
 #define TCP_RECV_BUFFER_SIZE 4096
 
+// Largest segment payload on Ethernet, and the largest send handed to
+// the NIC in one piece when it segments for us (64 KiB frame)
+#define TCP_MSS         1460
+#define TCP_TSO_MAX     (65536 - ETH_HEADER_SIZE - IP_HEADER_SIZE - 20)
+
 // TCP Connection
 typedef struct {
     uint8_t state;
@@ -33,8 +38,9 @@ typedef struct {
     uint32_t seq_num;       // Our sequence number
     uint32_t ack_num;       // Their sequence number we've acknowledged
 
-    uint8_t recv_buffer[TCP_RECV_BUFFER_SIZE];
-    size_t recv_len;
+    netbuf_t *recv_head;    // Received segments, payload at data
+    netbuf_t *recv_tail;
+    size_t recv_len;        // Bytes queued (at most TCP_RECV_BUFFER_SIZE)
 
     int used;
 } tcp_connection_t;
@@ -47,5 +53,5 @@ int tcp_accept(int listen_sock);
 int tcp_send(int sock, const void *data, size_t length);
 int tcp_recv(int sock, void *buffer, size_t max_length);
 int tcp_close(int sock);
-void tcp_handle(const uint8_t *packet, size_t length, uint32_t src_ip);
+void tcp_handle(netbuf_t *nb, uint32_t src_ip);
 tcp_connection_t *tcp_get_connection(int sock);
@@ -6,16 +6,13 @@
 // Maximum UDP sockets
 #define MAX_UDP_SOCKETS 16
 
-// UDP receive buffer size
-#define UDP_RECV_BUFFER_SIZE 2048
-
 // UDP Socket
 typedef struct {
     uint16_t local_port;
     uint32_t remote_ip;
     uint16_t remote_port;
 
-    uint8_t recv_buffer[UDP_RECV_BUFFER_SIZE];
+    netbuf_t *recv_nb;      // Unread datagram, payload at data
     size_t recv_len;
     uint32_t recv_src_ip;
     uint16_t recv_src_port;
@@ -36,4 +33,4 @@ int udp_recvfrom(int sock, void *buffer, size_t max_length,
                  uint32_t *src_ip, uint16_t *src_port);
 int udp_recv(int sock, void *buffer, size_t max_length);
 int udp_close(int sock);
-void udp_handle(const uint8_t *packet, size_t length, uint32_t src_ip);
+void udp_handle(netbuf_t *nb, uint32_t src_ip);
@@ -35,9 +35,15 @@ void cmd_info(int argc, char **argv);
 void cmd_reboot(int argc, char **argv);
 void cmd_draw(int argc, char **argv);
 void cmd_cls(int argc, char **argv);
+void cmd_fontbench(int argc, char **argv);
+void cmd_pngbench(int argc, char **argv);
+void cmd_jpgbench(int argc, char **argv);
 void cmd_ls(int argc, char **argv);
 void cmd_cat(int argc, char **argv);
 void cmd_heap(int argc, char **argv);
+void cmd_heapprof(int argc, char **argv);
+void cmd_pages(int argc, char **argv);
+void cmd_membench(int argc, char **argv);
 void cmd_touch(int argc, char **argv);
 void cmd_rm(int argc, char **argv);
 void cmd_write(int argc, char **argv);
@@ -46,6 +52,8 @@ void cmd_ping(int argc, char **argv);
 void cmd_ifconfig(int argc, char **argv);
 void cmd_pci(int argc, char **argv);
 void cmd_netstat(int argc, char **argv);
+void cmd_offload(int argc, char **argv);
+void cmd_csumbench(int argc, char **argv);
 void cmd_wget(int argc, char **argv);
 void cmd_view(int argc, char **argv);
 void cmd_run(int argc, char **argv);
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+
+// CPU SIMD features usable inside kernel_fpu_begin/end
+#define FPU_FEATURE_SSE2 (1 << 0)
+#define FPU_FEATURE_XSAVE (1 << 1) // State saved with xsave instead of fxsave
+#define FPU_FEATURE_AVX (1 << 2)
+#define FPU_FEATURE_AVX2 (1 << 3)
+
+// Deepest nesting of FPU sections (thread + nested interrupts); opening
+// one more is a fatal bug
+#define FPU_MAX_DEPTH 4
+
+// Enable SSE (and AVX when supported) and install the #NM handler.
+// Call once after the IDT is set up.
+void fpu_init(void);
+
+// FPU_FEATURE_* bits available on this CPU
+uint32_t fpu_features(void);
+
+// Mark a region that may use SSE/AVX registers. Code between begin and
+// end must live in a SIMD translation unit (*_sse2.c / *_avx2.c) and must
+// not sleep. Sections nest; an interrupt that opens its own section only
+// saves the interrupted section's registers if it actually touches them.
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
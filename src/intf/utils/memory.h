@@ -3,6 +3,12 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// Pick copy/fill strategies from CPUID (call once at boot)
+void memory_init(void);
+
+// Name of the copy strategy chosen by memory_init
+const char *memory_copy_strategy(void);
+
 // Set memory to a value
 void *memset(void *ptr, int value, size_t num);
 
@@ -13,4 +19,16 @@ void *memcpy(void *dest, const void *src, size_t num);
 void *memmove(void *dest, const void *src, size_t num);
 
 // Compare memory
-int memcmp(const void *ptr1, const void *ptr2, size_t num);
\ No newline at end of file
+int memcmp(const void *ptr1, const void *ptr2, size_t num);
+
+// Copy throughput for one size, byte loop vs memcpy
+#define MEMORY_BENCH_SIZES 10 // 16 B to 4 MiB in 4x steps
+typedef struct
+{
+    uint32_t size;
+    uint32_t byte_mbps;
+    uint32_t fast_mbps;
+} memory_bench_result_t;
+
+// Run the copy benchmark; returns the number of results filled
+int memory_benchmark(memory_bench_result_t *results, int count);
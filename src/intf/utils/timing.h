@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+// Calibrate the TSC against PIT channel 2 (call once at boot)
+void timing_init(void);
+
+// Read the CPU timestamp counter
+uint64_t timing_rdtsc(void);
+
+// Raise one timer interrupt about `us` microseconds from now (capped at
+// ~55 ms), to end a hlt when work is due; re-arming replaces the last one
+void timing_arm_wakeup(uint64_t us);
+
+// Calibrated TSC frequency in kHz (0 if not calibrated)
+uint64_t timing_tsc_khz(void);
+
+// Convert a TSC cycle delta to nanoseconds / microseconds
+uint64_t timing_cycles_to_ns(uint64_t cycles);
+uint64_t timing_cycles_to_us(uint64_t cycles);
+
+// Throughput in MB/s for `bytes` processed in `cycles`
+uint32_t timing_mb_per_sec(uint64_t bytes, uint64_t cycles);